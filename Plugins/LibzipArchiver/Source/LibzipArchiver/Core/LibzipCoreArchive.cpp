@@ -0,0 +1,462 @@
+#include "LibzipCoreArchive.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include "zlib.h"
+
+namespace LibzipCore
+{
+	namespace
+	{
+		constexpr uint32_t LocalHeaderSignature = 0x04034b50;
+		constexpr uint32_t CentralHeaderSignature = 0x02014b50;
+		constexpr uint32_t EndOfCentralDirSignature = 0x06054b50;
+		constexpr uint32_t Zip64EndOfCentralDirSignature = 0x06064b50;
+		constexpr uint32_t Zip64EndOfCentralDirLocatorSignature = 0x07064b50;
+
+		constexpr uint64_t CentralHeaderSize = 46;
+		constexpr uint64_t EndOfCentralDirSize = 22;
+		constexpr uint64_t Zip64EndOfCentralDirSize = 56;
+		constexpr uint64_t Zip64EndOfCentralDirLocatorSize = 20;
+		constexpr uint64_t MaxCommentLength = 0xFFFF;
+		constexpr uint16_t Zip64ExtraFieldId = 0x0001;
+		constexpr uint16_t UnicodePathExtraFieldId = 0x7075;
+		constexpr uint16_t Utf8NameFlag = 1 << 11;
+
+		/** Code page 437 characters 0x80 to 0xFF, the lower half is ASCII. */
+		constexpr uint16_t Cp437UpperHalf[128] = {
+			0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7,
+			0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+			0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9,
+			0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+			0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA,
+			0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+			0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+			0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+			0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+			0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+			0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+			0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+			0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4,
+			0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+			0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248,
+			0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0,
+		};
+
+		/** zlib takes 32-bit lengths. */
+		constexpr uint64_t ZlibMaxChunk = 1u << 30;
+
+		uint16_t ReadUInt16(const uint8_t* Data)
+		{
+			return static_cast<uint16_t>(Data[0] | (Data[1] << 8));
+		}
+
+		uint32_t ReadUInt32(const uint8_t* Data)
+		{
+			return Data[0] | (Data[1] << 8) | (Data[2] << 16) | (static_cast<uint32_t>(Data[3]) << 24);
+		}
+
+		uint64_t ReadUInt64(const uint8_t* Data)
+		{
+			return ReadUInt32(Data) | (static_cast<uint64_t>(ReadUInt32(Data + 4)) << 32);
+		}
+
+		uint32_t ComputeCrc(const uint8_t* Data, uint64_t Size)
+		{
+			uLong Crc = crc32(0L, Z_NULL, 0);
+			while (Size > 0)
+			{
+				const uInt Chunk = static_cast<uInt>(std::min(Size, ZlibMaxChunk));
+				Crc = crc32(Crc, Data, Chunk);
+				Data += Chunk;
+				Size -= Chunk;
+			}
+			return static_cast<uint32_t>(Crc);
+		}
+
+		/** Same check as libzip, which takes names that are not valid UTF-8 for code page 437. */
+		bool IsUtf8(const uint8_t* Name, size_t Length)
+		{
+			for (size_t Pos = 0; Pos < Length; ++Pos)
+			{
+				const uint8_t Byte = Name[Pos];
+				if ((Byte > 31 && Byte < 128) || Byte == '\r' || Byte == '\n' || Byte == '\t')
+				{
+					continue;
+				}
+				size_t Continuations;
+				if ((Byte & 0xE0) == 0xC0) { Continuations = 1; }
+				else if ((Byte & 0xF0) == 0xE0) { Continuations = 2; }
+				else if ((Byte & 0xF8) == 0xF0) { Continuations = 3; }
+				else { return false; }
+				if (Pos + Continuations >= Length)
+				{
+					return false;
+				}
+				for (size_t Next = 1; Next <= Continuations; ++Next)
+				{
+					if ((Name[Pos + Next] & 0xC0) != 0x80)
+					{
+						return false;
+					}
+				}
+				Pos += Continuations;
+			}
+			return true;
+		}
+
+		std::string Cp437ToUtf8(const uint8_t* Name, size_t Length)
+		{
+			std::string Result;
+			Result.reserve(Length * 2);
+			for (size_t Pos = 0; Pos < Length; ++Pos)
+			{
+				const uint16_t Char = Name[Pos] < 0x80 ? Name[Pos] : Cp437UpperHalf[Name[Pos] - 0x80];
+				if (Char < 0x80)
+				{
+					Result.push_back(static_cast<char>(Char));
+				}
+				else if (Char < 0x800)
+				{
+					Result.push_back(static_cast<char>(0xC0 | (Char >> 6)));
+					Result.push_back(static_cast<char>(0x80 | (Char & 0x3F)));
+				}
+				else
+				{
+					Result.push_back(static_cast<char>(0xE0 | (Char >> 12)));
+					Result.push_back(static_cast<char>(0x80 | ((Char >> 6) & 0x3F)));
+					Result.push_back(static_cast<char>(0x80 | (Char & 0x3F)));
+				}
+			}
+			return Result;
+		}
+
+		/** DOS times carry no time zone, libzip reads them as local time. */
+		int64_t DosTimeToUnixTime(uint16_t Time, uint16_t Date)
+		{
+			std::tm Tm = {};
+			Tm.tm_isdst = -1;
+			Tm.tm_year = ((Date >> 9) & 127) + 1980 - 1900;
+			Tm.tm_mon = ((Date >> 5) & 15) - 1;
+			Tm.tm_mday = Date & 31;
+			Tm.tm_hour = (Time >> 11) & 31;
+			Tm.tm_min = (Time >> 5) & 63;
+			Tm.tm_sec = (Time << 1) & 62;
+			return static_cast<int64_t>(std::mktime(&Tm));
+		}
+
+		bool Inflate(const uint8_t* Compressed, uint64_t CompressedSize, uint8_t* Data, uint64_t Size)
+		{
+			z_stream Stream = {};
+			if (inflateInit2(&Stream, -MAX_WBITS) != Z_OK)
+			{
+				return false;
+			}
+			Stream.next_in = const_cast<Bytef*>(Compressed);
+			Stream.next_out = Data;
+			uint64_t InputLeft = CompressedSize;
+			uint64_t OutputLeft = Size;
+			int Result = Z_OK;
+			while (Result == Z_OK)
+			{
+				if (Stream.avail_in == 0 && InputLeft > 0)
+				{
+					Stream.avail_in = static_cast<uInt>(std::min(InputLeft, ZlibMaxChunk));
+					InputLeft -= Stream.avail_in;
+				}
+				if (Stream.avail_out == 0 && OutputLeft > 0)
+				{
+					Stream.avail_out = static_cast<uInt>(std::min(OutputLeft, ZlibMaxChunk));
+					OutputLeft -= Stream.avail_out;
+				}
+				Result = inflate(&Stream, Z_NO_FLUSH);
+			}
+			const bool bComplete = Result == Z_STREAM_END && Stream.avail_out == 0 && OutputLeft == 0;
+			inflateEnd(&Stream);
+			return bComplete;
+		}
+
+		bool SeekFile(std::FILE* File, uint64_t Offset)
+		{
+#if defined(_WIN32)
+			return _fseeki64(File, static_cast<int64_t>(Offset), SEEK_SET) == 0;
+#else
+			return fseeko(File, static_cast<off_t>(Offset), SEEK_SET) == 0;
+#endif
+		}
+	}
+
+	bool ReadEndOfCentralDirectory(uint64_t ArchiveSize, const FReadFunction& Read, FEndOfCentralDirectory& End)
+	{
+		// The end of central directory record is followed by a comment of up to 64 KiB, and preceded by the ZIP64 locator if any.
+		const uint64_t TailSize = std::min(ArchiveSize, EndOfCentralDirSize + MaxCommentLength + Zip64EndOfCentralDirLocatorSize);
+		if (TailSize < EndOfCentralDirSize)
+		{
+			return false;
+		}
+		std::vector<uint8_t> Tail(TailSize);
+		if (!Read(ArchiveSize - TailSize, TailSize, Tail.data()))
+		{
+			return false;
+		}
+
+		// A record in the comment of the real one, or left behind by an append, only wins if no record ends the archive.
+		int64_t EndPos = -1;
+		for (int64_t Pos = static_cast<int64_t>(TailSize - EndOfCentralDirSize); Pos >= 0; --Pos)
+		{
+			if (ReadUInt32(&Tail[Pos]) != EndOfCentralDirSignature)
+			{
+				continue;
+			}
+			const uint64_t RecordEnd = Pos + EndOfCentralDirSize + ReadUInt16(&Tail[Pos + 20]);
+			if (RecordEnd == TailSize)
+			{
+				EndPos = Pos;
+				break;
+			}
+			if (RecordEnd < TailSize && EndPos < 0)
+			{
+				EndPos = Pos;
+			}
+		}
+		if (EndPos < 0)
+		{
+			return false;
+		}
+
+		const uint8_t* Record = &Tail[EndPos];
+		if (ReadUInt16(Record + 4) != 0 || ReadUInt16(Record + 6) != 0)
+		{
+			return false;
+		}
+		End.EntryCount = ReadUInt16(Record + 10);
+		End.DirectorySize = ReadUInt32(Record + 12);
+		End.DirectoryOffset = ReadUInt32(Record + 16);
+		End.Comment.assign(Record + EndOfCentralDirSize, Record + EndOfCentralDirSize + ReadUInt16(Record + 20));
+
+		const int64_t LocatorPos = EndPos - static_cast<int64_t>(Zip64EndOfCentralDirLocatorSize);
+		if (LocatorPos >= 0 && ReadUInt32(&Tail[LocatorPos]) == Zip64EndOfCentralDirLocatorSignature)
+		{
+			const uint64_t Zip64RecordOffset = ReadUInt64(&Tail[LocatorPos + 8]);
+			uint8_t Zip64Record[Zip64EndOfCentralDirSize];
+			if (Zip64RecordOffset + Zip64EndOfCentralDirSize > ArchiveSize
+				|| !Read(Zip64RecordOffset, Zip64EndOfCentralDirSize, Zip64Record)
+				|| ReadUInt32(Zip64Record) != Zip64EndOfCentralDirSignature)
+			{
+				return false;
+			}
+			End.EntryCount = ReadUInt64(Zip64Record + 32);
+			End.DirectorySize = ReadUInt64(Zip64Record + 40);
+			End.DirectoryOffset = ReadUInt64(Zip64Record + 48);
+		}
+		else if (End.EntryCount == 0xFFFF || End.DirectorySize == 0xFFFFFFFF || End.DirectoryOffset == 0xFFFFFFFF)
+		{
+			return false;
+		}
+		return End.DirectoryOffset + End.DirectorySize <= ArchiveSize;
+	}
+
+	bool ReadCentralDirectory(uint64_t ArchiveSize, const FReadFunction& Read, std::vector<FEntry>& Entries)
+	{
+		FEndOfCentralDirectory End;
+		if (!ReadEndOfCentralDirectory(ArchiveSize, Read, End))
+		{
+			return false;
+		}
+		const uint64_t EntryCount = End.EntryCount;
+		const uint64_t DirectorySize = End.DirectorySize;
+		const uint64_t DirectoryOffset = End.DirectoryOffset;
+		if (EntryCount > DirectorySize / CentralHeaderSize)
+		{
+			return false;
+		}
+
+		std::vector<uint8_t> Directory(DirectorySize);
+		if (DirectorySize > 0 && !Read(DirectoryOffset, DirectorySize, Directory.data()))
+		{
+			return false;
+		}
+
+		Entries.clear();
+		Entries.reserve(EntryCount);
+		uint64_t Pos = 0;
+		for (uint64_t Index = 0; Index < EntryCount; ++Index)
+		{
+			if (Pos + CentralHeaderSize > DirectorySize || ReadUInt32(&Directory[Pos]) != CentralHeaderSignature)
+			{
+				return false;
+			}
+			const uint8_t* Record = &Directory[Pos];
+			const uint16_t NameLength = ReadUInt16(Record + 28);
+			const uint16_t ExtraLength = ReadUInt16(Record + 30);
+			const uint16_t CommentLength = ReadUInt16(Record + 32);
+			const uint64_t RecordSize = CentralHeaderSize + NameLength + ExtraLength + CommentLength;
+			if (Pos + RecordSize > DirectorySize)
+			{
+				return false;
+			}
+
+			FEntry Entry;
+			const uint16_t Flags = ReadUInt16(Record + 8);
+			Entry.bEncrypted = (Flags & 1) != 0;
+			Entry.Method = ReadUInt16(Record + 10);
+			Entry.ModificationTime = DosTimeToUnixTime(ReadUInt16(Record + 12), ReadUInt16(Record + 14));
+			Entry.Crc = ReadUInt32(Record + 16);
+			Entry.CompressedSize = ReadUInt32(Record + 20);
+			Entry.Size = ReadUInt32(Record + 24);
+			Entry.LocalHeaderOffset = ReadUInt32(Record + 42);
+			const uint8_t* Name = Record + CentralHeaderSize;
+			if ((Flags & Utf8NameFlag) != 0 || IsUtf8(Name, NameLength))
+			{
+				Entry.Name.assign(reinterpret_cast<const char*>(Name), NameLength);
+			}
+			else
+			{
+				Entry.Name = Cp437ToUtf8(Name, NameLength);
+			}
+
+			// Values that do not fit their field are in the ZIP64 extra field, in this order.
+			const uint8_t* Extra = Name + NameLength;
+			for (uint32_t FieldPos = 0; FieldPos + 4 <= ExtraLength;)
+			{
+				const uint16_t FieldId = ReadUInt16(Extra + FieldPos);
+				const uint16_t FieldSize = ReadUInt16(Extra + FieldPos + 2);
+				if (FieldPos + 4 + FieldSize > ExtraLength)
+				{
+					break;
+				}
+				if (FieldId == Zip64ExtraFieldId)
+				{
+					const uint8_t* Value = Extra + FieldPos + 4;
+					const uint8_t* ValueEnd = Value + FieldSize;
+					if (Entry.Size == 0xFFFFFFFF && Value + 8 <= ValueEnd) { Entry.Size = ReadUInt64(Value); Value += 8; }
+					if (Entry.CompressedSize == 0xFFFFFFFF && Value + 8 <= ValueEnd) { Entry.CompressedSize = ReadUInt64(Value); Value += 8; }
+					if (Entry.LocalHeaderOffset == 0xFFFFFFFF && Value + 8 <= ValueEnd) { Entry.LocalHeaderOffset = ReadUInt64(Value); }
+				}
+				// A UTF-8 name written next to the stored one is used while it still belongs to it.
+				else if (FieldId == UnicodePathExtraFieldId && FieldSize >= 5 && Extra[FieldPos + 4] == 1
+					&& ReadUInt32(Extra + FieldPos + 5) == ComputeCrc(Name, NameLength) && IsUtf8(Extra + FieldPos + 9, FieldSize - 5))
+				{
+					Entry.Name.assign(reinterpret_cast<const char*>(Extra + FieldPos + 9), FieldSize - 5);
+				}
+				FieldPos += 4 + FieldSize;
+			}
+
+			// Buffers are sized from these, so data running past the archive fails here rather than when read.
+			if (Entry.LocalHeaderOffset > ArchiveSize || Entry.CompressedSize > ArchiveSize - Entry.LocalHeaderOffset)
+			{
+				return false;
+			}
+
+			Entries.push_back(std::move(Entry));
+			Pos += RecordSize;
+		}
+		return true;
+	}
+
+	int64_t GetDataOffset(const uint8_t* Header, int64_t LocalHeaderOffset)
+	{
+		if (ReadUInt32(Header) != LocalHeaderSignature)
+		{
+			return -1;
+		}
+		return LocalHeaderOffset + LocalHeaderSize + ReadUInt16(Header + 26) + ReadUInt16(Header + 28);
+	}
+
+	bool CanDecode(const FEntry& Entry)
+	{
+		return !Entry.bEncrypted && (Entry.Method == MethodDeflate || (Entry.Method == MethodStore && Entry.CompressedSize == Entry.Size));
+	}
+
+	bool Decode(const FEntry& Entry, const uint8_t* Compressed, uint8_t* Data)
+	{
+		if (!CanDecode(Entry))
+		{
+			return false;
+		}
+		if (Entry.Size == 0)
+		{
+			return Entry.Crc == 0;
+		}
+		if (Entry.Method == MethodStore)
+		{
+			if (Data != Compressed)
+			{
+				std::memcpy(Data, Compressed, Entry.Size);
+			}
+		}
+		else if (!Inflate(Compressed, Entry.CompressedSize, Data, Entry.Size))
+		{
+			return false;
+		}
+		return ComputeCrc(Data, Entry.Size) == Entry.Crc;
+	}
+
+	FArchiveReader::~FArchiveReader()
+	{
+		Close();
+	}
+
+	bool FArchiveReader::Open(const std::string& Path)
+	{
+		Close();
+		File = std::fopen(Path.c_str(), "rb");
+		if (File == nullptr)
+		{
+			return false;
+		}
+#if defined(_WIN32)
+		const bool bSeeked = _fseeki64(File, 0, SEEK_END) == 0;
+		const int64_t ArchiveSize = bSeeked ? _ftelli64(File) : -1;
+#else
+		const bool bSeeked = fseeko(File, 0, SEEK_END) == 0;
+		const int64_t ArchiveSize = bSeeked ? static_cast<int64_t>(ftello(File)) : -1;
+#endif
+		const FReadFunction ReadFile = [this](uint64_t Offset, uint64_t Size, uint8_t* Out) { return ReadAt(Offset, Size, Out); };
+		if (ArchiveSize < 0 || !ReadCentralDirectory(static_cast<uint64_t>(ArchiveSize), ReadFile, Entries))
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void FArchiveReader::Close()
+	{
+		if (File != nullptr)
+		{
+			std::fclose(File);
+			File = nullptr;
+		}
+		Entries.clear();
+	}
+
+	bool FArchiveReader::Read(size_t Index, std::vector<uint8_t>& Data)
+	{
+		if (File == nullptr || Index >= Entries.size() || !CanDecode(Entries[Index]))
+		{
+			return false;
+		}
+		const FEntry& Entry = Entries[Index];
+		uint8_t Header[LocalHeaderSize];
+		int64_t DataOffset;
+		if (!ReadAt(Entry.LocalHeaderOffset, LocalHeaderSize, Header) || (DataOffset = GetDataOffset(Header, Entry.LocalHeaderOffset)) < 0)
+		{
+			return false;
+		}
+
+		Data.resize(Entry.Size);
+		if (Entry.Method == MethodStore)
+		{
+			// Read in place, Decode then only checks the CRC.
+			return ReadAt(DataOffset, Entry.Size, Data.data()) && Decode(Entry, Data.data(), Data.data());
+		}
+		Compressed.resize(Entry.CompressedSize);
+		return ReadAt(DataOffset, Entry.CompressedSize, Compressed.data()) && Decode(Entry, Compressed.data(), Data.data());
+	}
+
+	bool FArchiveReader::ReadAt(uint64_t Offset, uint64_t Size, uint8_t* Out)
+	{
+		return Size == 0 || (SeekFile(File, Offset) && std::fread(Out, 1, Size, File) == Size);
+	}
+}
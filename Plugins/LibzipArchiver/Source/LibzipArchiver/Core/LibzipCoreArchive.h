@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Engine independent reading of zip archives for tools built without the engine. Only needs the C++ standard library and zlib.
+ * The plugin's reader pool, behind concurrent reads, mounted archives and the extraction pipeline, takes its entry tables from
+ * ReadCentralDirectory and decodes with Decode. Encrypted entries, other methods and archives opened with
+ * ULibzipArchiver::OpenArchiveFromStorage are read through libzip, which hands only deflate data to Decode.
+ */
+namespace LibzipCore
+{
+	constexpr uint16_t MethodStore = 0;
+	constexpr uint16_t MethodDeflate = 8;
+	constexpr int64_t LocalHeaderSize = 30;
+
+	struct FEntry
+	{
+		/**
+		 * UTF-8, decoded like libzip does: names neither flagged nor valid as UTF-8 are code page 437, and a matching
+		 * Info-ZIP Unicode path field replaces the stored name.
+		 */
+		std::string Name;
+		uint64_t Size = 0;
+		uint64_t CompressedSize = 0;
+		uint64_t LocalHeaderOffset = 0;
+		uint32_t Crc = 0;
+		/** Seconds since the Unix epoch, from the DOS time read as local time. */
+		int64_t ModificationTime = 0;
+		uint16_t Method = 0;
+		bool bEncrypted = false;
+	};
+
+	/** Reads Size bytes at Offset of the archive into Out. */
+	using FReadFunction = std::function<bool(uint64_t Offset, uint64_t Size, uint8_t* Out)>;
+
+	/** Where the central directory is, taken from the ZIP64 end of central directory record when there is one. */
+	struct FEndOfCentralDirectory
+	{
+		uint64_t EntryCount = 0;
+		uint64_t DirectorySize = 0;
+		uint64_t DirectoryOffset = 0;
+		std::vector<uint8_t> Comment;
+	};
+
+	/**
+	 * Finds the end of central directory record of an archive of ArchiveSize bytes, preferring one whose comment ends the archive.
+	 * Fails for multi-disk archives.
+	 */
+	bool ReadEndOfCentralDirectory(uint64_t ArchiveSize, const FReadFunction& Read, FEndOfCentralDirectory& End);
+
+	/** Parses the central directory of an archive of ArchiveSize bytes, including ZIP64 records. Fails for entries whose data would run past the archive. */
+	bool ReadCentralDirectory(uint64_t ArchiveSize, const FReadFunction& Read, std::vector<FEntry>& Entries);
+
+	/** Returns the offset of the data following the local header at LocalHeaderOffset, or -1 if Header is no local header. */
+	int64_t GetDataOffset(const uint8_t* Header, int64_t LocalHeaderOffset);
+
+	/** Unencrypted stored and deflate entries can be decoded. */
+	bool CanDecode(const FEntry& Entry);
+
+	/** Decodes the compressed data of Entry into Data, which holds Entry.Size bytes, and checks its CRC. */
+	bool Decode(const FEntry& Entry, const uint8_t* Compressed, uint8_t* Data);
+
+	/** Archive file read with plain file I/O. Not thread safe; use one reader per thread. */
+	class FArchiveReader
+	{
+	public:
+		FArchiveReader() = default;
+		FArchiveReader(const FArchiveReader&) = delete;
+		FArchiveReader& operator=(const FArchiveReader&) = delete;
+		~FArchiveReader();
+
+		bool Open(const std::string& Path);
+		void Close();
+
+		const std::vector<FEntry>& GetEntries() const { return Entries; }
+
+		/** Reads entry Index into Data, resizing it to the entry size. */
+		bool Read(size_t Index, std::vector<uint8_t>& Data);
+
+	private:
+		bool ReadAt(uint64_t Offset, uint64_t Size, uint8_t* Out);
+
+		std::FILE* File = nullptr;
+		std::vector<FEntry> Entries;
+		std::vector<uint8_t> Compressed;
+	};
+}
@@ -0,0 +1,107 @@
+#include "LibzipCoreDirectoryIndex.h"
+#include <algorithm>
+
+namespace LibzipCore
+{
+	void FDirectoryIndex::Add(std::string Name, uint64_t Size)
+	{
+		Entries.push_back({ std::move(Name), Size });
+	}
+
+	void FDirectoryIndex::Build()
+	{
+		// Byte order of UTF-8 is code point order, and keeps every prefix in one range.
+		std::sort(Entries.begin(), Entries.end(), [](const FIndexEntry& A, const FIndexEntry& B) { return A.Name < B.Name; });
+		SizeSums.resize(Entries.size() + 1);
+		SizeSums[0] = 0;
+		for (size_t Index = 0; Index < Entries.size(); ++Index)
+		{
+			SizeSums[Index + 1] = SizeSums[Index] + Entries[Index].Size;
+		}
+	}
+
+	std::string FDirectoryIndex::ToPrefix(const std::string& Path)
+	{
+		std::string Prefix = Path;
+		std::replace(Prefix.begin(), Prefix.end(), '\\', '/');
+		Prefix.erase(0, std::min(Prefix.find_first_not_of('/'), Prefix.size()));
+		if (!Prefix.empty() && Prefix.back() != '/')
+		{
+			Prefix += '/';
+		}
+		return Prefix;
+	}
+
+	size_t FDirectoryIndex::LowerBound(const std::string& Key, size_t Low, size_t High) const
+	{
+		while (Low < High)
+		{
+			const size_t Middle = Low + (High - Low) / 2;
+			if (Entries[Middle].Name < Key)
+			{
+				Low = Middle + 1;
+			}
+			else
+			{
+				High = Middle;
+			}
+		}
+		return Low;
+	}
+
+	void FDirectoryIndex::FindRange(const std::string& Prefix, size_t& Begin, size_t& End) const
+	{
+		if (Prefix.empty())
+		{
+			Begin = 0;
+			End = Entries.size();
+			return;
+		}
+		Begin = LowerBound(Prefix, 0, Entries.size());
+		// '0' follows '/', so this is the first name after all names starting with Prefix.
+		End = LowerBound(Prefix.substr(0, Prefix.size() - 1) + '0', Begin, Entries.size());
+	}
+
+	void FDirectoryIndex::List(const std::string& Path, bool bRecursive, std::vector<std::string>& Names) const
+	{
+		const std::string Prefix = ToPrefix(Path);
+		size_t Begin, End;
+		FindRange(Prefix, Begin, End);
+		for (size_t Index = Begin; Index < End;)
+		{
+			const std::string& Name = Entries[Index].Name;
+			const size_t Slash = Name.find('/', Prefix.size());
+			if (Name.size() == Prefix.size() || (bRecursive && Name.back() == '/'))
+			{
+				// The directory itself, or a subdirectory entry of a recursive listing.
+				++Index;
+			}
+			else if (bRecursive || Slash == std::string::npos)
+			{
+				Names.push_back(Name);
+				++Index;
+			}
+			else
+			{
+				// List the subdirectory once and skip everything below it.
+				Names.push_back(Name.substr(0, Slash + 1));
+				Index = LowerBound(Name.substr(0, Slash) + '0', Index + 1, End);
+			}
+		}
+	}
+
+	bool FDirectoryIndex::Exists(const std::string& Path) const
+	{
+		const std::string Prefix = ToPrefix(Path);
+		size_t Begin, End;
+		FindRange(Prefix, Begin, End);
+		return Prefix.empty() || Begin < End;
+	}
+
+	uint64_t FDirectoryIndex::GetSize(const std::string& Path) const
+	{
+		size_t Begin, End;
+		FindRange(ToPrefix(Path), Begin, End);
+		return SizeSums[End] - SizeSums[Begin];
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace LibzipCore
+{
+	/**
+	 * Directory view of the flat entry names of an archive.
+	 * Names are kept sorted, so that the entries below a directory form one range found by binary search, together with prefix
+	 * sums of the entry sizes, so that the size of a directory is the difference of two sums. Listing a directory costs in
+	 * proportion to its result instead of to the number of entries.
+	 */
+	class FDirectoryIndex
+	{
+	public:
+		/** Adds an entry with its UTF-8 name before Build. */
+		void Add(std::string Name, uint64_t Size);
+		void Build();
+
+		/**
+		 * Without bRecursive, lists the files and subdirectories directly in Path, with subdirectories ending in a slash.
+		 * With it, lists all files below Path. Path is empty for the root.
+		 */
+		void List(const std::string& Path, bool bRecursive, std::vector<std::string>& Names) const;
+		bool Exists(const std::string& Path) const;
+		uint64_t GetSize(const std::string& Path) const;
+
+	private:
+		struct FIndexEntry
+		{
+			std::string Name;
+			uint64_t Size;
+		};
+
+		/** Path as a name prefix with forward slashes and a trailing slash, or empty for the root. */
+		static std::string ToPrefix(const std::string& Path);
+
+		/** First entry in [Low, High) whose name is not less than Key. */
+		size_t LowerBound(const std::string& Key, size_t Low, size_t High) const;
+		/** Entries whose name starts with Prefix. */
+		void FindRange(const std::string& Prefix, size_t& Begin, size_t& End) const;
+
+		std::vector<FIndexEntry> Entries;
+		/** SizeSums[Index] is the size of all entries before Index. */
+		std::vector<uint64_t> SizeSums;
+	};
+}
@@ -1,5 +1,6 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
+using System.IO;
 using UnrealBuildTool;
 
 public class LibzipArchiver : ModuleRules
@@ -17,6 +18,8 @@ public class LibzipArchiver : ModuleRules
 		
 		PrivateIncludePaths.AddRange(
 			new string[] {
+				// Engine independent code, also built by Standalone/CMakeLists.txt.
+				Path.Combine(ModuleDirectory, "Core"),
 				// ... add other private include paths required here ...
 			}
 			);
@@ -37,6 +40,7 @@ public class LibzipArchiver : ModuleRules
 		PrivateDependencyModuleNames.AddRange(
 			new string[]
 			{
+				"Json",
 				// ... add private dependencies that you statically link with here ...	
 			}
 			);
@@ -48,5 +52,8 @@ public class LibzipArchiver : ModuleRules
 				// ... add any modules that your module loads dynamically here ...
 			}
 			);
+
+		// Mounted entries are inflated in chunks, which needs the streaming zlib API.
+		AddEngineThirdPartyPrivateStaticDependencies(Target, "zlib");
 	}
 }
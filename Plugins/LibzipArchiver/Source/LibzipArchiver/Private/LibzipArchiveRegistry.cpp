@@ -0,0 +1,114 @@
+#include "LibzipArchiveRegistry.h"
+#include "LibzipArchiverLog.h"
+#include "LibzipReaderPool.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	FLibzipArchiveRegistry* ArchiveRegistry = nullptr;
+}
+
+void FLibzipArchiveRegistry::Startup()
+{
+	check(ArchiveRegistry == nullptr);
+	ArchiveRegistry = new FLibzipArchiveRegistry();
+}
+
+void FLibzipArchiveRegistry::Shutdown()
+{
+	delete ArchiveRegistry;
+	ArchiveRegistry = nullptr;
+}
+
+FLibzipArchiveRegistry* FLibzipArchiveRegistry::Get()
+{
+	return ArchiveRegistry;
+}
+
+TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> FLibzipArchiveRegistry::Acquire(const FString& ArchivePath, const FString& Password, bool* bOutShared)
+{
+	if (bOutShared != nullptr)
+	{
+		*bOutShared = false;
+	}
+
+	FString FullPath = FPaths::ConvertRelativePathToFull(ArchivePath);
+	FPaths::NormalizeFilename(FullPath);
+	const FFileStatData StatData = FPlatformFileManager::Get().GetPlatformFile().GetStatData(*FullPath);
+	if (!StatData.bIsValid || StatData.bIsDirectory)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not exist archive %s"), *ArchivePath);
+		return nullptr;
+	}
+
+	auto Matches = [&StatData, &Password](const FEntry& Entry) {
+		return Entry.ModificationTime == StatData.ModificationTime && Entry.Size == StatData.FileSize && Entry.Password == Password;
+	};
+
+	{
+		FScopeLock ScopeLock(&Lock);
+		const FEntry* Entry = Entries.Find(FullPath);
+		if (Entry != nullptr && Matches(*Entry))
+		{
+			TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool = Entry->Pool.Pin();
+			if (Pool.IsValid())
+			{
+				if (bOutShared != nullptr)
+				{
+					*bOutShared = true;
+				}
+				return Pool;
+			}
+		}
+	}
+
+	// The directory is parsed outside of the lock, so that opening one archive does not hold up lookups of others.
+	TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool = FLibzipReaderPool::Open(FullPath, Password);
+	if (!Pool.IsValid())
+	{
+		return nullptr;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	FEntry& Entry = Entries.FindOrAdd(FullPath);
+	if (Matches(Entry))
+	{
+		// Another thread opened the archive meanwhile.
+		TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> OtherPool = Entry.Pool.Pin();
+		if (OtherPool.IsValid())
+		{
+			if (bOutShared != nullptr)
+			{
+				*bOutShared = true;
+			}
+			return OtherPool;
+		}
+	}
+	Entry.ModificationTime = StatData.ModificationTime;
+	Entry.Size = StatData.FileSize;
+	Entry.Password = Password;
+	Entry.Pool = Pool;
+
+	// Drop archives nobody uses anymore, which only needs to happen when one is added.
+	for (auto It = Entries.CreateIterator(); It; ++It)
+	{
+		if (!It->Value.Pool.IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+	return Pool;
+}
+
+int32 FLibzipArchiveRegistry::Num()
+{
+	FScopeLock ScopeLock(&Lock);
+	int32 Count = 0;
+	for (const TPair<FString, FEntry>& Entry : Entries)
+	{
+		Count += Entry.Value.Pool.IsValid() ? 1 : 0;
+	}
+	return Count;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FLibzipReaderPool;
+
+/**
+ * Process-wide table of archives opened for concurrent reads, so that everyone opening the same archive shares one entry table and one set of readers.
+ * Archives are identified by full path, and an entry is only reused while the file keeps its size and modification time.
+ * Users that acquired an archive before its file was replaced keep its old entry table, and have to acquire it again.
+ * The registry holds weak references, so an archive is released once the last user closes it. Created and destroyed by FLibzipArchiverModule.
+ */
+class FLibzipArchiveRegistry
+{
+public:
+	static void Startup();
+	static void Shutdown();
+
+	/** Returns null before the module started up and after it shut down. */
+	static FLibzipArchiveRegistry* Get();
+
+	/**
+	 * Returns the shared readers of ArchivePath, opening the archive if it is not open yet or has changed since.
+	 * bOutShared tells whether the archive was already open.
+	 */
+	TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Acquire(const FString& ArchivePath, const FString& Password, bool* bOutShared = nullptr);
+
+	/** Number of archives that are currently open. */
+	int32 Num();
+
+private:
+	struct FEntry
+	{
+		FDateTime ModificationTime;
+		int64 Size = 0;
+		FString Password;
+		TWeakPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool;
+	};
+
+	FCriticalSection Lock;
+	TMap<FString, FEntry> Entries;
+};
@@ -1,12 +1,189 @@
 #include "LibzipArchiver.h"
+#include "LibzipArchiveRegistry.h"
+#include "LibzipArchiverLog.h"
+#include "LibzipArchiverStats.h"
+#include "LibzipArchiverTrace.h"
+#include "LibzipBatchedWriter.h"
+#include "LibzipCentralDirectory.h"
+#include "LibzipCoreArchive.h"
+#include "LibzipDirectoryIndex.h"
+#include "LibzipEntryFileHandle.h"
+#include "LibzipExtractionPipeline.h"
+#include "LibzipFileSink.h"
+#include "LibzipMemorySink.h"
+#include "LibzipMemorySource.h"
+#include "LibzipPlatformFileSource.h"
+#include "LibzipPosixFileSource.h"
+#include "LibzipReaderPool.h"
 #include "zip.h"
 #include "zipint.h"
 #include "Misc/Paths.h"
+#include "Misc/FileHelper.h"
 #include "HAL/PlatformFilemanager.h"
+#include "HAL/FileManagerGeneric.h"
+#include "Async/Async.h"
+#include "Misc/ScopeExit.h"
+#include "Misc/ScopeLock.h"
+#include "Algo/BinarySearch.h"
+#include <atomic>
+
+namespace
+{
+	/** Minimum progress delta between two progress callbacks from libzip. */
+	constexpr double CloseProgressPrecision = 0.01;
+
+	/** Read ahead of an entry opened from the platform file, and of the local header of the entry after it. */
+	constexpr int64 EntryPrefetchBytes = 256 * 1024;
+	constexpr int64 LocalHeaderPrefetchBytes = 4 * 1024;
+
+	constexpr zip_uint64_t WriteEntryBufferSize = 4 * 1024 * 1024;
+
+	/** Largest entry written through the batched writer by WriteAllEntriesToStorage. */
+	constexpr zip_uint64_t BatchedWriteMaxBytes = 1024 * 1024;
+
+	/** Opens an archive on Source, which is freed if that fails. A Source that failed to be created is reported through Error too. */
+	zip* OpenArchiveOnSource(zip_source_t* Source, int Flags, zip_error_t* Error)
+	{
+		// libzip reads the central directory while opening.
+		LIBZIP_TRACE_SCOPE(LibzipArchiver_ParseCentralDirectory);
+		zip* Archive = Source != NULL ? zip_open_from_source(Source, Flags, Error) : NULL;
+		if (Archive == NULL)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_open %d"), zip_error_code_zip(Error));
+			if (Source != NULL)
+			{
+				zip_source_free(Source);
+			}
+		}
+		zip_error_fini(Error);
+		return Archive;
+	}
+
+	/**
+	 * Adds entry SrcIndex of Src to Dst, copying the compressed (and encrypted) data as is.
+	 * The entry keeps its name unless DstName is given as UTF-8.
+	 */
+	zip_int64_t AddRawEntryCopy(zip* Dst, zip* Src, zip_uint64_t SrcIndex, const char* DstName = NULL)
+	{
+		struct zip_stat sb;
+		if (zip_stat_index(Src, SrcIndex, 0, &sb) < 0)
+		{
+			return -1;
+		}
+		const bool bEncrypted = (sb.valid & ZIP_STAT_ENCRYPTION_METHOD) && sb.encryption_method != ZIP_EM_NONE;
+
+		zip_source_t* Source = zip_source_zip(Dst, Src, SrcIndex, bEncrypted ? ZIP_FL_ENCRYPTED : ZIP_FL_COMPRESSED, 0, -1);
+		if (Source == NULL)
+		{
+			return -1;
+		}
+
+		zip_int64_t Index = DstName != NULL ? zip_file_add(Dst, DstName, Source, ZIP_FL_ENC_UTF_8)
+			: zip_file_add(Dst, zip_get_name(Src, SrcIndex, ZIP_FL_ENC_RAW), Source, ZIP_FL_ENC_GUESS);
+		if (Index < 0)
+		{
+			zip_source_free(Source);
+			return -1;
+		}
+
+		// Keeping the source's encryption method without a password makes libzip copy the encrypted data instead of re-encrypting it.
+		if (bEncrypted && zip_file_set_encryption(Dst, Index, sb.encryption_method, NULL) < 0)
+		{
+			zip_delete(Dst, Index);
+			return -1;
+		}
+
+		zip_uint8_t OpSys;
+		zip_uint32_t Attributes;
+		if (zip_file_get_external_attributes(Src, SrcIndex, 0, &OpSys, &Attributes) == 0)
+		{
+			zip_file_set_external_attributes(Dst, Index, 0, OpSys, Attributes);
+		}
+
+		return Index;
+	}
+
+	/** Returns the entry indices of Archive sorted by the position of their data in the archive file. */
+	TArray<zip_uint64_t> GetEntryIndicesInOffsetOrder(zip* Archive)
+	{
+		TArray<zip_uint64_t> Indices;
+		Indices.Reserve(Archive->nentry);
+		for (zip_uint64_t Index = 0; Index < Archive->nentry; ++Index)
+		{
+			if (Archive->entry[Index].orig != NULL)
+			{
+				Indices.Add(Index);
+			}
+		}
+		Indices.Sort([Archive](zip_uint64_t A, zip_uint64_t B) {
+			return Archive->entry[A].orig->offset < Archive->entry[B].orig->offset;
+		});
+		return Indices;
+	}
+
+	bool GetFileCrc32(const FString& FilePath, uint32& Crc)
+	{
+		TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*FilePath));
+		if (!Reader.IsValid())
+		{
+			return false;
+		}
+
+		TArray<uint8> Buffer;
+		Buffer.SetNumUninitialized(FMath::Min<int64>(Reader->TotalSize(), 1024 * 1024));
+		Crc = 0;
+		for (int64 Remaining = Reader->TotalSize(); Remaining > 0;)
+		{
+			const int32 ChunkSize = static_cast<int32>(FMath::Min<int64>(Remaining, Buffer.Num()));
+			Reader->Serialize(Buffer.GetData(), ChunkSize);
+			Crc = FCrc::MemCrc32(Buffer.GetData(), ChunkSize, Crc);
+			Remaining -= ChunkSize;
+		}
+		return !Reader->IsError();
+	}
+}
+
+struct FLibzipAsyncCloseState : public TSharedFromThis<FLibzipAsyncCloseState, ESPMode::ThreadSafe>
+{
+	TFunction<void(float)> OnProgress;
+	std::atomic<bool> bCancelRequested{ false };
+	std::atomic<bool> bProgressPending{ false };
+	std::atomic<float> Progress{ 0.0f };
+
+	static void OnZipProgress(zip_t* Archive, double Progress, void* UserData)
+	{
+		TSharedRef<FLibzipAsyncCloseState, ESPMode::ThreadSafe> State = static_cast<FLibzipAsyncCloseState*>(UserData)->AsShared();
+		State->Progress = static_cast<float>(Progress);
+
+		// Coalesce updates so that at most one progress task is queued on the game thread.
+		if (!State->OnProgress || State->bProgressPending.exchange(true))
+		{
+			return;
+		}
+		AsyncTask(ENamedThreads::GameThread, [State]() {
+			State->bProgressPending = false;
+			State->OnProgress(State->Progress);
+		});
+	}
+
+	static int OnZipCancel(zip_t* Archive, void* UserData)
+	{
+		return static_cast<FLibzipAsyncCloseState*>(UserData)->bCancelRequested ? 1 : 0;
+	}
+};
+
+ULibzipArchiver::ULibzipArchiver()
+	: OperationStats(MakeShared<FLibzipStatsCollector, ESPMode::ThreadSafe>())
+{
+}
 
 ULibzipArchiver::~ULibzipArchiver()
 {
-	CloseArchive();
+	// Objects made by the hot reload vtable helper constructor have no collector and nothing to close.
+	if (OperationStats.IsValid())
+	{
+		CloseArchive();
+	}
 }
 
 bool ULibzipArchiver::GetRelativeFilesInDirectory(FString Dir, bool bAddParentDirectory, TArray<FString>& FilePaths)
@@ -15,7 +192,7 @@ bool ULibzipArchiver::GetRelativeFilesInDirectory(FString Dir, bool bAddParentDi
 
 	if (!FPaths::DirectoryExists(Dir))
 	{
-		UE_LOG(LogTemp, Error, TEXT("NotFoundDirectory:%s"), *Dir);
+		UE_LOG(LogLibzipArchiver, Error, TEXT("NotFoundDirectory:%s"), *Dir);
 		return false;
 	}
 
@@ -58,34 +235,92 @@ bool ULibzipArchiver::GetRelativeFilesInDirectory(FString Dir, bool bAddParentDi
 
 bool ULibzipArchiver::OpenArchiveFromStorage(const FString& ArchivePath)
 {
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
 	CloseArchive();
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_Open);
+	LIBZIP_TRACE_NAME_SCOPE(*ArchivePath);
 
+#if PLATFORM_LINUX
+	zip_error_t Error;
+	zip_error_init(&Error);
+	Zipper = OpenArchiveOnSource(FLibzipPosixFileSource::Create(ArchivePath, bUseDirectIO, &Error), ZIP_RDONLY, &Error);
+	if (Zipper == NULL)
+	{
+		return false;
+	}
+#else
 	int errorp;
-	Zipper = zip_open(TCHAR_TO_UTF8(*ArchivePath), ZIP_RDONLY, &errorp);
+	{
+		LIBZIP_TRACE_SCOPE(LibzipArchiver_ParseCentralDirectory);
+		Zipper = zip_open(TCHAR_TO_UTF8(*ArchivePath), ZIP_RDONLY, &errorp);
+	}
 	if (Zipper == NULL)
 	{
-		UE_LOG(LogTemp, Error, TEXT("Failed to zip_open %d"), errorp);
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_open %d"), errorp);
 		return false;
 	}
+#endif
+	OpenedArchivePath = ArchivePath;
 
 	return true;
 }
 
 bool ULibzipArchiver::CreateArchiveFromStorage(const FString& ArchivePath)
 {
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
 	CloseArchive();
 
+	if (bDirectWrite)
+	{
+		zip_error_t Error;
+		zip_error_init(&Error);
+		Zipper = OpenArchiveOnSource(FLibzipFileSink::Create(ArchivePath, &Error), ZIP_CREATE | ZIP_EXCL, &Error);
+		if (Zipper == NULL)
+		{
+			return false;
+		}
+		CreatedArchivePath = ArchivePath;
+		return true;
+	}
+
 	int errorp;
 	Zipper = zip_open(TCHAR_TO_UTF8(*ArchivePath), ZIP_CREATE | ZIP_EXCL, &errorp);
 	if (Zipper == NULL)
 	{
-		UE_LOG(LogTemp, Error, TEXT("Failed to zip_open %d"), errorp);
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_open %d"), errorp);
+		return false;
+	}
+	CreatedArchivePath = ArchivePath;
+
+	return true;
+}
+
+bool ULibzipArchiver::CreateArchiveInMemory(int64 ReserveBytes)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	CloseArchive();
+
+	TSharedRef<TArray64<uint8>, ESPMode::ThreadSafe> Buffer = MakeShared<TArray64<uint8>, ESPMode::ThreadSafe>();
+	Buffer->Reserve(FMath::Max<int64>(ReserveBytes, 0));
+	zip_error_t Error;
+	zip_error_init(&Error);
+	Zipper = OpenArchiveOnSource(FLibzipMemorySink::Create(Buffer, &Error), ZIP_CREATE | ZIP_TRUNCATE, &Error);
+	if (Zipper == NULL)
+	{
 		return false;
 	}
+	MemoryArchive = Buffer;
 
 	return true;
 }
 
+bool ULibzipArchiver::CreateEncryptedArchiveInMemory(const FString& ArchivePassword, int64 ReserveBytes)
+{
+	bool bResult = CreateArchiveInMemory(ReserveBytes);
+	Password = ArchivePassword;
+	return bResult;
+}
+
 bool ULibzipArchiver::OpenEncryptedArchiveFromStorage(const FString& ArchivePath, const FString& ArchivePassword)
 {
 	bool bResult = OpenArchiveFromStorage(ArchivePath);
@@ -100,135 +335,1361 @@ bool ULibzipArchiver::CreateEncryptedArchiveFromStorage(const FString& ArchivePa
 	return bResult;
 }
 
-bool ULibzipArchiver::CloseArchive()
+bool ULibzipArchiver::OpenArchiveFromPlatformFile(const FString& ArchivePath)
 {
-	if (Zipper != NULL)
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	CloseArchive();
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_Open);
+	LIBZIP_TRACE_NAME_SCOPE(*ArchivePath);
+
+	TSharedPtr<FLibzipPlatformFileSource, ESPMode::ThreadSafe> Reader = FLibzipPlatformFileSource::Open(ArchivePath);
+	if (!Reader.IsValid())
 	{
-		if (zip_close(Zipper) < 0)
-		{
-			WriteArchiveErrLog("Failed to zip_close");
-			return false;
-		}
-		Zipper = NULL;
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to open platform file %s"), *ArchivePath);
+		return false;
+	}
+
+	zip_error_t Error;
+	zip_error_init(&Error);
+	Zipper = OpenArchiveOnSource(Reader->CreateSource(&Error), ZIP_RDONLY, &Error);
+	if (Zipper == NULL)
+	{
+		return false;
+	}
+
+	PlatformFileSource = Reader;
+	for (zip_uint64_t Index : GetEntryIndicesInOffsetOrder(Zipper))
+	{
+		LocalHeaderOffsets.Add(Zipper->entry[Index].orig->offset);
 	}
-	Password = "";
 
 	return true;
 }
 
-bool ULibzipArchiver::AddEntryFromStorage(const FString& EntryName, const FString& FilePath)
+bool ULibzipArchiver::OpenEncryptedArchiveFromPlatformFile(const FString& ArchivePath, const FString& ArchivePassword)
 {
-	if (!FPaths::FileExists(FilePath)) 
+	bool bResult = OpenArchiveFromPlatformFile(ArchivePath);
+	Password = ArchivePassword;
+	return bResult;
+}
+
+bool ULibzipArchiver::OpenArchiveForConcurrentReads(const FString& ArchivePath)
+{
+	return OpenEncryptedArchiveForConcurrentReads(ArchivePath, "");
+}
+
+bool ULibzipArchiver::OpenEncryptedArchiveForConcurrentReads(const FString& ArchivePath, const FString& ArchivePassword)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	CloseArchive();
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_Open);
+	LIBZIP_TRACE_NAME_SCOPE(*ArchivePath);
+
+	// No zip handle is kept, the shared readers serve every call.
+	FLibzipArchiveRegistry* Registry = FLibzipArchiveRegistry::Get();
+	bool bShared = false;
+	ReaderPool = Registry != nullptr ? Registry->Acquire(ArchivePath, ArchivePassword, &bShared) : FLibzipReaderPool::Open(ArchivePath, ArchivePassword);
+	if (!ReaderPool.IsValid())
 	{
-		UE_LOG(LogTemp, Error, TEXT("Not exist file for adding entry"))
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to create readers of %s"), *ArchivePath);
 		return false;
 	}
-
-	TSharedPtr<zip_source_t> Zs(zip_source_file(Zipper, TCHAR_TO_UTF8(*FilePath), 0, 0), [](zip_source_t* zipfile) {
-		if (zipfile) { zip_source_close(zipfile); }
-	});
-	if (!Zs.IsValid())
+	if (bShared)
 	{
-		WriteArchiveErrLog("Failed to zip_source_file");
-		return false;
+		OperationStats->AddCacheHit();
 	}
+	Password = ArchivePassword;
+	OpenedArchivePath = ArchivePath;
 
-	zip_int64_t Index = zip_file_add(Zipper, TCHAR_TO_UTF8(*EntryName), Zs.Get(), ZIP_FL_ENC_UTF_8);
-	if (Index < 0)
+	return true;
+}
+
+bool ULibzipArchiver::OpenArchiveForAppend(const FString& ArchivePath)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	CloseArchive();
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_Open);
+	LIBZIP_TRACE_NAME_SCOPE(*ArchivePath);
+
+	if (!FPaths::FileExists(ArchivePath))
 	{
-		WriteArchiveErrLog("Failed to zip_file_add");
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not exist archive for append"));
 		return false;
 	}
 
-	if (!Password.IsEmpty())
+	// The added entries are written to a delta archive next to the archive, which is copied behind it on close.
+	const FString DeltaPath = FPaths::CreateTempFilename(*FPaths::GetPath(ArchivePath), TEXT("LibzipAppend"), TEXT(".zip"));
+	int errorp;
+	Zipper = zip_open(TCHAR_TO_UTF8(*DeltaPath), ZIP_CREATE | ZIP_TRUNCATE, &errorp);
+	if (Zipper == NULL)
 	{
-		int result = zip_file_set_encryption(Zipper, Index, ZIP_EM_AES_256, TCHAR_TO_UTF8(*Password));
-		if (result < 0)
-		{
-			WriteArchiveErrLog("Failed to zip_file_set_encryption");
-			return false;
-		}
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_open %d"), errorp);
+		return false;
 	}
+	AppendDeltaPath = DeltaPath;
+	AppendArchivePath = ArchivePath;
 
 	return true;
 }
 
-int64 ULibzipArchiver::GetArchiveEntries()
+bool ULibzipArchiver::OpenEncryptedArchiveForAppend(const FString& ArchivePath, const FString& ArchivePassword)
 {
-	zip_int64_t NumEntries = zip_get_num_entries(Zipper, 0);
-	if (NumEntries < 0)
+	bool bResult = OpenArchiveForAppend(ArchivePath);
+	Password = ArchivePassword;
+	return bResult;
+}
+
+bool ULibzipArchiver::OpenArchiveForUpdate(const FString& ArchivePath)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	CloseArchive();
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_Open);
+	LIBZIP_TRACE_NAME_SCOPE(*ArchivePath);
+
+#if PLATFORM_LINUX
+	zip_error_t Error;
+	zip_error_init(&Error);
+	Zipper = OpenArchiveOnSource(FLibzipPosixFileSource::CreateWritable(ArchivePath, bCloneOnUpdate, &Error), 0, &Error);
+	if (Zipper == NULL)
 	{
-		WriteArchiveErrLog("Failed to zip_get_num_entries");
+		return false;
+	}
+#else
+	int errorp;
+	{
+		LIBZIP_TRACE_SCOPE(LibzipArchiver_ParseCentralDirectory);
+		Zipper = zip_open(TCHAR_TO_UTF8(*ArchivePath), 0, &errorp);
+	}
+	if (Zipper == NULL)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_open %d"), errorp);
+		return false;
 	}
+#endif
 
-	return NumEntries;
+	return true;
 }
 
-void ULibzipArchiver::WriteArchiveErrLog(const FString& BaseMessage)
+bool ULibzipArchiver::OpenEncryptedArchiveForUpdate(const FString& ArchivePath, const FString& ArchivePassword)
 {
-	if (Zipper != NULL)
+	bool bResult = OpenArchiveForUpdate(ArchivePath);
+	Password = ArchivePassword;
+	return bResult;
+}
+
+bool ULibzipArchiver::CompactArchive(const FString& ArchivePath)
+{
+	const FString CompactPath = ArchivePath + TEXT(".compact");
+	if (!OptimizeArchiveLayout(ArchivePath, CompactPath, {}))
 	{
-		UE_LOG(LogTemp, Error, TEXT("%s %d %d %s"), *BaseMessage, Zipper->error.zip_err, Zipper->error.sys_err, UTF8_TO_TCHAR(Zipper->error.str));
+		return false;
 	}
-	else
+
+	if (!IFileManager::Get().Move(*ArchivePath, *CompactPath, true))
 	{
-		UE_LOG(LogTemp, Error, TEXT("%s"), *BaseMessage);
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to replace archive with compacted archive"));
+		return false;
 	}
-	
+	return true;
 }
 
-bool ULibzipArchiver::GetEntryToMemory(int64 Index, FString& Name, TArray<uint8>& Data)
+bool ULibzipArchiver::OptimizeArchiveLayout(const FString& SourcePath, const FString& OutputPath, const TArray<FString>& AccessOrder)
 {
-	if (Zipper == NULL)
+	int errorp;
+	zip* Src = zip_open(TCHAR_TO_UTF8(*SourcePath), ZIP_RDONLY, &errorp);
+	if (Src == NULL)
 	{
-		UE_LOG(LogTemp, Error, TEXT("Not yet opened"));
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_open %d"), errorp);
 		return false;
 	}
 
-	struct zip_stat sb;
-	int result = zip_stat_index(Zipper, Index, 0, &sb);
-	if (result < 0)
+	// libzip does not write archives without entries, and there is nothing to reorder in them anyway.
+	if (zip_get_num_entries(Src, 0) == 0)
 	{
-		WriteArchiveErrLog("Failed to zip_stat_index");
+		zip_discard(Src);
+		return IFileManager::Get().Copy(*OutputPath, *SourcePath) == COPY_OK;
+	}
+
+	zip* Dst = zip_open(TCHAR_TO_UTF8(*OutputPath), ZIP_CREATE | ZIP_TRUNCATE, &errorp);
+	if (Dst == NULL)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_open %d"), errorp);
+		zip_discard(Src);
 		return false;
 	}
 
-	Name = UTF8_TO_TCHAR(sb.name);
-	Data.SetNumUninitialized(sb.size, true);
-	TSharedPtr<zip_file> Zf(Password.IsEmpty() ? zip_fopen(Zipper, sb.name, 0) : zip_fopen_encrypted(Zipper, sb.name, 0, TCHAR_TO_UTF8(*Password)), [](zip_file* zipfile) {
-		if (zipfile) { zip_fclose(zipfile); }
-		});
-	if (!Zf.IsValid())
+	// Entries in access order first, then the remaining entries in their stored order.
+	TArray<zip_uint64_t> Order;
+	TSet<zip_uint64_t> Ordered;
+	for (const FString& Name : AccessOrder)
 	{
-		WriteArchiveErrLog("Failed to zip_fopen");
+		zip_int64_t Index = zip_name_locate(Src, TCHAR_TO_UTF8(*Name), 0);
+		if (Index >= 0 && !Ordered.Contains(Index))
+		{
+			Order.Add(Index);
+			Ordered.Add(Index);
+		}
+	}
+	for (zip_uint64_t Index : GetEntryIndicesInOffsetOrder(Src))
+	{
+		if (!Ordered.Contains(Index))
+		{
+			Order.Add(Index);
+		}
+	}
+
+	for (zip_uint64_t Index : Order)
+	{
+		if (AddRawEntryCopy(Dst, Src, Index) < 0)
+		{
+			WriteArchiveErrLog(Dst, "Failed to copy entry");
+			zip_discard(Dst);
+			zip_discard(Src);
+			return false;
+		}
+	}
+
+	// Entries are read from Src while Dst is written, so Src has to stay open until then.
+	bool bResult = zip_close(Dst) == 0;
+	if (!bResult)
+	{
+		WriteArchiveErrLog(Dst, "Failed to zip_close");
+		zip_discard(Dst);
+	}
+	zip_discard(Src);
+
+	return bResult;
+}
+
+void ULibzipArchiver::SetAccessTraceEnabled(bool bEnabled)
+{
+	bRecordAccessTrace = bEnabled;
+}
+
+TArray<FString> ULibzipArchiver::GetAccessTrace() const
+{
+	FScopeLock Lock(&AccessTraceLock);
+	return AccessTrace;
+}
+
+void ULibzipArchiver::ClearAccessTrace()
+{
+	FScopeLock Lock(&AccessTraceLock);
+	AccessTrace.Reset();
+	TracedEntries.Reset();
+}
+
+void ULibzipArchiver::RecordAccess(const FString& Name)
+{
+	// Entries are read from several threads at once in concurrent read mode.
+	FScopeLock Lock(&AccessTraceLock);
+	if (!TracedEntries.Contains(Name))
+	{
+		TracedEntries.Add(Name);
+		AccessTrace.Add(Name);
+	}
+}
+
+bool ULibzipArchiver::SetReferenceArchive(const FString& ReferenceArchivePath, ELibzipReuseMatch Match)
+{
+	if (Zipper == NULL)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not yet opened"));
 		return false;
 	}
-	zip_int64_t ReadByte = zip_fread(Zf.Get(), Data.GetData(), sb.size);
-	if (ReadByte < 0)
+
+	CloseReferenceArchive();
+
+	int errorp;
+	ReferenceZipper = zip_open(TCHAR_TO_UTF8(*ReferenceArchivePath), ZIP_RDONLY, &errorp);
+	if (ReferenceZipper == NULL)
 	{
-		WriteArchiveErrLog("Failed to zip_fread");
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_open %d"), errorp);
 		return false;
 	}
+	ReferenceMatch = Match;
 
 	return true;
 }
 
-bool ULibzipArchiver::WriteEntryToStorage(int64 Index, const FString& BaseDir)
+bool ULibzipArchiver::TryAddEntryFromReference(const FString& EntryName, const FString& FilePath)
 {
-	FString Name;
-	TArray<uint8> Contents;
-	if (!GetEntryToMemory(Index, Name, Contents))
+	zip_int64_t ReferenceIndex = zip_name_locate(ReferenceZipper, TCHAR_TO_UTF8(*EntryName), 0);
+	struct zip_stat sb;
+	if (ReferenceIndex < 0 || zip_stat_index(ReferenceZipper, ReferenceIndex, 0, &sb) < 0)
 	{
 		return false;
 	}
 
-	FArchive* Archive = IFileManager::Get().CreateFileWriter(*FPaths::Combine(BaseDir, Name));
-	if (Archive == nullptr)
+	// The raw data is only reusable when it was written with the encryption this archive would apply.
+	const bool bEncrypted = (sb.valid & ZIP_STAT_ENCRYPTION_METHOD) && sb.encryption_method != ZIP_EM_NONE;
+	if (bEncrypted != !Password.IsEmpty() || (bEncrypted && sb.encryption_method != ZIP_EM_AES_256))
 	{
-		UE_LOG(LogTemp, Error, TEXT("Failed to create file"));
 		return false;
 	}
-	TUniquePtr<FArchive> FileWriter(Archive);
-	FileWriter->Serialize(Contents.GetData(), Contents.Num());
-	return true;
-}
\ No newline at end of file
+	if (bEncrypted)
+	{
+		// Opening verifies the password against the entry's password verifier without decrypting the data.
+		zip_file* Zf = zip_fopen_index_encrypted(ReferenceZipper, ReferenceIndex, 0, TCHAR_TO_UTF8(*Password));
+		if (Zf == NULL)
+		{
+			return false;
+		}
+		zip_fclose(Zf);
+	}
+
+	const FFileStatData FileStat = IFileManager::Get().GetStatData(*FilePath);
+	if (!FileStat.bIsValid || FileStat.FileSize != static_cast<int64>(sb.size))
+	{
+		return false;
+	}
+
+	switch (ReferenceMatch)
+	{
+	case ELibzipReuseMatch::SizeAndTime:
+		// Zip timestamps have a resolution of two seconds.
+		if (FMath::Abs((FileStat.ModificationTime - FDateTime::FromUnixTimestamp(sb.mtime)).GetTotalSeconds()) > 2.0)
+		{
+			return false;
+		}
+		break;
+	case ELibzipReuseMatch::Content:
+	{
+		uint32 Crc;
+		if (!(sb.valid & ZIP_STAT_CRC) || !GetFileCrc32(FilePath, Crc) || Crc != sb.crc)
+		{
+			return false;
+		}
+		break;
+	}
+	}
+
+	zip_int64_t Index = AddRawEntryCopy(Zipper, ReferenceZipper, ReferenceIndex, TCHAR_TO_UTF8(*EntryName));
+	if (Index < 0)
+	{
+		return false;
+	}
+	DirectoryIndex.Reset();
+	zip_file_set_mtime(Zipper, Index, FileStat.ModificationTime.ToUnixTimestamp(), 0);
+
+	return true;
+}
+
+void ULibzipArchiver::CloseReferenceArchive()
+{
+	if (ReferenceZipper != NULL)
+	{
+		zip_discard(ReferenceZipper);
+		ReferenceZipper = NULL;
+	}
+}
+
+bool ULibzipArchiver::MergeArchives(const FString& OutputPath, const TArray<FString>& InputPaths, ELibzipMergeConflictPolicy ConflictPolicy)
+{
+	TArray<zip*> Inputs;
+	ON_SCOPE_EXIT
+	{
+		for (zip* Input : Inputs)
+		{
+			zip_discard(Input);
+		}
+	};
+
+	// Entries are visited in the order of their data in each input so that every input is read front to back.
+	TArray<TArray<zip_uint64_t>> InputIndices;
+	TMap<FString, TPair<int32, zip_uint64_t>> Winners;
+	for (const FString& InputPath : InputPaths)
+	{
+		int errorp;
+		zip* Input = zip_open(TCHAR_TO_UTF8(*InputPath), ZIP_RDONLY, &errorp);
+		if (Input == NULL)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_open %d %s"), errorp, *InputPath);
+			return false;
+		}
+		const int32 InputIndex = Inputs.Add(Input);
+
+		for (zip_uint64_t Index : InputIndices.Add_GetRef(GetEntryIndicesInOffsetOrder(Input)))
+		{
+			const FString Name = UTF8_TO_TCHAR(zip_get_name(Input, Index, 0));
+			if (!Winners.Contains(Name) || ConflictPolicy == ELibzipMergeConflictPolicy::KeepLast)
+			{
+				Winners.Add(Name, { InputIndex, Index });
+			}
+			else if (ConflictPolicy == ELibzipMergeConflictPolicy::Fail)
+			{
+				UE_LOG(LogLibzipArchiver, Error, TEXT("Conflicting entry %s in %s"), *Name, *InputPath);
+				return false;
+			}
+		}
+	}
+
+	int errorp;
+	zip* Output = zip_open(TCHAR_TO_UTF8(*OutputPath), ZIP_CREATE | ZIP_EXCL, &errorp);
+	if (Output == NULL)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_open %d"), errorp);
+		return false;
+	}
+
+	for (int32 InputIndex = 0; InputIndex < Inputs.Num(); ++InputIndex)
+	{
+		zip* Input = Inputs[InputIndex];
+		for (zip_uint64_t Index : InputIndices[InputIndex])
+		{
+			const TPair<int32, zip_uint64_t>& Winner = Winners.FindChecked(UTF8_TO_TCHAR(zip_get_name(Input, Index, 0)));
+			if (Winner.Key != InputIndex || Winner.Value != Index)
+			{
+				continue;
+			}
+			if (AddRawEntryCopy(Output, Input, Index) < 0)
+			{
+				WriteArchiveErrLog(Output, "Failed to copy entry");
+				zip_discard(Output);
+				return false;
+			}
+		}
+	}
+
+	// The inputs are read while the output is written, so they are released only after zip_close.
+	if (zip_close(Output) < 0)
+	{
+		WriteArchiveErrLog(Output, "Failed to zip_close");
+		zip_discard(Output);
+		return false;
+	}
+
+	return true;
+}
+
+bool ULibzipArchiver::CloseArchive()
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	WaitForPendingClose();
+
+	if (Zipper != NULL)
+	{
+		// Added entries are compressed and written by zip_close.
+		LIBZIP_TRACE_SCOPE(LibzipArchiver_Close);
+		if (zip_close(Zipper) < 0)
+		{
+			WriteArchiveErrLog("Failed to zip_close");
+			return false;
+		}
+		Zipper = NULL;
+
+		if (!CreatedArchivePath.IsEmpty())
+		{
+			OperationStats->AddBytes(0, FMath::Max<int64>(IFileManager::Get().FileSize(*CreatedArchivePath), 0));
+		}
+		else if (MemoryArchive.IsValid())
+		{
+			OperationStats->AddBytes(0, MemoryArchive->Num());
+		}
+	}
+	Password = "";
+	PlatformFileSource.Reset();
+	LocalHeaderOffsets.Reset();
+	MemoryArchive.Reset();
+	ReaderPool.Reset();
+	DirectoryIndex.Reset();
+	OpenedArchivePath.Reset();
+	CreatedArchivePath.Reset();
+	// The reference entries are read by zip_close, so the reference archive has to outlive it.
+	CloseReferenceArchive();
+
+	if (!AppendDeltaPath.IsEmpty())
+	{
+		const FString DeltaPath = MoveTemp(AppendDeltaPath);
+		AppendDeltaPath.Reset();
+		return FinishAppend(DeltaPath, MoveTemp(AppendArchivePath));
+	}
+
+	return true;
+}
+
+bool ULibzipArchiver::CloseArchiveToMemory(TArray64<uint8>& Data)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	WaitForPendingClose();
+
+	if (!MemoryArchive.IsValid())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not an archive in memory"));
+		return false;
+	}
+
+	TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe> Buffer = MemoryArchive;
+	if (!CloseArchive())
+	{
+		return false;
+	}
+	Data = MoveTemp(*Buffer);
+	return true;
+}
+
+bool ULibzipArchiver::K2_CloseArchiveToMemory(TArray<uint8>& Data)
+{
+	TArray64<uint8> Data64;
+	if (!CloseArchiveToMemory(Data64))
+	{
+		return false;
+	}
+	if (Data64.Num() > TNumericLimits<int32>::Max())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Archive too large for 32-bit array %lld, use CloseArchiveToMemory"), Data64.Num());
+		return false;
+	}
+	Data = TArray<uint8>(Data64.GetData(), Data64.Num());
+	return true;
+}
+
+bool ULibzipArchiver::FinishAppend(const FString& DeltaPath, const FString& ArchivePath)
+{
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_Append);
+	LIBZIP_TRACE_NAME_SCOPE(*ArchivePath);
+	// libzip does not write the delta archive when no entry was added.
+	if (!FPaths::FileExists(DeltaPath))
+	{
+		return true;
+	}
+
+	const bool bResult = FLibzipAppender::Append(ArchivePath, DeltaPath);
+	IFileManager::Get().Delete(*DeltaPath, false, false, true);
+	return bResult;
+}
+
+void ULibzipArchiver::CloseArchiveAsync(TFunction<void(float)> OnProgress, TFunction<void(bool)> OnClosed)
+{
+	WaitForPendingClose();
+
+	// Nothing to commit, but an archive opened for reading still has to release its readers and registry entry.
+	if (Zipper == NULL)
+	{
+		const bool bResult = CloseArchive();
+		if (OnClosed)
+		{
+			OnClosed(bResult);
+		}
+		return;
+	}
+
+	// zip_close writes an archive in memory into MemoryArchive, which is only handed out by CloseArchiveToMemory.
+	if (MemoryArchive.IsValid())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Archive in memory can not be closed asynchronously, use CloseArchiveToMemory"));
+		if (OnClosed)
+		{
+			OnClosed(false);
+		}
+		return;
+	}
+
+	// The worker owns the handle from here on, so the archiver can be reused or destroyed meanwhile.
+	zip* ClosingZipper = Zipper;
+	zip* ClosingReferenceZipper = ReferenceZipper;
+	FString ClosingDeltaPath = MoveTemp(AppendDeltaPath);
+	FString ClosingAppendPath = MoveTemp(AppendArchivePath);
+	FString ClosingCreatedPath = MoveTemp(CreatedArchivePath);
+	Zipper = NULL;
+	ReferenceZipper = NULL;
+	AppendDeltaPath.Reset();
+	Password = "";
+	PlatformFileSource.Reset();
+	LocalHeaderOffsets.Reset();
+	MemoryArchive.Reset();
+	ReaderPool.Reset();
+	DirectoryIndex.Reset();
+	OpenedArchivePath.Reset();
+
+	TSharedPtr<FLibzipAsyncCloseState, ESPMode::ThreadSafe> State = MakeShared<FLibzipAsyncCloseState, ESPMode::ThreadSafe>();
+	State->OnProgress = MoveTemp(OnProgress);
+	PendingClose = State;
+
+	zip_register_progress_callback_with_state(ClosingZipper, CloseProgressPrecision, &FLibzipAsyncCloseState::OnZipProgress, nullptr, State.Get());
+	zip_register_cancel_callback_with_state(ClosingZipper, &FLibzipAsyncCloseState::OnZipCancel, nullptr, State.Get());
+
+	PendingCloseResult = Async(EAsyncExecution::ThreadPool, [ClosingZipper, ClosingReferenceZipper, ClosingDeltaPath, ClosingAppendPath, ClosingCreatedPath,
+		Stats = OperationStats, State, OnClosed = MoveTemp(OnClosed)]() {
+		FLibzipStatsCollector::FOperationScope Operation(*Stats);
+		LIBZIP_TRACE_SCOPE(LibzipArchiver_Close);
+		bool bResult = true;
+		if (zip_close(ClosingZipper) < 0)
+		{
+			if (zip_error_code_zip(zip_get_error(ClosingZipper)) == ZIP_ER_CANCELLED)
+			{
+				UE_LOG(LogLibzipArchiver, Warning, TEXT("Cancelled zip_close"));
+			}
+			else
+			{
+				WriteArchiveErrLog(ClosingZipper, "Failed to zip_close");
+			}
+			// zip_close has already rolled back the temporary output, so only the handle is left to release.
+			zip_discard(ClosingZipper);
+			bResult = false;
+		}
+		else if (!ClosingCreatedPath.IsEmpty())
+		{
+			Stats->AddBytes(0, FMath::Max<int64>(IFileManager::Get().FileSize(*ClosingCreatedPath), 0));
+		}
+		if (ClosingReferenceZipper != NULL)
+		{
+			zip_discard(ClosingReferenceZipper);
+		}
+
+		if (!ClosingDeltaPath.IsEmpty())
+		{
+			if (bResult)
+			{
+				bResult = FinishAppend(ClosingDeltaPath, ClosingAppendPath);
+			}
+			else
+			{
+				IFileManager::Get().Delete(*ClosingDeltaPath, false, false, true);
+			}
+		}
+
+		if (OnClosed)
+		{
+			AsyncTask(ENamedThreads::GameThread, [OnClosed, bResult]() {
+				OnClosed(bResult);
+			});
+		}
+		return bResult;
+	});
+}
+
+void ULibzipArchiver::K2_CloseArchiveAsync(const FOnArchiveCloseProgress& OnProgress, const FOnArchiveClosed& OnClosed)
+{
+	CloseArchiveAsync([OnProgress](float Progress) {
+		OnProgress.ExecuteIfBound(Progress);
+	}, [OnClosed](bool bSuccess) {
+		OnClosed.ExecuteIfBound(bSuccess);
+	});
+}
+
+void ULibzipArchiver::CancelCloseArchive()
+{
+	if (PendingClose.IsValid())
+	{
+		PendingClose->bCancelRequested = true;
+	}
+}
+
+bool ULibzipArchiver::IsClosingArchive() const
+{
+	return PendingCloseResult.IsValid() && !PendingCloseResult.IsReady();
+}
+
+void ULibzipArchiver::WaitForPendingClose()
+{
+	if (PendingCloseResult.IsValid())
+	{
+		PendingCloseResult.Wait();
+		PendingCloseResult.Reset();
+	}
+	PendingClose.Reset();
+}
+
+FLibzipOperationStats ULibzipArchiver::GetLastOperationStats() const
+{
+	return OperationStats->GetLastOperation();
+}
+
+FLibzipOperationStats ULibzipArchiver::GetArchiverStats() const
+{
+	return OperationStats->GetCumulative();
+}
+
+void ULibzipArchiver::ResetArchiverStats()
+{
+	OperationStats->Reset();
+}
+
+bool ULibzipArchiver::AddEntryFromStorage(const FString& EntryName, const FString& FilePath)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_AddEntry);
+	LIBZIP_TRACE_NAME_SCOPE(*EntryName);
+	if (!FPaths::FileExists(FilePath)) 
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not exist file for adding entry"))
+		return false;
+	}
+
+	FLibzipStatsCollector::FEntryTimer Timer(OperationStats.Get());
+	const FFileStatData FileStat = IFileManager::Get().GetStatData(*FilePath);
+	if (ReferenceZipper != NULL && TryAddEntryFromReference(EntryName, FilePath))
+	{
+		// The entry's data is copied from the reference archive without compressing it again.
+		OperationStats->AddCacheHit();
+		Timer.FinishWrite(FileStat.FileSize, -1);
+		return true;
+	}
+
+	zip_source_t* Zs = zip_source_file(Zipper, TCHAR_TO_UTF8(*FilePath), 0, 0);
+	if (Zs == NULL)
+	{
+		WriteArchiveErrLog("Failed to zip_source_file");
+		return false;
+	}
+
+	if (!AddEntryFromSource(EntryName, Zs))
+	{
+		return false;
+	}
+	Timer.FinishWrite(FileStat.FileSize, -1);
+	return true;
+}
+
+bool ULibzipArchiver::AddEntryFromMemory(const FString& EntryName, const TArray<uint8>& Data)
+{
+	return AddEntryFromMemory(EntryName, TArray64<uint8>(Data));
+}
+
+bool ULibzipArchiver::AddEntryFromMemory(const FString& EntryName, TArray64<uint8>&& Data)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_AddEntry);
+	LIBZIP_TRACE_NAME_SCOPE(*EntryName);
+	if (Zipper == NULL)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not yet opened"));
+		return false;
+	}
+
+	FLibzipStatsCollector::FEntryTimer Timer(OperationStats.Get());
+	const FDateTime Now = FDateTime::UtcNow();
+	const int64 Size = Data.Num();
+	zip_source_t* Zs = FLibzipMemorySource::Create(Zipper, MoveTemp(Data), Now.ToUnixTimestamp());
+	if (Zs == NULL)
+	{
+		WriteArchiveErrLog("Failed to create memory source");
+		return false;
+	}
+
+	if (!AddEntryFromSource(EntryName, Zs))
+	{
+		return false;
+	}
+	Timer.FinishWrite(Size, -1);
+	return true;
+}
+
+bool ULibzipArchiver::AddEntryFromSource(const FString& EntryName, zip_source* Source)
+{
+	if (Source == NULL)
+	{
+		WriteArchiveErrLog("Failed to create source");
+		return false;
+	}
+
+	zip_int64_t Index = zip_file_add(Zipper, TCHAR_TO_UTF8(*EntryName), Source, ZIP_FL_ENC_UTF_8);
+	if (Index < 0)
+	{
+		zip_source_free(Source);
+		WriteArchiveErrLog("Failed to zip_file_add");
+		return false;
+	}
+	DirectoryIndex.Reset();
+
+	if (!Password.IsEmpty())
+	{
+		int result = zip_file_set_encryption(Zipper, Index, ZIP_EM_AES_256, TCHAR_TO_UTF8(*Password));
+		if (result < 0)
+		{
+			WriteArchiveErrLog("Failed to zip_file_set_encryption");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ULibzipArchiver::DeleteEntry(int64 Index)
+{
+	if (Zipper == NULL)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not yet opened"));
+		return false;
+	}
+
+	if (zip_delete(Zipper, Index) < 0)
+	{
+		WriteArchiveErrLog("Failed to zip_delete");
+		return false;
+	}
+	DirectoryIndex.Reset();
+
+	return true;
+}
+
+int64 ULibzipArchiver::GetArchiveEntries()
+{
+	if (ReaderPool.IsValid())
+	{
+		return ReaderPool->Num();
+	}
+
+	zip_int64_t NumEntries = zip_get_num_entries(Zipper, 0);
+	if (NumEntries < 0)
+	{
+		WriteArchiveErrLog("Failed to zip_get_num_entries");
+	}
+
+	return NumEntries;
+}
+
+int64 ULibzipArchiver::FindEntry(const FString& Name)
+{
+	if (ReaderPool.IsValid())
+	{
+		return ReaderPool->Find(Name);
+	}
+
+	if (Zipper == NULL)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not yet opened"));
+		return -1;
+	}
+
+	return zip_name_locate(Zipper, TCHAR_TO_UTF8(*Name), 0);
+}
+
+TArray<FString> ULibzipArchiver::ListDirectory(const FString& Path, bool bRecursive)
+{
+	TArray<FString> Names;
+	if (TSharedPtr<const FLibzipDirectoryIndex, ESPMode::ThreadSafe> Index = GetDirectoryIndex())
+	{
+		Index->List(Path, bRecursive, Names);
+	}
+	return Names;
+}
+
+bool ULibzipArchiver::DirectoryExists(const FString& Path)
+{
+	TSharedPtr<const FLibzipDirectoryIndex, ESPMode::ThreadSafe> Index = GetDirectoryIndex();
+	return Index.IsValid() && Index->Exists(Path);
+}
+
+int64 ULibzipArchiver::GetDirectorySize(const FString& Path)
+{
+	TSharedPtr<const FLibzipDirectoryIndex, ESPMode::ThreadSafe> Index = GetDirectoryIndex();
+	return Index.IsValid() ? Index->GetSize(Path) : 0;
+}
+
+TSharedPtr<const FLibzipDirectoryIndex, ESPMode::ThreadSafe> ULibzipArchiver::GetDirectoryIndex()
+{
+	// Archives opened for concurrent reads may be listed from several threads.
+	FScopeLock Lock(&DirectoryIndexLock);
+	if (DirectoryIndex.IsValid())
+	{
+		return DirectoryIndex;
+	}
+
+	TSharedPtr<FLibzipDirectoryIndex, ESPMode::ThreadSafe> Index = MakeShared<FLibzipDirectoryIndex, ESPMode::ThreadSafe>();
+	if (ReaderPool.IsValid())
+	{
+		for (int64 EntryIndex = 0; EntryIndex < ReaderPool->Num(); ++EntryIndex)
+		{
+			const FLibzipReaderPool::FEntry& Entry = ReaderPool->GetEntry(EntryIndex);
+			Index->Add(Entry.Name, Entry.Size);
+		}
+	}
+	else if (Zipper != NULL)
+	{
+		const zip_int64_t NumEntries = zip_get_num_entries(Zipper, 0);
+		for (zip_int64_t EntryIndex = 0; EntryIndex < NumEntries; ++EntryIndex)
+		{
+			// Deleted entries fail to stat.
+			struct zip_stat sb;
+			if (zip_stat_index(Zipper, EntryIndex, 0, &sb) == 0 && (sb.valid & ZIP_STAT_NAME))
+			{
+				Index->Add(UTF8_TO_TCHAR(sb.name), (sb.valid & ZIP_STAT_SIZE) ? sb.size : 0);
+			}
+		}
+	}
+	else
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not yet opened"));
+		return nullptr;
+	}
+
+	Index->Build();
+	DirectoryIndex = Index;
+	return DirectoryIndex;
+}
+
+void ULibzipArchiver::WriteArchiveErrLog(const FString& BaseMessage)
+{
+	WriteArchiveErrLog(Zipper, BaseMessage);
+}
+
+void ULibzipArchiver::WriteArchiveErrLog(zip* Archive, const FString& BaseMessage)
+{
+	if (Archive != NULL)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("%s %d %d %s"), *BaseMessage, Archive->error.zip_err, Archive->error.sys_err, UTF8_TO_TCHAR(Archive->error.str));
+	}
+	else
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("%s"), *BaseMessage);
+	}
+	
+}
+
+TSharedPtr<zip_file> ULibzipArchiver::OpenEntry(int64 Index, struct zip_stat& Stat, bool* bOutRaw)
+{
+	if (Zipper == NULL)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not yet opened"));
+		return nullptr;
+	}
+
+	int result = zip_stat_index(Zipper, Index, 0, &Stat);
+	if (result < 0)
+	{
+		WriteArchiveErrLog("Failed to zip_stat_index");
+		return nullptr;
+	}
+
+	if (bRecordAccessTrace)
+	{
+		RecordAccess(UTF8_TO_TCHAR(Stat.name));
+	}
+
+	if (PlatformFileSource.IsValid() && Zipper->entry[Index].orig != NULL)
+	{
+		// The entry's first block follows its local header, and the next entry usually is the one read after it.
+		const zip_uint64_t Offset = Zipper->entry[Index].orig->offset;
+		PlatformFileSource->Prefetch(Offset, EntryPrefetchBytes);
+		const int32 Next = Algo::UpperBound(LocalHeaderOffsets, Offset);
+		if (LocalHeaderOffsets.IsValidIndex(Next))
+		{
+			PlatformFileSource->Prefetch(LocalHeaderOffsets[Next], LocalHeaderPrefetchBytes);
+		}
+	}
+
+	const zip_uint64_t RawValid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_CRC;
+	const bool bRaw = bOutRaw != nullptr
+		&& (Stat.valid & RawValid) == RawValid
+		&& Stat.comp_method == ZIP_CM_DEFLATE
+		&& Stat.encryption_method == ZIP_EM_NONE
+		&& Stat.size <= static_cast<zip_uint64_t>(FMath::Max<int64>(OneShotDecodeMaxBytes, 0));
+	if (bOutRaw != nullptr)
+	{
+		*bOutRaw = bRaw;
+	}
+
+	zip_file* File = bRaw ? zip_fopen_index(Zipper, Index, ZIP_FL_COMPRESSED)
+		: Password.IsEmpty() ? zip_fopen_index(Zipper, Index, 0) : zip_fopen_index_encrypted(Zipper, Index, 0, TCHAR_TO_UTF8(*Password));
+	TSharedPtr<zip_file> Zf(File, [](zip_file* zipfile) {
+		if (zipfile) { zip_fclose(zipfile); }
+		});
+	if (!Zf.IsValid())
+	{
+		WriteArchiveErrLog("Failed to zip_fopen");
+		return nullptr;
+	}
+
+	return Zf;
+}
+
+bool ULibzipArchiver::ReadEntryData(zip_file* File, uint8* Data, int64 Size)
+{
+	while (Size > 0)
+	{
+		zip_int64_t ReadByte = zip_fread(File, Data, Size);
+		if (ReadByte <= 0)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_fread %s"), UTF8_TO_TCHAR(zip_file_strerror(File)));
+			return false;
+		}
+		Data += ReadByte;
+		Size -= ReadByte;
+	}
+
+	return true;
+}
+
+bool ULibzipArchiver::ReadEntryData(zip_file* File, const struct zip_stat& Stat, bool bRaw, uint8* Data)
+{
+	FLibzipTraceEntryInFlight InFlight;
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_ReadEntry);
+	LIBZIP_TRACE_NAME_SCOPE(UTF8_TO_TCHAR(Stat.name));
+	TRACE_COUNTER_ADD(LibzipArchiver_BytesInflated, Stat.size);
+
+	if (!bRaw)
+	{
+		// libzip decrypts, inflates and checks the CRC while reading.
+		if (Stat.encryption_method != ZIP_EM_NONE)
+		{
+			LIBZIP_TRACE_SCOPE(LibzipArchiver_Decrypt);
+			return ReadEntryData(File, Data, Stat.size);
+		}
+		LIBZIP_TRACE_SCOPE(LibzipArchiver_Inflate);
+		return ReadEntryData(File, Data, Stat.size);
+	}
+
+	TArray64<uint8> Compressed;
+	Compressed.SetNumUninitialized(Stat.comp_size);
+	if (!ReadEntryData(File, Compressed.GetData(), Compressed.Num()))
+	{
+		return false;
+	}
+
+	LibzipCore::FEntry Entry;
+	Entry.Size = Stat.size;
+	Entry.CompressedSize = Stat.comp_size;
+	Entry.Crc = Stat.crc;
+	Entry.Method = LibzipCore::MethodDeflate;
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_Inflate);
+	if (!LibzipCore::Decode(Entry, Compressed.GetData(), Data))
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to decompress entry %s"), UTF8_TO_TCHAR(Stat.name));
+		return false;
+	}
+
+	return true;
+}
+
+bool ULibzipArchiver::GetEntryToMemory(int64 Index, FString& Name, TArray<uint8>& Data)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	if (ReaderPool.IsValid())
+	{
+		return ReadEntryConcurrently(Index, Name, [&Data](int64 Size) -> uint8* {
+			if (Size > TNumericLimits<int32>::Max())
+			{
+				UE_LOG(LogLibzipArchiver, Error, TEXT("Entry too large for 32-bit array %lld, use GetEntryToMemory64"), Size);
+				return nullptr;
+			}
+			Data.SetNumUninitialized(Size, true);
+			return Data.GetData();
+		});
+	}
+
+	FLibzipStatsCollector::FEntryTimer Timer(OperationStats.Get());
+	struct zip_stat sb;
+	bool bRaw;
+	TSharedPtr<zip_file> Zf = OpenEntry(Index, sb, &bRaw);
+	if (!Zf.IsValid())
+	{
+		return false;
+	}
+
+	if (sb.size > static_cast<zip_uint64_t>(TNumericLimits<int32>::Max()))
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Entry too large for 32-bit array %llu, use GetEntryToMemory64"), sb.size);
+		return false;
+	}
+
+	Name = UTF8_TO_TCHAR(sb.name);
+	Data.SetNumUninitialized(sb.size, true);
+	if (!ReadEntryData(Zf.Get(), sb, bRaw, Data.GetData()))
+	{
+		return false;
+	}
+	Timer.FinishRead(sb.comp_size, sb.size);
+	return true;
+}
+
+bool ULibzipArchiver::GetEntryToMemory64(int64 Index, FString& Name, TArray64<uint8>& Data)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	if (ReaderPool.IsValid())
+	{
+		return ReadEntryConcurrently(Index, Name, [&Data](int64 Size) {
+			Data.SetNumUninitialized(Size, true);
+			return Data.GetData();
+		});
+	}
+
+	FLibzipStatsCollector::FEntryTimer Timer(OperationStats.Get());
+	struct zip_stat sb;
+	bool bRaw;
+	TSharedPtr<zip_file> Zf = OpenEntry(Index, sb, &bRaw);
+	if (!Zf.IsValid())
+	{
+		return false;
+	}
+
+	Name = UTF8_TO_TCHAR(sb.name);
+	Data.SetNumUninitialized(sb.size, true);
+	if (!ReadEntryData(Zf.Get(), sb, bRaw, Data.GetData()))
+	{
+		return false;
+	}
+	Timer.FinishRead(sb.comp_size, sb.size);
+	return true;
+}
+
+FSharedBuffer ULibzipArchiver::GetEntryToSharedBuffer(int64 Index, FString& Name)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	if (ReaderPool.IsValid())
+	{
+		FUniqueBuffer Buffer;
+		const bool bRead = ReadEntryConcurrently(Index, Name, [&Buffer](int64 Size) {
+			Buffer = FUniqueBuffer::Alloc(Size);
+			return static_cast<uint8*>(Buffer.GetData());
+		});
+		return bRead ? Buffer.MoveToShared() : FSharedBuffer();
+	}
+
+	FLibzipStatsCollector::FEntryTimer Timer(OperationStats.Get());
+	struct zip_stat sb;
+	bool bRaw;
+	TSharedPtr<zip_file> Zf = OpenEntry(Index, sb, &bRaw);
+	if (!Zf.IsValid())
+	{
+		return FSharedBuffer();
+	}
+
+	FUniqueBuffer Buffer = FUniqueBuffer::Alloc(sb.size);
+	if (!ReadEntryData(Zf.Get(), sb, bRaw, static_cast<uint8*>(Buffer.GetData())))
+	{
+		return FSharedBuffer();
+	}
+	Timer.FinishRead(sb.comp_size, sb.size);
+
+	Name = UTF8_TO_TCHAR(sb.name);
+	return Buffer.MoveToShared();
+}
+
+bool ULibzipArchiver::WriteEntryToStorage(int64 Index, const FString& BaseDir)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_WriteEntry);
+	if (ReaderPool.IsValid())
+	{
+		FString Name;
+		TArray64<uint8> Data;
+		if (!GetEntryToMemory64(Index, Name, Data))
+		{
+			return false;
+		}
+		TUniquePtr<FArchive> FileWriter(IFileManager::Get().CreateFileWriter(*FPaths::Combine(BaseDir, Name)));
+		if (!FileWriter.IsValid())
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to create file"));
+			return false;
+		}
+		LIBZIP_TRACE_NAME_SCOPE(*Name);
+		TRACE_COUNTER_ADD(LibzipArchiver_BytesWritten, Data.Num());
+		FileWriter->Serialize(Data.GetData(), Data.Num());
+		return FileWriter->Close();
+	}
+
+	FLibzipStatsCollector::FEntryTimer Timer(OperationStats.Get());
+	struct zip_stat sb;
+	TSharedPtr<zip_file> Zf = OpenEntry(Index, sb);
+	if (!Zf.IsValid())
+	{
+		return false;
+	}
+
+	FLibzipTraceEntryInFlight InFlight;
+	LIBZIP_TRACE_NAME_SCOPE(UTF8_TO_TCHAR(sb.name));
+	const FString FilePath = FPaths::Combine(BaseDir, UTF8_TO_TCHAR(sb.name));
+	FArchive* Archive = IFileManager::Get().CreateFileWriter(*FilePath);
+	if (Archive == nullptr)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to create file"));
+		return false;
+	}
+	TUniquePtr<FArchive> FileWriter(Archive);
+
+	// Entries are streamed through a bounded buffer so that entries of any size can be extracted.
+	TArray<uint8> Buffer;
+	Buffer.SetNumUninitialized(FMath::Min<zip_uint64_t>(sb.size, WriteEntryBufferSize));
+	for (zip_uint64_t Remaining = sb.size; Remaining > 0;)
+	{
+		const int32 ChunkSize = static_cast<int32>(FMath::Min<zip_uint64_t>(Remaining, Buffer.Num()));
+		if (!ReadEntryData(Zf.Get(), Buffer.GetData(), ChunkSize))
+		{
+			FileWriter.Reset();
+			IFileManager::Get().Delete(*FilePath);
+			return false;
+		}
+		TRACE_COUNTER_ADD(LibzipArchiver_BytesInflated, ChunkSize);
+		TRACE_COUNTER_ADD(LibzipArchiver_BytesWritten, ChunkSize);
+		FileWriter->Serialize(Buffer.GetData(), ChunkSize);
+		Remaining -= ChunkSize;
+	}
+
+	if (!FileWriter->Close())
+	{
+		return false;
+	}
+	Timer.FinishRead(sb.comp_size, sb.size);
+	return true;
+}
+
+bool ULibzipArchiver::ReadEntryConcurrently(int64 Index, FString& Name, TFunctionRef<uint8*(int64 Size)> Allocate)
+{
+	FLibzipStatsCollector::FEntryTimer Timer(OperationStats.Get());
+	bool bCacheHit = false;
+	const bool bRead = ReaderPool->Read(Index, Name, Allocate, [this](const FString& EntryName) {
+		if (bRecordAccessTrace)
+		{
+			RecordAccess(EntryName);
+		}
+	}, &bCacheHit);
+	if (!bRead)
+	{
+		return false;
+	}
+
+	if (bCacheHit)
+	{
+		OperationStats->AddCacheHit();
+	}
+	const FLibzipReaderPool::FEntry& Entry = ReaderPool->GetEntry(Index);
+	Timer.FinishRead(Entry.CompressedSize, Entry.Size);
+	return true;
+}
+
+bool ULibzipArchiver::WriteAllEntriesToStorage(const FString& BaseDir, ELibzipWriteDurability Durability)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_WriteAllEntries);
+	if (Zipper == NULL && !ReaderPool.IsValid())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not yet opened"));
+		return false;
+	}
+
+	FLibzipBatchedWriter Writer(Durability);
+	bool bResult = true;
+	for (zip_uint64_t Index : ReaderPool.IsValid() ? ReaderPool->GetIndicesInOffsetOrder() : GetEntryIndicesInOffsetOrder(Zipper))
+	{
+		FString Name;
+		int64 Size;
+		if (ReaderPool.IsValid())
+		{
+			if (!ReaderPool->Stat(Index, Name, Size))
+			{
+				bResult = false;
+				continue;
+			}
+		}
+		else
+		{
+			struct zip_stat sb;
+			if (zip_stat_index(Zipper, Index, 0, &sb) < 0)
+			{
+				WriteArchiveErrLog("Failed to zip_stat_index");
+				bResult = false;
+				continue;
+			}
+			Name = UTF8_TO_TCHAR(sb.name);
+			Size = sb.size;
+		}
+
+		if (Name.EndsWith(TEXT("/")))
+		{
+			FPlatformFileManager::Get().GetPlatformFile().CreateDirectoryTree(*FPaths::Combine(BaseDir, Name));
+			continue;
+		}
+
+		if (Size > BatchedWriteMaxBytes)
+		{
+			bResult = WriteEntryToStorage(Index, BaseDir) && bResult;
+			continue;
+		}
+
+		FString EntryName;
+		TArray64<uint8> Data;
+		if (!GetEntryToMemory64(Index, EntryName, Data))
+		{
+			bResult = false;
+			continue;
+		}
+		bResult = Writer.Add(FPaths::Combine(BaseDir, EntryName), MoveTemp(Data)) && bResult;
+	}
+
+	return Writer.Flush() && bResult;
+}
+
+bool ULibzipArchiver::WriteAllEntriesToStoragePipelined(const FString& BaseDir, FLibzipPipelineStats& Stats, int32 DecodeWorkers, ELibzipWriteDurability Durability)
+{
+	FLibzipStatsCollector::FOperationScope Operation(*OperationStats);
+	TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool = GetReaderPool();
+	if (!Pool.IsValid())
+	{
+		return false;
+	}
+
+	return FLibzipExtractionPipeline::Run(Pool.ToSharedRef(), BaseDir, DecodeWorkers, Durability, Stats, OperationStats.Get());
+}
+
+TUniquePtr<FArchive> ULibzipArchiver::OpenEntryReader(int64 Index)
+{
+	TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool = GetReaderPool();
+	if (!Pool.IsValid())
+	{
+		return nullptr;
+	}
+	if (Index < 0 || Index >= Pool->Num())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_stat_index %lld"), Index);
+		return nullptr;
+	}
+
+	const FString& Name = Pool->GetEntry(Index).Name;
+	if (bRecordAccessTrace)
+	{
+		RecordAccess(Name);
+	}
+	IFileHandle* Handle = FLibzipEntryFileHandle::Open(FPlatformFileManager::Get().GetPlatformFile(), Pool, Index);
+	if (Handle == nullptr)
+	{
+		return nullptr;
+	}
+	// The generic reader buffers small serializations, so that they do not go to the handle one by one.
+	return MakeUnique<FArchiveFileReaderGeneric>(Handle, *Name, Handle->Size());
+}
+
+TUniquePtr<FArchive> ULibzipArchiver::OpenEntryReader(const FString& Name)
+{
+	TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool = GetReaderPool();
+	if (!Pool.IsValid())
+	{
+		return nullptr;
+	}
+
+	const int64 Index = Pool->Find(Name);
+	if (Index < 0)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to find entry %s"), *Name);
+		return nullptr;
+	}
+	return OpenEntryReader(Index);
+}
+
+TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> ULibzipArchiver::GetReaderPool()
+{
+	if (ReaderPool.IsValid())
+	{
+		return ReaderPool;
+	}
+	if (OpenedArchivePath.IsEmpty())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not yet opened from storage"));
+		return nullptr;
+	}
+
+	FLibzipArchiveRegistry* Registry = FLibzipArchiveRegistry::Get();
+	bool bShared = false;
+	TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool = Registry != nullptr ? Registry->Acquire(OpenedArchivePath, Password, &bShared) : FLibzipReaderPool::Open(OpenedArchivePath, Password);
+	if (!Pool.IsValid())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to create readers of %s"), *OpenedArchivePath);
+	}
+	else if (bShared)
+	{
+		OperationStats->AddCacheHit();
+	}
+	return Pool;
+}
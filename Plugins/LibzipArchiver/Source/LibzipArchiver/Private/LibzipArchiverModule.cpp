@@ -1,17 +1,23 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "LibzipArchiverModule.h"
+#include "LibzipArchiverLog.h"
+#include "LibzipArchiveRegistry.h"
 #include "Core.h"
 #include "Modules/ModuleManager.h"
 
 #define LOCTEXT_NAMESPACE "FLibzipArchiverModule"
 
+DEFINE_LOG_CATEGORY(LogLibzipArchiver);
+
 void FLibzipArchiverModule::StartupModule()
 {
+	FLibzipArchiveRegistry::Startup();
 }
 
 void FLibzipArchiverModule::ShutdownModule()
 {
+	FLibzipArchiveRegistry::Shutdown();
 }
 
 #undef LOCTEXT_NAMESPACE
@@ -0,0 +1,272 @@
+#include "LibzipArchiverStats.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/WindowsHWrapper.h"
+#elif PLATFORM_UNIX || PLATFORM_APPLE || PLATFORM_ANDROID
+#include <time.h>
+#endif
+
+namespace
+{
+	/** CPU time of the calling thread, or 0 where the platform does not report it. */
+	double GetThreadCpuSeconds()
+	{
+#if PLATFORM_WINDOWS
+		FILETIME CreationTime, ExitTime, KernelTime, UserTime;
+		if (!::GetThreadTimes(::GetCurrentThread(), &CreationTime, &ExitTime, &KernelTime, &UserTime))
+		{
+			return 0.0;
+		}
+		// FILETIME counts 100 ns intervals.
+		const uint64 Kernel = (static_cast<uint64>(KernelTime.dwHighDateTime) << 32) | KernelTime.dwLowDateTime;
+		const uint64 User = (static_cast<uint64>(UserTime.dwHighDateTime) << 32) | UserTime.dwLowDateTime;
+		return (Kernel + User) * 1e-7;
+#elif PLATFORM_UNIX || PLATFORM_APPLE || PLATFORM_ANDROID
+		struct timespec Time;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Time) != 0)
+		{
+			return 0.0;
+		}
+		return Time.tv_sec + Time.tv_nsec * 1e-9;
+#else
+		return 0.0;
+#endif
+	}
+
+	int64 ToNanoseconds(double Seconds)
+	{
+		return static_cast<int64>(Seconds * 1e9);
+	}
+}
+
+FLibzipLatencyHistogram::FLibzipLatencyHistogram()
+{
+	Reset();
+}
+
+void FLibzipLatencyHistogram::Record(uint64 Nanoseconds)
+{
+	Counts[GetBucket(Nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void FLibzipLatencyHistogram::Reset()
+{
+	for (std::atomic<uint64>& Count : Counts)
+	{
+		Count.store(0, std::memory_order_relaxed);
+	}
+}
+
+uint64 FLibzipLatencyHistogram::GetPercentile(double Fraction) const
+{
+	uint64 Snapshot[BucketCount];
+	uint64 Samples = 0;
+	for (int32 Bucket = 0; Bucket < BucketCount; ++Bucket)
+	{
+		Snapshot[Bucket] = Counts[Bucket].load(std::memory_order_relaxed);
+		Samples += Snapshot[Bucket];
+	}
+	if (Samples == 0)
+	{
+		return 0;
+	}
+
+	const uint64 Rank = FMath::Clamp<uint64>(static_cast<uint64>(FMath::CeilToDouble(FMath::Clamp(Fraction, 0.0, 1.0) * Samples)), 1, Samples);
+	uint64 Seen = 0;
+	for (int32 Bucket = 0; Bucket < BucketCount; ++Bucket)
+	{
+		Seen += Snapshot[Bucket];
+		if (Seen >= Rank)
+		{
+			return GetBucketHighestValue(Bucket);
+		}
+	}
+	return GetBucketHighestValue(BucketCount - 1);
+}
+
+int32 FLibzipLatencyHistogram::GetBucket(uint64 Value)
+{
+	// Values below SubBucketCount have a bucket each, above that every power of two has SubBucketCount buckets.
+	if (Value < SubBucketCount)
+	{
+		return static_cast<int32>(Value);
+	}
+	Value = FMath::Min<uint64>(Value, (uint64(2) << MaxExponent) - 1);
+	const int32 Shift = FMath::FloorLog2_64(Value) - SubBucketBits;
+	return (Shift + 1) * SubBucketCount + static_cast<int32>((Value >> Shift) - SubBucketCount);
+}
+
+uint64 FLibzipLatencyHistogram::GetBucketHighestValue(int32 Bucket)
+{
+	if (Bucket < SubBucketCount)
+	{
+		return Bucket;
+	}
+	const int32 Shift = Bucket / SubBucketCount - 1;
+	const uint64 Lowest = static_cast<uint64>(SubBucketCount + Bucket % SubBucketCount) << Shift;
+	return Lowest + (uint64(1) << Shift) - 1;
+}
+
+thread_local FLibzipStatsCollector::FOperationScope* FLibzipStatsCollector::FOperationScope::Innermost = nullptr;
+
+FLibzipStatsCollector::FOperationScope::FOperationScope(FLibzipStatsCollector& InCollector)
+	: Collector(InCollector), Outer(Innermost), bCounted(true), StartCpuSeconds(0.0)
+{
+	for (const FOperationScope* Scope = Outer; Scope != nullptr; Scope = Scope->Outer)
+	{
+		if (&Scope->Collector == &Collector)
+		{
+			bCounted = false;
+			break;
+		}
+	}
+	Innermost = this;
+	if (!bCounted)
+	{
+		return;
+	}
+
+	if (Collector.ActiveCalls.fetch_add(1, std::memory_order_acq_rel) == 0)
+	{
+		Collector.Last.Reset();
+		Collector.OperationStartCycles.store(FPlatformTime::Cycles64(), std::memory_order_relaxed);
+	}
+	StartCpuSeconds = GetThreadCpuSeconds();
+}
+
+FLibzipStatsCollector::FOperationScope::~FOperationScope()
+{
+	Innermost = Outer;
+	if (!bCounted)
+	{
+		return;
+	}
+
+	Collector.AddCpu(GetThreadCpuSeconds() - StartCpuSeconds);
+	if (Collector.ActiveCalls.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		const int64 Wall = ToNanoseconds(FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - Collector.OperationStartCycles.load(std::memory_order_relaxed)));
+		Collector.Last.WallNanoseconds.store(Wall, std::memory_order_relaxed);
+		Collector.Total.WallNanoseconds.fetch_add(Wall, std::memory_order_relaxed);
+	}
+}
+
+FLibzipStatsCollector::FThreadCpuScope::FThreadCpuScope(FLibzipStatsCollector* InCollector)
+	: Collector(InCollector), StartCpuSeconds(InCollector != nullptr ? GetThreadCpuSeconds() : 0.0)
+{
+}
+
+FLibzipStatsCollector::FThreadCpuScope::~FThreadCpuScope()
+{
+	if (Collector != nullptr)
+	{
+		Collector->AddCpu(GetThreadCpuSeconds() - StartCpuSeconds);
+	}
+}
+
+FLibzipStatsCollector::FEntryTimer::FEntryTimer(FLibzipStatsCollector* InCollector)
+	: Collector(InCollector), StartCycles(FPlatformTime::Cycles64())
+{
+}
+
+void FLibzipStatsCollector::FEntryTimer::FinishRead(int64 CompressedBytes, int64 UncompressedBytes)
+{
+	if (Collector != nullptr)
+	{
+		const uint64 Nanoseconds = ToNanoseconds(FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles));
+		Collector->AddEntry(CompressedBytes, UncompressedBytes, CompressedBytes, UncompressedBytes, Nanoseconds);
+	}
+}
+
+void FLibzipStatsCollector::FEntryTimer::FinishWrite(int64 UncompressedBytes, int64 CompressedBytes)
+{
+	if (Collector != nullptr)
+	{
+		const uint64 Nanoseconds = ToNanoseconds(FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles));
+		Collector->AddEntry(UncompressedBytes, FMath::Max<int64>(CompressedBytes, 0), CompressedBytes, CompressedBytes >= 0 ? UncompressedBytes : 0, Nanoseconds);
+	}
+}
+
+void FLibzipStatsCollector::AddCacheHit()
+{
+	Last.CacheHits.fetch_add(1, std::memory_order_relaxed);
+	Total.CacheHits.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FLibzipStatsCollector::AddBytes(int64 BytesIn, int64 BytesOut)
+{
+	for (FCounters* Counters : { &Last, &Total })
+	{
+		Counters->BytesIn.fetch_add(BytesIn, std::memory_order_relaxed);
+		Counters->BytesOut.fetch_add(BytesOut, std::memory_order_relaxed);
+	}
+}
+
+FLibzipOperationStats FLibzipStatsCollector::GetLastOperation() const
+{
+	return Last.ToStats();
+}
+
+FLibzipOperationStats FLibzipStatsCollector::GetCumulative() const
+{
+	return Total.ToStats();
+}
+
+void FLibzipStatsCollector::Reset()
+{
+	Last.Reset();
+	Total.Reset();
+}
+
+void FLibzipStatsCollector::AddEntry(int64 BytesIn, int64 BytesOut, int64 CompressedBytes, int64 UncompressedBytes, uint64 Nanoseconds)
+{
+	for (FCounters* Counters : { &Last, &Total })
+	{
+		Counters->BytesIn.fetch_add(BytesIn, std::memory_order_relaxed);
+		Counters->BytesOut.fetch_add(BytesOut, std::memory_order_relaxed);
+		if (CompressedBytes >= 0)
+		{
+			Counters->CompressedBytes.fetch_add(CompressedBytes, std::memory_order_relaxed);
+			Counters->UncompressedBytes.fetch_add(UncompressedBytes, std::memory_order_relaxed);
+		}
+		Counters->Entries.fetch_add(1, std::memory_order_relaxed);
+		Counters->Latency.Record(Nanoseconds);
+	}
+}
+
+void FLibzipStatsCollector::AddCpu(double Seconds)
+{
+	const int64 Nanoseconds = ToNanoseconds(FMath::Max(Seconds, 0.0));
+	Last.CpuNanoseconds.fetch_add(Nanoseconds, std::memory_order_relaxed);
+	Total.CpuNanoseconds.fetch_add(Nanoseconds, std::memory_order_relaxed);
+}
+
+void FLibzipStatsCollector::FCounters::Reset()
+{
+	WallNanoseconds.store(0, std::memory_order_relaxed);
+	CpuNanoseconds.store(0, std::memory_order_relaxed);
+	BytesIn.store(0, std::memory_order_relaxed);
+	BytesOut.store(0, std::memory_order_relaxed);
+	CompressedBytes.store(0, std::memory_order_relaxed);
+	UncompressedBytes.store(0, std::memory_order_relaxed);
+	Entries.store(0, std::memory_order_relaxed);
+	CacheHits.store(0, std::memory_order_relaxed);
+	Latency.Reset();
+}
+
+FLibzipOperationStats FLibzipStatsCollector::FCounters::ToStats() const
+{
+	FLibzipOperationStats Stats;
+	Stats.WallSeconds = WallNanoseconds.load(std::memory_order_relaxed) * 1e-9f;
+	Stats.CpuSeconds = CpuNanoseconds.load(std::memory_order_relaxed) * 1e-9f;
+	Stats.BytesIn = BytesIn.load(std::memory_order_relaxed);
+	Stats.BytesOut = BytesOut.load(std::memory_order_relaxed);
+	const int64 Compressed = CompressedBytes.load(std::memory_order_relaxed);
+	Stats.CompressionRatio = Compressed > 0 ? static_cast<float>(static_cast<double>(UncompressedBytes.load(std::memory_order_relaxed)) / Compressed) : 0.0f;
+	Stats.Entries = Entries.load(std::memory_order_relaxed);
+	Stats.CacheHits = CacheHits.load(std::memory_order_relaxed);
+	Stats.P50EntryLatencyMs = Latency.GetPercentile(0.50) * 1e-6f;
+	Stats.P95EntryLatencyMs = Latency.GetPercentile(0.95) * 1e-6f;
+	Stats.P99EntryLatencyMs = Latency.GetPercentile(0.99) * 1e-6f;
+	return Stats;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LibzipArchiver.h"
+#include <atomic>
+
+/**
+ * Lock-free latency histogram with HDR-style log-linear buckets.
+ * Values are grouped by their highest set bit and every power of two is split into linear sub-buckets, so that a
+ * percentile is off by at most 1/16 of its value at a fixed memory cost. Recording is one relaxed atomic increment.
+ */
+class FLibzipLatencyHistogram
+{
+public:
+	FLibzipLatencyHistogram();
+
+	void Record(uint64 Nanoseconds);
+	void Reset();
+
+	/** Highest value of the bucket holding the Fraction quantile, or 0 without samples. */
+	uint64 GetPercentile(double Fraction) const;
+
+private:
+	static constexpr int32 SubBucketBits = 4;
+	static constexpr int32 SubBucketCount = 1 << SubBucketBits;
+	/** Values of 2^(MaxExponent + 1) ns and more, about 36 minutes, are counted in the last bucket. */
+	static constexpr int32 MaxExponent = 40;
+	static constexpr int32 BucketCount = (MaxExponent - SubBucketBits + 2) * SubBucketCount;
+
+	static int32 GetBucket(uint64 Value);
+	static uint64 GetBucketHighestValue(int32 Bucket);
+
+	std::atomic<uint64> Counts[BucketCount];
+};
+
+/**
+ * Statistics of the operations of one archiver, kept for the last operation and cumulatively.
+ * Calls on any thread that overlap in time count as one operation, like a batch of concurrent reads.
+ */
+class FLibzipStatsCollector
+{
+public:
+	/** Brackets a public call. Calls nested in another call of the same collector on the same thread are not counted again. */
+	class FOperationScope
+	{
+	public:
+		explicit FOperationScope(FLibzipStatsCollector& InCollector);
+		~FOperationScope();
+
+	private:
+		FLibzipStatsCollector& Collector;
+		FOperationScope* Outer;
+		bool bCounted;
+		double StartCpuSeconds;
+		static thread_local FOperationScope* Innermost;
+	};
+
+	/** Adds the CPU time of a helper thread working for the current operation. */
+	class FThreadCpuScope
+	{
+	public:
+		explicit FThreadCpuScope(FLibzipStatsCollector* InCollector);
+		~FThreadCpuScope();
+
+	private:
+		FLibzipStatsCollector* Collector;
+		double StartCpuSeconds;
+	};
+
+	/** Measures the latency of one entry from its construction. */
+	class FEntryTimer
+	{
+	public:
+		explicit FEntryTimer(FLibzipStatsCollector* InCollector);
+
+		/** Records an entry decoded from CompressedBytes to UncompressedBytes. */
+		void FinishRead(int64 CompressedBytes, int64 UncompressedBytes);
+		/** Records an entry added from UncompressedBytes, with CompressedBytes below 0 if it is compressed later by libzip. */
+		void FinishWrite(int64 UncompressedBytes, int64 CompressedBytes);
+
+	private:
+		FLibzipStatsCollector* Collector;
+		uint64 StartCycles;
+	};
+
+	void AddCacheHit();
+	/** Adds bytes that belong to no entry, like the archive written on close. */
+	void AddBytes(int64 BytesIn, int64 BytesOut);
+
+	FLibzipOperationStats GetLastOperation() const;
+	FLibzipOperationStats GetCumulative() const;
+	void Reset();
+
+private:
+	struct FCounters
+	{
+		std::atomic<int64> WallNanoseconds{ 0 };
+		std::atomic<int64> CpuNanoseconds{ 0 };
+		std::atomic<int64> BytesIn{ 0 };
+		std::atomic<int64> BytesOut{ 0 };
+		/** Sizes of the entries whose compressed size is known, for the compression ratio. */
+		std::atomic<int64> CompressedBytes{ 0 };
+		std::atomic<int64> UncompressedBytes{ 0 };
+		std::atomic<int64> Entries{ 0 };
+		std::atomic<int64> CacheHits{ 0 };
+		FLibzipLatencyHistogram Latency;
+
+		void Reset();
+		FLibzipOperationStats ToStats() const;
+	};
+
+	void AddEntry(int64 BytesIn, int64 BytesOut, int64 CompressedBytes, int64 UncompressedBytes, uint64 Nanoseconds);
+	void AddCpu(double Seconds);
+
+	FCounters Last;
+	FCounters Total;
+	std::atomic<int32> ActiveCalls{ 0 };
+	std::atomic<uint64> OperationStartCycles{ 0 };
+};
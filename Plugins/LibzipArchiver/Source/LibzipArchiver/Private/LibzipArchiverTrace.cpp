@@ -0,0 +1,8 @@
+#include "LibzipArchiverTrace.h"
+
+UE_TRACE_CHANNEL_DEFINE(LibzipArchiverChannel)
+
+TRACE_DECLARE_MEMORY_COUNTER(LibzipArchiver_BytesRead, TEXT("LibzipArchiver/BytesRead"));
+TRACE_DECLARE_MEMORY_COUNTER(LibzipArchiver_BytesInflated, TEXT("LibzipArchiver/BytesInflated"));
+TRACE_DECLARE_MEMORY_COUNTER(LibzipArchiver_BytesWritten, TEXT("LibzipArchiver/BytesWritten"));
+TRACE_DECLARE_INT_COUNTER(LibzipArchiver_EntriesInFlight, TEXT("LibzipArchiver/EntriesInFlight"));
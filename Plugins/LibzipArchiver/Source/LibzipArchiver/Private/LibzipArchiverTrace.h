@@ -0,0 +1,36 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CountersTrace.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Trace/Trace.h"
+
+/** Timing events of archive work, recorded with -trace=cpu,LibzipArchiver. */
+UE_TRACE_CHANNEL_EXTERN(LibzipArchiverChannel)
+
+/** Archive bytes read by the file sources and readers of the plugin, and entries read through libzip's own file source. */
+TRACE_DECLARE_MEMORY_COUNTER_EXTERN(LibzipArchiver_BytesRead)
+/** Entry bytes produced by decoding. */
+TRACE_DECLARE_MEMORY_COUNTER_EXTERN(LibzipArchiver_BytesInflated)
+/** Bytes written to archives by the plugin's sinks, and to extracted files. */
+TRACE_DECLARE_MEMORY_COUNTER_EXTERN(LibzipArchiver_BytesWritten)
+TRACE_DECLARE_INT_COUNTER_EXTERN(LibzipArchiver_EntriesInFlight)
+
+#define LIBZIP_TRACE_SCOPE(Name) TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Name, LibzipArchiverChannel)
+
+/** Nested event named after an archive or entry, so that the enclosing scope can be attributed to it in Insights. */
+#define LIBZIP_TRACE_NAME_SCOPE(Name) TRACE_CPUPROFILER_EVENT_SCOPE_TEXT_ON_CHANNEL(Name, LibzipArchiverChannel)
+
+/** Counts an entry in LibzipArchiver_EntriesInFlight while it is being read or written. */
+struct FLibzipTraceEntryInFlight
+{
+	FLibzipTraceEntryInFlight()
+	{
+		TRACE_COUNTER_INCREMENT(LibzipArchiver_EntriesInFlight);
+	}
+
+	~FLibzipTraceEntryInFlight()
+	{
+		TRACE_COUNTER_DECREMENT(LibzipArchiver_EntriesInFlight);
+	}
+};
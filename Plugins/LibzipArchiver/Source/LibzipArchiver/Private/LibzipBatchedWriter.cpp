@@ -0,0 +1,499 @@
+#include "LibzipBatchedWriter.h"
+#include "LibzipArchiverLog.h"
+#include "LibzipArchiverTrace.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/Paths.h"
+
+#if PLATFORM_LINUX && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define LIBZIP_WITH_IO_URING 1
+#endif
+#endif
+#ifndef LIBZIP_WITH_IO_URING
+#define LIBZIP_WITH_IO_URING 0
+#endif
+
+#if LIBZIP_WITH_IO_URING
+#include <linux/io_uring.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register 427
+#endif
+#endif
+
+namespace
+{
+	constexpr int32 BatchMaxFiles = 64;
+	constexpr int64 BatchMaxBytes = 64 * 1024 * 1024;
+}
+
+#if LIBZIP_WITH_IO_URING
+
+/** Just enough of io_uring on raw system calls for the batched writer, as the engine does not ship liburing. */
+struct FLibzipUring
+{
+	~FLibzipUring()
+	{
+		if (Sqes != nullptr)
+		{
+			munmap(Sqes, SqesSize);
+		}
+		if (CqRing != nullptr && CqRing != SqRing)
+		{
+			munmap(CqRing, CqRingSize);
+		}
+		if (SqRing != nullptr)
+		{
+			munmap(SqRing, SqRingSize);
+		}
+		if (RingFd >= 0)
+		{
+			close(RingFd);
+		}
+	}
+
+	bool Init(uint32 EntryCount)
+	{
+		io_uring_params Params;
+		FMemory::Memzero(Params);
+		RingFd = syscall(__NR_io_uring_setup, EntryCount, &Params);
+		if (RingFd < 0)
+		{
+			return false;
+		}
+
+		SqRingSize = Params.sq_off.array + Params.sq_entries * sizeof(uint32);
+		CqRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(io_uring_cqe);
+		const bool bSingleMmap = (Params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (bSingleMmap)
+		{
+			SqRingSize = CqRingSize = FMath::Max(SqRingSize, CqRingSize);
+		}
+
+		void* Ring = mmap(nullptr, SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_SQ_RING);
+		if (Ring == MAP_FAILED)
+		{
+			return false;
+		}
+		SqRing = static_cast<uint8*>(Ring);
+
+		if (bSingleMmap)
+		{
+			CqRing = SqRing;
+		}
+		else
+		{
+			Ring = mmap(nullptr, CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_CQ_RING);
+			if (Ring == MAP_FAILED)
+			{
+				return false;
+			}
+			CqRing = static_cast<uint8*>(Ring);
+		}
+
+		SqesSize = Params.sq_entries * sizeof(io_uring_sqe);
+		Ring = mmap(nullptr, SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_SQES);
+		if (Ring == MAP_FAILED)
+		{
+			return false;
+		}
+		Sqes = static_cast<io_uring_sqe*>(Ring);
+
+		SqHead = reinterpret_cast<uint32*>(SqRing + Params.sq_off.head);
+		SqTailShared = reinterpret_cast<uint32*>(SqRing + Params.sq_off.tail);
+		SqMask = *reinterpret_cast<uint32*>(SqRing + Params.sq_off.ring_mask);
+		SqArray = reinterpret_cast<uint32*>(SqRing + Params.sq_off.array);
+		CqHead = reinterpret_cast<uint32*>(CqRing + Params.cq_off.head);
+		CqTail = reinterpret_cast<uint32*>(CqRing + Params.cq_off.tail);
+		CqMask = *reinterpret_cast<uint32*>(CqRing + Params.cq_off.ring_mask);
+		Cqes = reinterpret_cast<io_uring_cqe*>(CqRing + Params.cq_off.cqes);
+		SqEntries = Params.sq_entries;
+		SqTail = *SqTailShared;
+		return true;
+	}
+
+	bool SupportsOps(std::initializer_list<uint8> Ops)
+	{
+		constexpr int32 ProbeOpCount = 256;
+		TArray<uint8> ProbeBuffer;
+		ProbeBuffer.SetNumZeroed(sizeof(io_uring_probe) + ProbeOpCount * sizeof(io_uring_probe_op));
+		io_uring_probe* Probe = reinterpret_cast<io_uring_probe*>(ProbeBuffer.GetData());
+		if (syscall(__NR_io_uring_register, RingFd, IORING_REGISTER_PROBE, Probe, ProbeOpCount) < 0)
+		{
+			return false;
+		}
+		for (uint8 Op : Ops)
+		{
+			if (Op > Probe->last_op || (Probe->ops[Op].flags & IO_URING_OP_SUPPORTED) == 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/** Next free submission entry, cleared. There is always room as long as no more than SqEntries are queued between submissions. */
+	io_uring_sqe* GetSqe(uint8 Opcode, int Fd, uint64 UserData)
+	{
+		check(SqTail - __atomic_load_n(SqHead, __ATOMIC_ACQUIRE) < SqEntries);
+		const uint32 Slot = SqTail & SqMask;
+		io_uring_sqe* Sqe = &Sqes[Slot];
+		FMemory::Memzero(*Sqe);
+		Sqe->opcode = Opcode;
+		Sqe->fd = Fd;
+		Sqe->user_data = UserData;
+		SqArray[Slot] = Slot;
+		++SqTail;
+		++Queued;
+		return Sqe;
+	}
+
+	/** Submits the queued entries and calls OnCompletion for each of their completions. False if not all could be submitted. */
+	bool SubmitAndReap(TFunctionRef<void(const io_uring_cqe&)> OnCompletion)
+	{
+		__atomic_store_n(SqTailShared, SqTail, __ATOMIC_RELEASE);
+
+		uint32 Submitted = 0;
+		bool bResult = true;
+		while (Submitted < Queued)
+		{
+			const int Result = syscall(__NR_io_uring_enter, RingFd, Queued - Submitted, 0, 0, nullptr, 0);
+			if (Result < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				bResult = false;
+				break;
+			}
+			Submitted += Result;
+		}
+		Queued = 0;
+
+		for (uint32 Reaped = 0; Reaped < Submitted;)
+		{
+			const uint32 Head = *CqHead;
+			if (Head == __atomic_load_n(CqTail, __ATOMIC_ACQUIRE))
+			{
+				if (syscall(__NR_io_uring_enter, RingFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+				{
+					return false;
+				}
+				continue;
+			}
+			OnCompletion(Cqes[Head & CqMask]);
+			__atomic_store_n(CqHead, Head + 1, __ATOMIC_RELEASE);
+			++Reaped;
+		}
+		return bResult;
+	}
+
+	int RingFd = -1;
+	uint32 SqEntries = 0;
+	uint32 SqTail = 0;
+	uint32 Queued = 0;
+
+	uint8* SqRing = nullptr;
+	size_t SqRingSize = 0;
+	uint8* CqRing = nullptr;
+	size_t CqRingSize = 0;
+	io_uring_sqe* Sqes = nullptr;
+	size_t SqesSize = 0;
+
+	uint32* SqHead = nullptr;
+	uint32* SqTailShared = nullptr;
+	uint32 SqMask = 0;
+	uint32* SqArray = nullptr;
+	uint32* CqHead = nullptr;
+	uint32* CqTail = nullptr;
+	uint32 CqMask = 0;
+	io_uring_cqe* Cqes = nullptr;
+};
+
+namespace
+{
+	enum EUringStep : uint64
+	{
+		UringOpen,
+		UringWrite,
+		UringSync,
+		UringClose,
+	};
+
+	uint64 MakeUserData(EUringStep Step, int32 File)
+	{
+		return (static_cast<uint64>(Step) << 32) | static_cast<uint32>(File);
+	}
+
+	// A write through the ring is capped a little below 2 GiB by the kernel, so larger files are written without it.
+	constexpr int64 UringMaxWriteBytes = 1024 * 1024 * 1024;
+}
+
+#else
+
+struct FLibzipUring
+{
+};
+
+#endif
+
+FLibzipBatchedWriter::FLibzipBatchedWriter(ELibzipWriteDurability InDurability)
+	: Durability(InDurability)
+{
+#if LIBZIP_WITH_IO_URING
+	// Each file takes up to three entries (write, sync and close) in one submission.
+	Uring = MakeUnique<FLibzipUring>();
+	if (!Uring->Init(BatchMaxFiles * 4)
+		|| !Uring->SupportsOps({ IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_FSYNC, IORING_OP_CLOSE }))
+	{
+		Uring.Reset();
+	}
+#endif
+}
+
+FLibzipBatchedWriter::~FLibzipBatchedWriter()
+{
+	Flush();
+}
+
+bool FLibzipBatchedWriter::Add(const FString& FilePath, TArray64<uint8>&& Data)
+{
+	const FString Directory = FPaths::GetPath(FilePath);
+	if (!CreatedDirectories.Contains(Directory))
+	{
+		FPlatformFileManager::Get().GetPlatformFile().CreateDirectoryTree(*Directory);
+		CreatedDirectories.Add(Directory);
+	}
+
+	PendingBytes += Data.Num();
+	Pending.Add({ FilePath, MoveTemp(Data) });
+	if (Pending.Num() >= BatchMaxFiles || PendingBytes >= BatchMaxBytes)
+	{
+		WriteBatch();
+	}
+	return bSucceeded;
+}
+
+bool FLibzipBatchedWriter::Flush()
+{
+	WriteBatch();
+	const bool bResult = bSucceeded;
+	bSucceeded = true;
+	return bResult;
+}
+
+void FLibzipBatchedWriter::WriteBatch()
+{
+	if (Pending.Num() == 0)
+	{
+		return;
+	}
+
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_WriteBatch);
+	TRACE_COUNTER_ADD(LibzipArchiver_BytesWritten, PendingBytes);
+	if (!Uring.IsValid() || !WriteBatchUring())
+	{
+		WriteBatchPortable();
+	}
+	Pending.Reset();
+	PendingBytes = 0;
+}
+
+void FLibzipBatchedWriter::WriteBatchPortable()
+{
+	for (const FPendingFile& File : Pending)
+	{
+		if (!WriteFilePortable(File))
+		{
+			FailFile(File);
+		}
+	}
+}
+
+bool FLibzipBatchedWriter::WriteFilePortable(const FPendingFile& File) const
+{
+	TUniquePtr<IFileHandle> Handle(FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*File.Path));
+	// Files are synced one at a time here, so a sync per batch costs as much as one per file.
+	return Handle.IsValid()
+		&& Handle->Write(File.Data.GetData(), File.Data.Num())
+		&& (Durability == ELibzipWriteDurability::None || Handle->Flush(true));
+}
+
+bool FLibzipBatchedWriter::WriteBatchUring()
+{
+#if LIBZIP_WITH_IO_URING
+	const int32 Count = Pending.Num();
+	TArray<TArray<ANSICHAR>> Paths;
+	TArray<int32> Fds;
+	TArray<bool> Failed;
+	TArray<bool> Portable;
+	Fds.Init(-1, Count);
+	Failed.Init(false, Count);
+	Portable.Init(false, Count);
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		const FPendingFile& File = Pending[Index];
+		Portable[Index] = File.Data.Num() > UringMaxWriteBytes;
+		FTCHARToUTF8 Converter(*File.Path);
+		TArray<ANSICHAR>& Path = Paths.AddDefaulted_GetRef();
+		Path.Append(Converter.Get(), Converter.Length());
+		Path.Add('\0');
+	}
+
+	auto CloseRemaining = [&Fds]() {
+		for (int32& Fd : Fds)
+		{
+			if (Fd >= 0)
+			{
+				close(Fd);
+				Fd = -1;
+			}
+		}
+	};
+
+	// A failed submission leaves the ring unusable, so the batch is written again without it.
+	auto Abandon = [this, &CloseRemaining]() {
+		CloseRemaining();
+		Uring.Reset();
+		return false;
+	};
+
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		if (Portable[Index])
+		{
+			continue;
+		}
+		io_uring_sqe* Sqe = Uring->GetSqe(IORING_OP_OPENAT, AT_FDCWD, MakeUserData(UringOpen, Index));
+		Sqe->addr = reinterpret_cast<uint64>(Paths[Index].GetData());
+		Sqe->len = 0644;
+		Sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+	}
+	if (!Uring->SubmitAndReap([&Fds, &Failed](const io_uring_cqe& Cqe) {
+		const int32 Index = static_cast<int32>(Cqe.user_data & 0xffffffff);
+		Fds[Index] = Cqe.res;
+		Failed[Index] = Cqe.res < 0;
+	}))
+	{
+		return Abandon();
+	}
+
+	// Without a sync per batch, every file is written, synced if asked for and closed in one linked chain.
+	const bool bCloseInChain = Durability != ELibzipWriteDurability::SyncPerBatch;
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		if (Fds[Index] < 0)
+		{
+			continue;
+		}
+		io_uring_sqe* Sqe = Uring->GetSqe(IORING_OP_WRITE, Fds[Index], MakeUserData(UringWrite, Index));
+		Sqe->addr = reinterpret_cast<uint64>(Pending[Index].Data.GetData());
+		Sqe->len = static_cast<uint32>(Pending[Index].Data.Num());
+		Sqe->off = 0;
+		if (bCloseInChain)
+		{
+			Sqe->flags = IOSQE_IO_LINK;
+			if (Durability == ELibzipWriteDurability::SyncPerFile)
+			{
+				Uring->GetSqe(IORING_OP_FSYNC, Fds[Index], MakeUserData(UringSync, Index))->flags = IOSQE_IO_LINK;
+			}
+			Uring->GetSqe(IORING_OP_CLOSE, Fds[Index], MakeUserData(UringClose, Index));
+		}
+	}
+
+	auto OnWriteCompletion = [this, &Fds, &Failed, &Portable](const io_uring_cqe& Cqe) {
+		const int32 Index = static_cast<int32>(Cqe.user_data & 0xffffffff);
+		switch (static_cast<EUringStep>(Cqe.user_data >> 32))
+		{
+		case UringWrite:
+			if (Cqe.res >= 0 && Cqe.res < Pending[Index].Data.Num())
+			{
+				// A short write is not an error, the file is written again without the ring.
+				Portable[Index] = true;
+			}
+			else
+			{
+				Failed[Index] |= Cqe.res != Pending[Index].Data.Num();
+			}
+			break;
+		case UringSync:
+			// The sync is cancelled with the rest of the chain after a failed or short write, which is handled there.
+			Failed[Index] |= Cqe.res < 0 && Cqe.res != -ECANCELED;
+			break;
+		case UringClose:
+			// The close is cancelled with the rest of the chain when the write fails or is short.
+			if (Cqe.res == -ECANCELED)
+			{
+				close(Fds[Index]);
+			}
+			else
+			{
+				Failed[Index] |= Cqe.res < 0;
+			}
+			Fds[Index] = -1;
+			break;
+		default:
+			break;
+		}
+	};
+	if (!Uring->SubmitAndReap(OnWriteCompletion))
+	{
+		return Abandon();
+	}
+
+	if (!bCloseInChain)
+	{
+		// One sync of the file system holding the batch, instead of one per file.
+		const int32* SyncFd = Fds.FindByPredicate([](int32 Fd) { return Fd >= 0; });
+		if (SyncFd != nullptr && syncfs(*SyncFd) < 0)
+		{
+			for (int32 Index = 0; Index < Count; ++Index)
+			{
+				Failed[Index] |= Fds[Index] >= 0;
+			}
+		}
+		for (int32 Index = 0; Index < Count; ++Index)
+		{
+			if (Fds[Index] >= 0)
+			{
+				Uring->GetSqe(IORING_OP_CLOSE, Fds[Index], MakeUserData(UringClose, Index));
+			}
+		}
+		if (!Uring->SubmitAndReap(OnWriteCompletion))
+		{
+			return Abandon();
+		}
+	}
+	CloseRemaining();
+
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		if (Failed[Index] || (Portable[Index] && !WriteFilePortable(Pending[Index])))
+		{
+			FailFile(Pending[Index]);
+		}
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+void FLibzipBatchedWriter::FailFile(const FPendingFile& File)
+{
+	UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to write file %s"), *File.Path);
+	FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*File.Path);
+	bSucceeded = false;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LibzipArchiver.h"
+
+struct FLibzipUring;
+
+/**
+ * Writes many small files in batches.
+ * On Linux the opens, writes, syncs and closes of a batch are each submitted at once through io_uring.
+ * Elsewhere, and on kernels without the needed io_uring operations, the files are written one by one.
+ * So are files over 1 GiB and files which io_uring only wrote in part.
+ */
+class FLibzipBatchedWriter
+{
+public:
+	explicit FLibzipBatchedWriter(ELibzipWriteDurability InDurability);
+	~FLibzipBatchedWriter();
+
+	/** Queues a file and writes the batch once it is full. Returns false if a file of a written batch failed. */
+	bool Add(const FString& FilePath, TArray64<uint8>&& Data);
+
+	/** Writes the queued files. Files which failed are deleted. Returns false if any file failed since the previous call. */
+	bool Flush();
+
+private:
+	struct FPendingFile
+	{
+		FString Path;
+		TArray64<uint8> Data;
+	};
+
+	void WriteBatch();
+	void WriteBatchPortable();
+	bool WriteFilePortable(const FPendingFile& File) const;
+	bool WriteBatchUring();
+	void FailFile(const FPendingFile& File);
+
+	ELibzipWriteDurability Durability;
+	TUniquePtr<FLibzipUring> Uring;
+	TArray<FPendingFile> Pending;
+	int64 PendingBytes = 0;
+	TSet<FString> CreatedDirectories;
+	bool bSucceeded = true;
+};
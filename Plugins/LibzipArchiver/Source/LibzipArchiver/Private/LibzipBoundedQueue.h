@@ -0,0 +1,107 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * Bounded lock-free queue for any number of producers and consumers, after Dmitry Vyukov's array queue.
+ * Every cell carries a sequence number telling whether it is free for the producer or filled for the consumer of a given lap.
+ */
+template <typename T>
+class TLibzipBoundedQueue
+{
+public:
+	/** Capacity is rounded up to a power of two. */
+	explicit TLibzipBoundedQueue(uint32 InCapacity)
+		: Capacity(FMath::RoundUpToPowerOfTwo(FMath::Max<uint32>(InCapacity, 2)))
+		, Cells(MakeUnique<FCell[]>(Capacity))
+	{
+		for (uint32 Index = 0; Index < Capacity; ++Index)
+		{
+			Cells[Index].Sequence.store(Index, std::memory_order_relaxed);
+		}
+	}
+
+	/** Returns false, leaving Item untouched, if the queue is full. */
+	bool TryPush(T& Item)
+	{
+		FCell* Cell;
+		uint64 Position = PushPosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell = &Cells[Position & (Capacity - 1)];
+			const int64 Difference = static_cast<int64>(Cell->Sequence.load(std::memory_order_acquire)) - static_cast<int64>(Position);
+			if (Difference == 0)
+			{
+				if (PushPosition.compare_exchange_weak(Position, Position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (Difference < 0)
+			{
+				return false;
+			}
+			else
+			{
+				Position = PushPosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		Cell->Value = MoveTemp(Item);
+		Cell->Sequence.store(Position + 1, std::memory_order_release);
+		Count.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	/** Returns false if the queue is empty. */
+	bool TryPop(T& Item)
+	{
+		FCell* Cell;
+		uint64 Position = PopPosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell = &Cells[Position & (Capacity - 1)];
+			const int64 Difference = static_cast<int64>(Cell->Sequence.load(std::memory_order_acquire)) - static_cast<int64>(Position + 1);
+			if (Difference == 0)
+			{
+				if (PopPosition.compare_exchange_weak(Position, Position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (Difference < 0)
+			{
+				return false;
+			}
+			else
+			{
+				Position = PopPosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		Item = MoveTemp(Cell->Value);
+		Cell->Sequence.store(Position + Capacity, std::memory_order_release);
+		Count.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	/** Number of queued items, which may be stale by the time it is used. */
+	int32 Num() const
+	{
+		return FMath::Max(Count.load(std::memory_order_relaxed), 0);
+	}
+
+private:
+	struct FCell
+	{
+		std::atomic<uint64> Sequence;
+		T Value;
+	};
+
+	const uint32 Capacity;
+	TUniquePtr<FCell[]> Cells;
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> PushPosition{ 0 };
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> PopPosition{ 0 };
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<int32> Count{ 0 };
+};
@@ -0,0 +1,370 @@
+#include "LibzipCentralDirectory.h"
+#include "LibzipArchiverLog.h"
+#include "LibzipArchiverTrace.h"
+#include "LibzipCoreArchive.h"
+#include "HAL/PlatformFilemanager.h"
+
+namespace
+{
+	constexpr uint32 CentralHeaderSignature = 0x02014b50;
+	constexpr uint32 EndOfCentralDirSignature = 0x06054b50;
+	constexpr uint32 Zip64EndOfCentralDirSignature = 0x06064b50;
+	constexpr uint32 Zip64EndOfCentralDirLocatorSignature = 0x07064b50;
+
+	constexpr int64 CentralHeaderSize = 46;
+	constexpr int64 Zip64EndOfCentralDirSize = 56;
+
+	constexpr uint16 Zip64ExtraFieldId = 0x0001;
+	constexpr uint16 Zip64VersionNeeded = 45;
+
+	/** Size of the chunks in which the data of a delta archive is copied. */
+	constexpr int64 AppendCopyChunkBytes = 4 * 1024 * 1024;
+
+	uint16 ReadUInt16(const uint8* Data)
+	{
+		return Data[0] | (Data[1] << 8);
+	}
+
+	uint32 ReadUInt32(const uint8* Data)
+	{
+		return Data[0] | (Data[1] << 8) | (Data[2] << 16) | (static_cast<uint32>(Data[3]) << 24);
+	}
+
+	uint64 ReadUInt64(const uint8* Data)
+	{
+		return ReadUInt32(Data) | (static_cast<uint64>(ReadUInt32(Data + 4)) << 32);
+	}
+
+	void WriteUInt16(uint8* Data, uint16 Value)
+	{
+		Data[0] = Value & 0xFF;
+		Data[1] = (Value >> 8) & 0xFF;
+	}
+
+	void WriteUInt32(uint8* Data, uint32 Value)
+	{
+		WriteUInt16(Data, Value & 0xFFFF);
+		WriteUInt16(Data + 2, (Value >> 16) & 0xFFFF);
+	}
+
+	void AppendUInt16(TArray64<uint8>& Out, uint16 Value)
+	{
+		WriteUInt16(&Out[Out.AddUninitialized(2)], Value);
+	}
+
+	void AppendUInt32(TArray64<uint8>& Out, uint32 Value)
+	{
+		WriteUInt32(&Out[Out.AddUninitialized(4)], Value);
+	}
+
+	void AppendUInt64(TArray64<uint8>& Out, uint64 Value)
+	{
+		AppendUInt32(Out, Value & 0xFFFFFFFF);
+		AppendUInt32(Out, Value >> 32);
+	}
+
+	/** Reads the local header offset of a central directory record, from its ZIP64 extra field if it does not fit 32 bits. */
+	bool ReadLocalHeaderOffset(const uint8* Record, uint64& Offset)
+	{
+		Offset = ReadUInt32(Record + 42);
+		if (Offset != MAX_uint32)
+		{
+			return true;
+		}
+
+		const uint16 ExtraLength = ReadUInt16(Record + 30);
+		const uint8* Extra = Record + CentralHeaderSize + ReadUInt16(Record + 28);
+		for (int32 Pos = 0; Pos + 4 <= ExtraLength;)
+		{
+			const uint16 FieldId = ReadUInt16(Extra + Pos);
+			const uint16 FieldSize = ReadUInt16(Extra + Pos + 2);
+			if (Pos + 4 + FieldSize > ExtraLength)
+			{
+				return false;
+			}
+			if (FieldId == Zip64ExtraFieldId)
+			{
+				// The offset follows the sizes that do not fit 32 bits either.
+				const uint8* Value = Extra + Pos + 4;
+				const uint8* ValueEnd = Value + FieldSize;
+				Value += ReadUInt32(Record + 24) == MAX_uint32 ? 8 : 0;
+				Value += ReadUInt32(Record + 20) == MAX_uint32 ? 8 : 0;
+				if (Value + 8 > ValueEnd)
+				{
+					return false;
+				}
+				Offset = ReadUInt64(Value);
+				return true;
+			}
+			Pos += 4 + FieldSize;
+		}
+		return false;
+	}
+
+	/** Appends a central directory record whose local header has moved to NewOffset, adding or updating its ZIP64 extra field when needed. */
+	bool AppendRelocatedRecord(TArray64<uint8>& Out, const uint8* Record, uint64 NewOffset)
+	{
+		const uint32 UncompSize32 = ReadUInt32(Record + 24);
+		const uint32 CompSize32 = ReadUInt32(Record + 20);
+		const uint16 DiskNumber16 = ReadUInt16(Record + 34);
+		const uint32 Offset32 = ReadUInt32(Record + 42);
+		const uint16 NameLength = ReadUInt16(Record + 28);
+		const uint16 ExtraLength = ReadUInt16(Record + 30);
+		const uint16 CommentLength = ReadUInt16(Record + 32);
+		const uint8* Extra = Record + CentralHeaderSize + NameLength;
+
+		const int64 Start = Out.Num();
+		if (Offset32 != MAX_uint32 && NewOffset < MAX_uint32)
+		{
+			Out.Append(Record, CentralHeaderSize + NameLength + ExtraLength + CommentLength);
+			WriteUInt32(&Out[Start + 42], static_cast<uint32>(NewOffset));
+			return true;
+		}
+
+		uint64 UncompSize = UncompSize32;
+		uint64 CompSize = CompSize32;
+		uint32 DiskNumber = DiskNumber16;
+		TArray64<uint8> OtherFields;
+		for (int32 Pos = 0; Pos + 4 <= ExtraLength;)
+		{
+			const uint16 FieldId = ReadUInt16(Extra + Pos);
+			const uint16 FieldSize = ReadUInt16(Extra + Pos + 2);
+			if (Pos + 4 + FieldSize > ExtraLength)
+			{
+				return false;
+			}
+			if (FieldId == Zip64ExtraFieldId)
+			{
+				const uint8* Value = Extra + Pos + 4;
+				const uint8* ValueEnd = Value + FieldSize;
+				if (UncompSize32 == MAX_uint32 && Value + 8 <= ValueEnd) { UncompSize = ReadUInt64(Value); Value += 8; }
+				if (CompSize32 == MAX_uint32 && Value + 8 <= ValueEnd) { CompSize = ReadUInt64(Value); Value += 8; }
+				if (Offset32 == MAX_uint32 && Value + 8 <= ValueEnd) { Value += 8; }
+				if (DiskNumber16 == MAX_uint16 && Value + 4 <= ValueEnd) { DiskNumber = ReadUInt32(Value); }
+			}
+			else
+			{
+				OtherFields.Append(Extra + Pos, 4 + FieldSize);
+			}
+			Pos += 4 + FieldSize;
+		}
+
+		TArray64<uint8> Zip64Field;
+		AppendUInt16(Zip64Field, Zip64ExtraFieldId);
+		AppendUInt16(Zip64Field, 0);
+		if (UncompSize32 == MAX_uint32) { AppendUInt64(Zip64Field, UncompSize); }
+		if (CompSize32 == MAX_uint32) { AppendUInt64(Zip64Field, CompSize); }
+		AppendUInt64(Zip64Field, NewOffset);
+		if (DiskNumber16 == MAX_uint16) { AppendUInt32(Zip64Field, DiskNumber); }
+		WriteUInt16(&Zip64Field[2], static_cast<uint16>(Zip64Field.Num() - 4));
+
+		const int64 NewExtraLength = Zip64Field.Num() + OtherFields.Num();
+		if (NewExtraLength > MAX_uint16)
+		{
+			return false;
+		}
+
+		Out.Append(Record, CentralHeaderSize + NameLength);
+		Out.Append(Zip64Field);
+		Out.Append(OtherFields);
+		Out.Append(Extra + ExtraLength, CommentLength);
+		WriteUInt16(&Out[Start + 6], FMath::Max(ReadUInt16(Record + 6), Zip64VersionNeeded));
+		WriteUInt16(&Out[Start + 30], static_cast<uint16>(NewExtraLength));
+		WriteUInt32(&Out[Start + 42], MAX_uint32);
+		return true;
+	}
+
+	void AppendEndOfCentralDirectory(TArray64<uint8>& Out, int64 EntryCount, int64 DirectoryOffset, int64 DirectorySize, const TArray<uint8>& Comment)
+	{
+		const bool bNeedsZip64 = EntryCount >= MAX_uint16 || DirectoryOffset >= MAX_uint32 || DirectorySize >= MAX_uint32;
+		if (bNeedsZip64)
+		{
+			const int64 Zip64RecordOffset = DirectoryOffset + DirectorySize;
+			AppendUInt32(Out, Zip64EndOfCentralDirSignature);
+			AppendUInt64(Out, Zip64EndOfCentralDirSize - 12);
+			AppendUInt16(Out, Zip64VersionNeeded);
+			AppendUInt16(Out, Zip64VersionNeeded);
+			AppendUInt32(Out, 0);
+			AppendUInt32(Out, 0);
+			AppendUInt64(Out, EntryCount);
+			AppendUInt64(Out, EntryCount);
+			AppendUInt64(Out, DirectorySize);
+			AppendUInt64(Out, DirectoryOffset);
+
+			AppendUInt32(Out, Zip64EndOfCentralDirLocatorSignature);
+			AppendUInt32(Out, 0);
+			AppendUInt64(Out, Zip64RecordOffset);
+			AppendUInt32(Out, 1);
+		}
+
+		AppendUInt32(Out, EndOfCentralDirSignature);
+		AppendUInt16(Out, 0);
+		AppendUInt16(Out, 0);
+		AppendUInt16(Out, static_cast<uint16>(FMath::Min<int64>(EntryCount, MAX_uint16)));
+		AppendUInt16(Out, static_cast<uint16>(FMath::Min<int64>(EntryCount, MAX_uint16)));
+		AppendUInt32(Out, static_cast<uint32>(FMath::Min<int64>(DirectorySize, MAX_uint32)));
+		AppendUInt32(Out, static_cast<uint32>(FMath::Min<int64>(DirectoryOffset, MAX_uint32)));
+		AppendUInt16(Out, static_cast<uint16>(Comment.Num()));
+		Out.Append(Comment.GetData(), Comment.Num());
+	}
+}
+
+bool FLibzipCentralDirectory::Load(int64 ArchiveSize, FReadFunction Read)
+{
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_ParseCentralDirectory);
+	LibzipCore::FEndOfCentralDirectory End;
+	const LibzipCore::FReadFunction ReadArchive = [&Read](uint64_t ReadOffset, uint64_t Size, uint8_t* Out) {
+		return Read(static_cast<int64>(ReadOffset), static_cast<int64>(Size), Out);
+	};
+	if (ArchiveSize < 0 || !LibzipCore::ReadEndOfCentralDirectory(ArchiveSize, ReadArchive, End))
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Not found end of central directory"));
+		return false;
+	}
+	const uint64 EntryCount = End.EntryCount;
+	const uint64 DirectorySize = End.DirectorySize;
+	const uint64 DirectoryOffset = End.DirectoryOffset;
+	Comment = TArray<uint8>(End.Comment.data(), static_cast<int32>(End.Comment.size()));
+
+	Offset = DirectoryOffset;
+	Bytes.SetNumUninitialized(DirectorySize);
+	if (!Read(DirectoryOffset, DirectorySize, Bytes.GetData()))
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read central directory"));
+		return false;
+	}
+
+	Records.Reset(EntryCount);
+	for (int64 Pos = 0; Pos < Bytes.Num();)
+	{
+		if (Pos + CentralHeaderSize > Bytes.Num() || ReadUInt32(&Bytes[Pos]) != CentralHeaderSignature)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Invalid central directory"));
+			return false;
+		}
+		const uint16 NameLength = ReadUInt16(&Bytes[Pos + 28]);
+		const int64 Length = CentralHeaderSize + NameLength + ReadUInt16(&Bytes[Pos + 30]) + ReadUInt16(&Bytes[Pos + 32]);
+		if (Pos + Length > Bytes.Num())
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Invalid central directory"));
+			return false;
+		}
+		const auto Name = StringCast<TCHAR>(reinterpret_cast<const UTF8CHAR*>(&Bytes[Pos + CentralHeaderSize]), NameLength);
+		Records.Add({ Pos, Length, FString(Name.Length(), Name.Get()) });
+		Pos += Length;
+	}
+
+	if (static_cast<uint64>(Records.Num()) != EntryCount)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Invalid central directory"));
+		return false;
+	}
+
+	return true;
+}
+
+bool FLibzipAppender::Append(const FString& ArchivePath, const FString& DeltaPath)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	TUniquePtr<IFileHandle> DeltaFile(PlatformFile.OpenRead(*DeltaPath));
+	if (!DeltaFile.IsValid())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read appended entries"));
+		return false;
+	}
+	TUniquePtr<IFileHandle> File(PlatformFile.OpenWrite(*ArchivePath, true, true));
+	if (!File.IsValid())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to open archive for append"));
+		return false;
+	}
+	return Append(*File, *DeltaFile);
+}
+
+bool FLibzipAppender::Append(IFileHandle& File, IFileHandle& DeltaFile)
+{
+	FLibzipCentralDirectory Delta;
+	bool bDeltaLoaded = Delta.Load(DeltaFile.Size(), [&DeltaFile](int64 Offset, int64 Size, uint8* Out) {
+		return DeltaFile.Seek(Offset) && DeltaFile.Read(Out, Size);
+	});
+	if (!bDeltaLoaded)
+	{
+		return false;
+	}
+
+	const int64 ArchiveSize = File.Size();
+	FLibzipCentralDirectory Directory;
+	bool bLoaded = Directory.Load(ArchiveSize, [&File](int64 Offset, int64 Size, uint8* Out) {
+		return File.Seek(Offset) && File.Read(Out, Size);
+	});
+	if (!bLoaded)
+	{
+		return false;
+	}
+
+	TSet<FString> DeltaNames;
+	for (const FLibzipCentralDirectory::FRecord& Record : Delta.Records)
+	{
+		DeltaNames.Add(Record.Name);
+	}
+
+	// The new entries follow the old end of central directory, so the directory offsets of the delta shift by the archive size.
+	// The old central directory is left dead in between, like replaced entries, until the archive is compacted.
+	const int64 DataOffset = ArchiveSize;
+	const int64 NewDirectoryOffset = DataOffset + Delta.Offset;
+
+	TArray64<uint8> NewDirectory;
+	NewDirectory.Reserve(Directory.Bytes.Num() + Delta.Bytes.Num());
+	int64 EntryCount = 0;
+	for (const FLibzipCentralDirectory::FRecord& Record : Directory.Records)
+	{
+		if (!DeltaNames.Contains(Record.Name))
+		{
+			NewDirectory.Append(&Directory.Bytes[Record.Offset], Record.Length);
+			++EntryCount;
+		}
+	}
+	for (const FLibzipCentralDirectory::FRecord& Record : Delta.Records)
+	{
+		const uint8* RecordData = &Delta.Bytes[Record.Offset];
+		uint64 LocalHeaderOffset;
+		if (!ReadLocalHeaderOffset(RecordData, LocalHeaderOffset))
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Invalid central directory"));
+			return false;
+		}
+		if (!AppendRelocatedRecord(NewDirectory, RecordData, DataOffset + LocalHeaderOffset))
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to relocate entry %s"), *Record.Name);
+			return false;
+		}
+		++EntryCount;
+	}
+	const int64 NewDirectorySize = NewDirectory.Num();
+	AppendEndOfCentralDirectory(NewDirectory, EntryCount, NewDirectoryOffset, NewDirectorySize, Directory.Comment);
+
+	// Until the new end of central directory is written the old one is still the last in the archive, so a failure only has to
+	// cut off what was written. The entry data is copied in chunks, so that only the directories are held in memory.
+	bool bWritten = File.Seek(DataOffset) && DeltaFile.Seek(0);
+	TArray<uint8> Buffer;
+	Buffer.SetNumUninitialized(static_cast<int32>(FMath::Min(Delta.Offset, AppendCopyChunkBytes)));
+	for (int64 Copied = 0; bWritten && Copied < Delta.Offset; Copied += Buffer.Num())
+	{
+		const int32 ChunkBytes = static_cast<int32>(FMath::Min<int64>(Buffer.Num(), Delta.Offset - Copied));
+		bWritten = DeltaFile.Read(Buffer.GetData(), ChunkBytes) && File.Write(Buffer.GetData(), ChunkBytes);
+	}
+	if (!bWritten
+		|| !File.Write(NewDirectory.GetData(), NewDirectory.Num())
+		|| !File.Flush(true))
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to write appended entries"));
+		if (!File.Truncate(ArchiveSize) || !File.Flush(true))
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to restore archive after failed append"));
+		}
+		return false;
+	}
+	TRACE_COUNTER_ADD(LibzipArchiver_BytesWritten, Delta.Offset + NewDirectory.Num());
+
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class IFileHandle;
+
+/**
+ * Raw view of the central directory of a zip archive.
+ * Records are kept as they are stored so that they can be written back without going through libzip.
+ */
+struct FLibzipCentralDirectory
+{
+	struct FRecord
+	{
+		/** Position of the record in Bytes. */
+		int64 Offset;
+		int64 Length;
+		FString Name;
+	};
+
+	/** Reads Size bytes at Offset of the archive into Out. */
+	typedef TFunctionRef<bool(int64 Offset, int64 Size, uint8* Out)> FReadFunction;
+
+	bool Load(int64 ArchiveSize, FReadFunction Read);
+
+	/** Offset of the central directory in the archive, which is also where the entry data ends. */
+	int64 Offset = 0;
+	TArray64<uint8> Bytes;
+	TArray<FRecord> Records;
+	TArray<uint8> Comment;
+};
+
+struct FLibzipAppender
+{
+	/**
+	 * Appends the entries of the archive at DeltaPath to the archive at ArchivePath.
+	 * The entry data and a new central directory are written after the end of the archive, so the old central directory stays valid
+	 * until the new one is complete, and the archive is truncated back to its old size if writing fails.
+	 * Entries of the archive with the same name as a delta entry are dropped from the directory and their data is left dead.
+	 */
+	static bool Append(const FString& ArchivePath, const FString& DeltaPath);
+	/** Appends to an archive opened for reading and writing. Only the central directories are read into memory. */
+	static bool Append(IFileHandle& File, IFileHandle& DeltaFile);
+};
@@ -0,0 +1,32 @@
+#include "LibzipDirectoryIndex.h"
+
+void FLibzipDirectoryIndex::Add(const FString& Name, int64 Size)
+{
+	Index.Add(TCHAR_TO_UTF8(*Name), Size);
+}
+
+void FLibzipDirectoryIndex::Build()
+{
+	Index.Build();
+}
+
+void FLibzipDirectoryIndex::List(const FString& Path, bool bRecursive, TArray<FString>& Names) const
+{
+	std::vector<std::string> Utf8Names;
+	Index.List(TCHAR_TO_UTF8(*Path), bRecursive, Utf8Names);
+	Names.Reserve(Names.Num() + Utf8Names.size());
+	for (const std::string& Name : Utf8Names)
+	{
+		Names.Add(UTF8_TO_TCHAR(Name.c_str()));
+	}
+}
+
+bool FLibzipDirectoryIndex::Exists(const FString& Path) const
+{
+	return Index.Exists(TCHAR_TO_UTF8(*Path));
+}
+
+int64 FLibzipDirectoryIndex::GetSize(const FString& Path) const
+{
+	return Index.GetSize(TCHAR_TO_UTF8(*Path));
+}
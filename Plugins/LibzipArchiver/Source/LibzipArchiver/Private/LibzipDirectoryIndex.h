@@ -0,0 +1,21 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LibzipCoreDirectoryIndex.h"
+
+/** Engine facing wrapper of LibzipCore::FDirectoryIndex. */
+class FLibzipDirectoryIndex
+{
+public:
+	/** Adds an entry before Build. */
+	void Add(const FString& Name, int64 Size);
+	void Build();
+
+	/** See ULibzipArchiver::ListDirectory. */
+	void List(const FString& Path, bool bRecursive, TArray<FString>& Names) const;
+	bool Exists(const FString& Path) const;
+	int64 GetSize(const FString& Path) const;
+
+private:
+	LibzipCore::FDirectoryIndex Index;
+};
@@ -0,0 +1,346 @@
+#include "LibzipEntryFileHandle.h"
+#include "LibzipArchiverLog.h"
+#include "LibzipArchiverTrace.h"
+#include "LibzipReaderPool.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+
+THIRD_PARTY_INCLUDES_START
+#include "zlib.h"
+THIRD_PARTY_INCLUDES_END
+
+namespace
+{
+	/** Entries up to this size, and entries libzip has to read, are decoded completely when they are opened. */
+	constexpr int64 EntryHandleInMemoryMaxBytes = 1024 * 1024;
+	constexpr int64 EntryHandleChunkBytes = 256 * 1024;
+	constexpr int32 EntryHandleMaxCachedChunks = 8;
+	constexpr int64 EntryHandleInputBytes = 64 * 1024;
+	/** Inflate states are kept at least this far apart, and at most EntryHandleMaxCheckpoints per handle. */
+	constexpr int64 EntryHandleMinCheckpointInterval = 4 * 1024 * 1024;
+	constexpr int64 EntryHandleMaxCheckpoints = 64;
+
+	class FEntryFileHandle : public IFileHandle
+	{
+	public:
+		static IFileHandle* Open(IPlatformFile& LowerLevel, const TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe>& Pool, int64 Index);
+
+		virtual ~FEntryFileHandle() override;
+
+		virtual int64 Tell() override { return Position; }
+		virtual bool Seek(int64 NewPosition) override;
+		virtual bool SeekFromEnd(int64 NewPositionRelativeToEnd = 0) override;
+		virtual bool Read(uint8* Destination, int64 BytesToRead) override;
+		virtual bool Write(const uint8* Source, int64 BytesToWrite) override { return false; }
+		virtual bool Flush(const bool bFullFlush = false) override { return false; }
+		virtual bool Truncate(int64 NewSize) override { return false; }
+		virtual int64 Size() override { return Entry.Size; }
+
+	private:
+		struct FChunk
+		{
+			int64 Index = -1;
+			uint64 LastUse = 0;
+			TArray<uint8> Data;
+		};
+
+		struct FCheckpoint
+		{
+			int64 OutputPosition;
+			int64 InputPosition;
+			uint32 Crc;
+			/** Not movable, as zlib keeps a pointer back to the stream. */
+			z_stream State;
+		};
+
+		FEntryFileHandle(const TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe>& InPool, int64 InIndex)
+			: Pool(InPool), Entry(InPool->GetEntry(InIndex))
+		{
+		}
+
+		const TArray<uint8>* GetChunk(int64 ChunkIndex);
+		bool PrepareStream(int64 ChunkStart);
+		bool InflateNextChunk(TArray<uint8>& Data);
+		void EndStream();
+
+		TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool;
+		const FLibzipReaderPool::FEntry& Entry;
+		int64 Position = 0;
+		FLibzipTraceEntryInFlight InFlight;
+
+		/** Content of entries decoded when they were opened. */
+		TArray64<uint8> Content;
+		bool bInMemory = false;
+
+		TUniquePtr<IFileHandle> File;
+		int64 DataOffset = 0;
+
+		z_stream Stream;
+		bool bStreamActive = false;
+		/** Own counters, as those of zlib are 32 bits wide on Windows. */
+		int64 OutputPosition = 0;
+		int64 InputPosition = 0;
+		uint32 Crc = 0;
+		TArray<uint8> Input;
+		TArray<uint8> SkippedChunk;
+		TArray<FChunk> Chunks;
+		uint64 UseCount = 0;
+		int64 CheckpointInterval = 0;
+		TArray<TUniquePtr<FCheckpoint>> Checkpoints;
+	};
+
+	IFileHandle* FEntryFileHandle::Open(IPlatformFile& LowerLevel, const TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe>& Pool, int64 Index)
+	{
+		TUniquePtr<FEntryFileHandle> Handle(new FEntryFileHandle(Pool, Index));
+		const FLibzipReaderPool::FEntry& Entry = Handle->Entry;
+		if (!Entry.bDirect || (!Entry.bStored && Entry.Size <= EntryHandleInMemoryMaxBytes))
+		{
+			FString Name;
+			TArray64<uint8>& Content = Handle->Content;
+			const bool bResult = Pool->Read(Index, Name, [&Content](int64 Size) {
+				Content.SetNumUninitialized(Size);
+				return Content.GetData();
+			}, [](const FString&) {});
+			if (!bResult)
+			{
+				return nullptr;
+			}
+			Handle->bInMemory = true;
+			return Handle.Release();
+		}
+
+		Handle->File.Reset(LowerLevel.OpenRead(*Pool->GetArchivePath()));
+		uint8 Header[FLibzipReaderPool::LocalHeaderSize];
+		if (!Handle->File.IsValid() || !Handle->File->Seek(Entry.LocalHeaderOffset) || !Handle->File->Read(Header, FLibzipReaderPool::LocalHeaderSize)
+			|| (Handle->DataOffset = FLibzipReaderPool::GetDataOffset(Header, Entry.LocalHeaderOffset)) < 0)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read local header of %s"), *Entry.Name);
+			return nullptr;
+		}
+
+		if (!Entry.bStored)
+		{
+			Handle->Input.SetNumUninitialized(EntryHandleInputBytes);
+			Handle->CheckpointInterval = FMath::Max(EntryHandleMinCheckpointInterval,
+				Align(FMath::DivideAndRoundUp(Entry.Size, EntryHandleMaxCheckpoints), EntryHandleChunkBytes));
+		}
+		return Handle.Release();
+	}
+
+	FEntryFileHandle::~FEntryFileHandle()
+	{
+		EndStream();
+		for (const TUniquePtr<FCheckpoint>& Checkpoint : Checkpoints)
+		{
+			inflateEnd(&Checkpoint->State);
+		}
+	}
+
+	bool FEntryFileHandle::Seek(int64 NewPosition)
+	{
+		if (NewPosition < 0 || NewPosition > Entry.Size)
+		{
+			return false;
+		}
+		Position = NewPosition;
+		return true;
+	}
+
+	bool FEntryFileHandle::SeekFromEnd(int64 NewPositionRelativeToEnd)
+	{
+		return NewPositionRelativeToEnd <= 0 && Seek(Entry.Size + NewPositionRelativeToEnd);
+	}
+
+	bool FEntryFileHandle::Read(uint8* Destination, int64 BytesToRead)
+	{
+		if (BytesToRead < 0 || Position + BytesToRead > Entry.Size)
+		{
+			return false;
+		}
+
+		if (bInMemory)
+		{
+			FMemory::Memcpy(Destination, Content.GetData() + Position, BytesToRead);
+		}
+		else if (Entry.bStored)
+		{
+			if (!File->Seek(DataOffset + Position) || !File->Read(Destination, BytesToRead))
+			{
+				UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read entry %s"), *Entry.Name);
+				return false;
+			}
+			TRACE_COUNTER_ADD(LibzipArchiver_BytesRead, BytesToRead);
+		}
+		else
+		{
+			int64 ReadPosition = Position;
+			while (ReadPosition < Position + BytesToRead)
+			{
+				const TArray<uint8>* Chunk = GetChunk(ReadPosition / EntryHandleChunkBytes);
+				if (Chunk == nullptr)
+				{
+					return false;
+				}
+				const int64 ChunkOffset = ReadPosition % EntryHandleChunkBytes;
+				const int64 CopyBytes = FMath::Min<int64>(Chunk->Num() - ChunkOffset, Position + BytesToRead - ReadPosition);
+				FMemory::Memcpy(Destination + (ReadPosition - Position), Chunk->GetData() + ChunkOffset, CopyBytes);
+				ReadPosition += CopyBytes;
+			}
+		}
+
+		Position += BytesToRead;
+		return true;
+	}
+
+	const TArray<uint8>* FEntryFileHandle::GetChunk(int64 ChunkIndex)
+	{
+		for (FChunk& Chunk : Chunks)
+		{
+			if (Chunk.Index == ChunkIndex)
+			{
+				Chunk.LastUse = ++UseCount;
+				return &Chunk.Data;
+			}
+		}
+
+		if (!PrepareStream(ChunkIndex * EntryHandleChunkBytes))
+		{
+			return nullptr;
+		}
+
+		FChunk* Target = nullptr;
+		if (Chunks.Num() < EntryHandleMaxCachedChunks)
+		{
+			Target = &Chunks.AddDefaulted_GetRef();
+		}
+		else
+		{
+			Target = &Chunks[0];
+			for (FChunk& Chunk : Chunks)
+			{
+				Target = Chunk.LastUse < Target->LastUse ? &Chunk : Target;
+			}
+		}
+		Target->Index = -1;
+
+		while (OutputPosition < ChunkIndex * EntryHandleChunkBytes)
+		{
+			if (!InflateNextChunk(SkippedChunk))
+			{
+				return nullptr;
+			}
+		}
+		if (!InflateNextChunk(Target->Data))
+		{
+			return nullptr;
+		}
+		Target->Index = ChunkIndex;
+		Target->LastUse = ++UseCount;
+		return &Target->Data;
+	}
+
+	bool FEntryFileHandle::PrepareStream(int64 ChunkStart)
+	{
+		const FCheckpoint* Closest = nullptr;
+		for (const TUniquePtr<FCheckpoint>& Checkpoint : Checkpoints)
+		{
+			if (Checkpoint->OutputPosition > ChunkStart)
+			{
+				break;
+			}
+			Closest = Checkpoint.Get();
+		}
+		if (bStreamActive && OutputPosition <= ChunkStart && (Closest == nullptr || Closest->OutputPosition <= OutputPosition))
+		{
+			return true;
+		}
+
+		EndStream();
+		FMemory::Memzero(Stream);
+		if ((Closest != nullptr ? inflateCopy(&Stream, const_cast<z_streamp>(&Closest->State)) : inflateInit2(&Stream, -MAX_WBITS)) != Z_OK)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to start inflating entry %s"), *Entry.Name);
+			return false;
+		}
+		bStreamActive = true;
+		Stream.next_in = nullptr;
+		Stream.avail_in = 0;
+		OutputPosition = Closest != nullptr ? Closest->OutputPosition : 0;
+		InputPosition = Closest != nullptr ? Closest->InputPosition : 0;
+		Crc = Closest != nullptr ? Closest->Crc : 0;
+		return true;
+	}
+
+	bool FEntryFileHandle::InflateNextChunk(TArray<uint8>& Data)
+	{
+		LIBZIP_TRACE_SCOPE(LibzipArchiver_Inflate);
+		LIBZIP_TRACE_NAME_SCOPE(*Entry.Name);
+		if (OutputPosition > 0 && OutputPosition % CheckpointInterval == 0
+			&& (Checkpoints.Num() == 0 || Checkpoints.Last()->OutputPosition < OutputPosition))
+		{
+			TUniquePtr<FCheckpoint> Checkpoint = MakeUnique<FCheckpoint>();
+			FMemory::Memzero(Checkpoint->State);
+			if (inflateCopy(&Checkpoint->State, &Stream) == Z_OK)
+			{
+				Checkpoint->OutputPosition = OutputPosition;
+				// Input that is buffered but not inflated yet is read again after restoring the copy.
+				Checkpoint->InputPosition = InputPosition - Stream.avail_in;
+				Checkpoint->Crc = Crc;
+				Checkpoints.Add(MoveTemp(Checkpoint));
+			}
+		}
+
+		const int32 ChunkBytes = static_cast<int32>(FMath::Min(EntryHandleChunkBytes, Entry.Size - OutputPosition));
+		Data.SetNumUninitialized(ChunkBytes, false);
+		Stream.next_out = Data.GetData();
+		Stream.avail_out = ChunkBytes;
+		while (Stream.avail_out > 0)
+		{
+			if (Stream.avail_in == 0)
+			{
+				const int32 InputBytes = static_cast<int32>(FMath::Min(EntryHandleInputBytes, Entry.CompressedSize - InputPosition));
+				if (InputBytes <= 0 || !File->Seek(DataOffset + InputPosition) || !File->Read(Input.GetData(), InputBytes))
+				{
+					UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read entry %s"), *Entry.Name);
+					EndStream();
+					return false;
+				}
+				TRACE_COUNTER_ADD(LibzipArchiver_BytesRead, InputBytes);
+				InputPosition += InputBytes;
+				Stream.next_in = Input.GetData();
+				Stream.avail_in = InputBytes;
+			}
+			const int Result = inflate(&Stream, Z_NO_FLUSH);
+			if (Result == Z_STREAM_END ? Stream.avail_out > 0 : Result != Z_OK)
+			{
+				UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to decompress entry %s"), *Entry.Name);
+				EndStream();
+				return false;
+			}
+		}
+
+		TRACE_COUNTER_ADD(LibzipArchiver_BytesInflated, ChunkBytes);
+		OutputPosition += ChunkBytes;
+		Crc = FCrc::MemCrc32(Data.GetData(), ChunkBytes, Crc);
+		if (OutputPosition == Entry.Size && Crc != Entry.Crc)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("CRC mismatch of entry %s"), *Entry.Name);
+			EndStream();
+			return false;
+		}
+		return true;
+	}
+
+	void FEntryFileHandle::EndStream()
+	{
+		if (bStreamActive)
+		{
+			inflateEnd(&Stream);
+			bStreamActive = false;
+		}
+	}
+}
+
+IFileHandle* FLibzipEntryFileHandle::Open(IPlatformFile& LowerLevel, const TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe>& Pool, int64 Index)
+{
+	return FEntryFileHandle::Open(LowerLevel, Pool, Index);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FLibzipReaderPool;
+class IFileHandle;
+class IPlatformFile;
+
+/**
+ * Read-only file handles of single entries.
+ * Stored entries are read from the archive directly. Large deflate entries are inflated in chunks when they are read,
+ * keeping the last chunks and, every few megabytes, a copy of the inflate state, so that seeking back only inflates
+ * from the closest copy instead of from the start of the entry. Other entries are decoded completely when they are opened.
+ */
+struct FLibzipEntryFileHandle
+{
+	/** Opens the archive through LowerLevel. Returns null on failure. */
+	static IFileHandle* Open(IPlatformFile& LowerLevel, const TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe>& Pool, int64 Index);
+};
@@ -0,0 +1,406 @@
+#include "LibzipExtractionPipeline.h"
+#include "LibzipArchiverLog.h"
+#include "LibzipArchiverStats.h"
+#include "LibzipArchiverTrace.h"
+#include "LibzipBatchedWriter.h"
+#include "LibzipBoundedQueue.h"
+#include "LibzipEntryFileHandle.h"
+#include "LibzipReaderPool.h"
+#include "Async/Async.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/Paths.h"
+#include <atomic>
+
+namespace
+{
+	/** Size of one read of the reading stage. Larger entries are read on their own. */
+	constexpr int64 PipelineReadBytes = 8 * 1024 * 1024;
+
+	/** Entries above this are not read by the reading stage. A decoding worker copies them to their file in chunks instead. */
+	constexpr int64 PipelineMaxEntryBytes = 64 * 1024 * 1024;
+
+	/** Size of the chunks in which large entries are copied. */
+	constexpr int64 PipelineCopyChunkBytes = 4 * 1024 * 1024;
+
+	/** Blocks read but not yet decoded, which bounds the memory taken by compressed data. */
+	constexpr int32 PipelineMaxBlocks = 8;
+
+	/** Decoded entries not yet handed to the writer, which bounds the memory taken by uncompressed data. It fits any entry of the queues. */
+	constexpr int64 PipelineMaxDecodedBytes = 256 * 1024 * 1024;
+
+	constexpr uint32 PipelineQueueCapacity = 256;
+
+	/** Space a local header can take beyond its fixed part, for the last entry whose end is not given by a following header. */
+	constexpr int64 LocalHeaderMaxVariableBytes = 2 * 0xFFFF;
+
+	struct FPipelineBlock
+	{
+		int64 Offset = 0;
+		TArray64<uint8> Data;
+		std::atomic<int32>* BlocksInFlight = nullptr;
+
+		~FPipelineBlock()
+		{
+			BlocksInFlight->fetch_sub(1, std::memory_order_release);
+		}
+	};
+
+	struct FDecodeItem
+	{
+		int64 Index = -1;
+		/** Null for entries the worker reads itself. */
+		TSharedPtr<FPipelineBlock, ESPMode::ThreadSafe> Block;
+	};
+
+	struct FWriteItem
+	{
+		int64 Index = -1;
+		TArray64<uint8> Data;
+	};
+
+	/** Queue depth sampled on every push. */
+	struct FQueueDepth
+	{
+		std::atomic<int64> Sum{ 0 };
+		std::atomic<int64> Samples{ 0 };
+		std::atomic<int32> Max{ 0 };
+
+		void Sample(int32 Depth)
+		{
+			Sum.fetch_add(Depth, std::memory_order_relaxed);
+			Samples.fetch_add(1, std::memory_order_relaxed);
+			int32 Previous = Max.load(std::memory_order_relaxed);
+			while (Depth > Previous && !Max.compare_exchange_weak(Previous, Depth, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		float Average() const
+		{
+			const int64 Count = Samples.load();
+			return Count > 0 ? static_cast<float>(static_cast<double>(Sum.load()) / Count) : 0.0f;
+		}
+	};
+
+	/** Spins briefly before sleeping, since the other stages usually catch up within microseconds. */
+	void WaitForPipeline(int32& Spins)
+	{
+		if (++Spins < 64)
+		{
+			FPlatformProcess::Yield();
+		}
+		else
+		{
+			FPlatformProcess::SleepNoStats(0.0002f);
+		}
+	}
+
+	template <typename T>
+	void PushToPipeline(TLibzipBoundedQueue<T>& Queue, T& Item, FQueueDepth& Depth)
+	{
+		for (int32 Spins = 0; !Queue.TryPush(Item);)
+		{
+			WaitForPipeline(Spins);
+		}
+		Depth.Sample(Queue.Num());
+	}
+
+	bool IsReadByPipeline(const FLibzipReaderPool::FEntry& Entry)
+	{
+		return Entry.bDirect && Entry.Size <= PipelineMaxEntryBytes && Entry.CompressedSize <= PipelineMaxEntryBytes;
+	}
+
+	/** Copies a large entry to FilePath through an entry file handle, so that only one chunk of it is held in memory. */
+	bool CopyEntryToFile(const TSharedRef<FLibzipReaderPool, ESPMode::ThreadSafe>& Pool, int64 Index, const FString& FilePath, ELibzipWriteDurability Durability)
+	{
+		LIBZIP_TRACE_SCOPE(LibzipArchiver_WriteEntry);
+		const FLibzipReaderPool::FEntry& Entry = Pool->GetEntry(Index);
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		TUniquePtr<IFileHandle> Source(FLibzipEntryFileHandle::Open(PlatformFile, Pool, Index));
+		if (!Source.IsValid())
+		{
+			return false;
+		}
+
+		PlatformFile.CreateDirectoryTree(*FPaths::GetPath(FilePath));
+		TUniquePtr<IFileHandle> Target(PlatformFile.OpenWrite(*FilePath));
+		bool bWritten = Target.IsValid();
+		// The handle checks the CRC of the entries it inflates or decodes completely, but not of stored entries it reads directly.
+		const bool bCheckCrc = Entry.bDirect && Entry.bStored;
+		uint32 Crc = 0;
+		TArray<uint8> Buffer;
+		Buffer.SetNumUninitialized(static_cast<int32>(FMath::Min(Entry.Size, PipelineCopyChunkBytes)));
+		for (int64 Offset = 0; bWritten && Offset < Entry.Size; Offset += Buffer.Num())
+		{
+			const int32 ChunkBytes = static_cast<int32>(FMath::Min<int64>(Buffer.Num(), Entry.Size - Offset));
+			bWritten = Source->Read(Buffer.GetData(), ChunkBytes) && Target->Write(Buffer.GetData(), ChunkBytes);
+			if (bCheckCrc)
+			{
+				Crc = FCrc::MemCrc32(Buffer.GetData(), ChunkBytes, Crc);
+			}
+		}
+		if (bWritten && bCheckCrc && Crc != Entry.Crc)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("CRC mismatch of entry %s"), *Entry.Name);
+			bWritten = false;
+		}
+		bWritten = bWritten && (Durability == ELibzipWriteDurability::None || Target->Flush(true));
+		Target.Reset();
+
+		if (!bWritten)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to write file %s"), *FilePath);
+			PlatformFile.DeleteFile(*FilePath);
+		}
+		return bWritten;
+	}
+}
+
+bool FLibzipExtractionPipeline::Run(const TSharedRef<FLibzipReaderPool, ESPMode::ThreadSafe>& Pool, const FString& BaseDir, int32 DecodeWorkers,
+	ELibzipWriteDurability Durability, FLibzipPipelineStats& Stats, FLibzipStatsCollector* Collector)
+{
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_ExtractPipelined);
+	LIBZIP_TRACE_NAME_SCOPE(*Pool->GetArchivePath());
+	const double StartTime = FPlatformTime::Seconds();
+	TUniquePtr<IFileHandle> File(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*Pool->GetArchivePath()));
+	if (!File.IsValid())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to open archive %s"), *Pool->GetArchivePath());
+		return false;
+	}
+	const int64 FileSize = File->Size();
+	const TArray<zip_uint64_t> Order = Pool->GetIndicesInOffsetOrder();
+	if (DecodeWorkers <= 0)
+	{
+		DecodeWorkers = FMath::Max(FPlatformMisc::NumberOfCoresIncludingHyperthreads() - 2, 1);
+	}
+
+	TLibzipBoundedQueue<FDecodeItem> DecodeQueue(PipelineQueueCapacity);
+	TLibzipBoundedQueue<FWriteItem> WriteQueue(PipelineQueueCapacity);
+	FQueueDepth DecodeDepth;
+	FQueueDepth WriteDepth;
+	std::atomic<int32> BlocksInFlight{ 0 };
+	std::atomic<int64> DecodedBytes{ 0 };
+	std::atomic<int64> BytesRead{ 0 };
+	std::atomic<int64> BytesWritten{ 0 };
+	std::atomic<bool> bReadDone{ false };
+	std::atomic<int32> ActiveWorkers{ DecodeWorkers };
+	std::atomic<bool> bSucceeded{ true };
+
+	TFuture<void> Reader = Async(EAsyncExecution::Thread, [&]() {
+		FLibzipStatsCollector::FThreadCpuScope CpuScope(Collector);
+		for (int32 Position = 0; Position < Order.Num();)
+		{
+			FDecodeItem Item;
+			Item.Index = Order[Position];
+			const FLibzipReaderPool::FEntry& First = Pool->GetEntry(Item.Index);
+			if (!IsReadByPipeline(First))
+			{
+				PushToPipeline(DecodeQueue, Item, DecodeDepth);
+				++Position;
+				continue;
+			}
+
+			// Neighbouring entries are read together, each spanning from its local header to the next one.
+			const int64 BlockBegin = First.LocalHeaderOffset;
+			int64 BlockEnd = BlockBegin;
+			int32 BlockEntries = 0;
+			while (Position + BlockEntries < Order.Num())
+			{
+				const FLibzipReaderPool::FEntry& Entry = Pool->GetEntry(Order[Position + BlockEntries]);
+				if (!IsReadByPipeline(Entry))
+				{
+					break;
+				}
+				const int64 EntryEnd = Position + BlockEntries + 1 < Order.Num() ? Pool->GetEntry(Order[Position + BlockEntries + 1]).LocalHeaderOffset
+					: FMath::Min(FileSize, Entry.LocalHeaderOffset + FLibzipReaderPool::LocalHeaderSize + LocalHeaderMaxVariableBytes + Entry.CompressedSize);
+				if (BlockEntries > 0 && EntryEnd - BlockBegin > PipelineReadBytes)
+				{
+					break;
+				}
+				BlockEnd = EntryEnd;
+				++BlockEntries;
+			}
+
+			for (int32 Spins = 0; BlocksInFlight.load(std::memory_order_acquire) >= PipelineMaxBlocks;)
+			{
+				WaitForPipeline(Spins);
+			}
+			BlocksInFlight.fetch_add(1, std::memory_order_relaxed);
+			TSharedPtr<FPipelineBlock, ESPMode::ThreadSafe> Block = MakeShared<FPipelineBlock, ESPMode::ThreadSafe>();
+			Block->BlocksInFlight = &BlocksInFlight;
+			Block->Offset = BlockBegin;
+			Block->Data.SetNumUninitialized(BlockEnd - BlockBegin);
+			LIBZIP_TRACE_SCOPE(LibzipArchiver_ReadBlock);
+			if (!File->Seek(BlockBegin) || !File->Read(Block->Data.GetData(), Block->Data.Num()))
+			{
+				UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read archive %s at %lld"), *Pool->GetArchivePath(), BlockBegin);
+				bSucceeded = false;
+				break;
+			}
+			BytesRead.fetch_add(Block->Data.Num(), std::memory_order_relaxed);
+			TRACE_COUNTER_ADD(LibzipArchiver_BytesRead, Block->Data.Num());
+
+			for (int32 Entry = 0; Entry < BlockEntries; ++Entry, ++Position)
+			{
+				FDecodeItem BlockItem;
+				BlockItem.Index = Order[Position];
+				BlockItem.Block = Block;
+				PushToPipeline(DecodeQueue, BlockItem, DecodeDepth);
+			}
+		}
+		bReadDone.store(true, std::memory_order_release);
+	});
+
+	TArray<TFuture<void>> Workers;
+	for (int32 Worker = 0; Worker < DecodeWorkers; ++Worker)
+	{
+		// Dedicated threads, since waiting on the other stages would hold up tasks of the shared thread pool such as CloseArchiveAsync.
+		Workers.Add(Async(EAsyncExecution::Thread, [&]() {
+			FLibzipStatsCollector::FThreadCpuScope CpuScope(Collector);
+			FDecodeItem Item;
+			for (int32 Spins = 0;;)
+			{
+				const bool bDone = bReadDone.load(std::memory_order_acquire);
+				if (!DecodeQueue.TryPop(Item))
+				{
+					if (bDone)
+					{
+						break;
+					}
+					WaitForPipeline(Spins);
+					continue;
+				}
+				Spins = 0;
+
+				const FLibzipReaderPool::FEntry& Entry = Pool->GetEntry(Item.Index);
+				FLibzipTraceEntryInFlight InFlight;
+				FLibzipStatsCollector::FEntryTimer EntryTimer(Collector);
+				// Queued copies of large entries could take any amount of memory, so they are written here instead.
+				if (!Item.Block.IsValid() && Entry.Size > PipelineMaxEntryBytes)
+				{
+					if (!CopyEntryToFile(Pool, Item.Index, FPaths::Combine(BaseDir, Entry.Name), Durability))
+					{
+						bSucceeded = false;
+						continue;
+					}
+					EntryTimer.FinishRead(Entry.CompressedSize, Entry.Size);
+					BytesWritten.fetch_add(Entry.Size, std::memory_order_relaxed);
+					continue;
+				}
+
+				for (int32 WaitSpins = 0;;)
+				{
+					int64 Decoded = DecodedBytes.load(std::memory_order_acquire);
+					if (Decoded + Entry.Size <= PipelineMaxDecodedBytes
+						&& DecodedBytes.compare_exchange_weak(Decoded, Decoded + Entry.Size, std::memory_order_acq_rel))
+					{
+						break;
+					}
+					WaitForPipeline(WaitSpins);
+				}
+
+				FWriteItem Output;
+				Output.Index = Item.Index;
+				bool bDecoded;
+				if (Item.Block.IsValid())
+				{
+					const FPipelineBlock& Block = *Item.Block;
+					const int64 DataOffset = FLibzipReaderPool::GetDataOffset(Block.Data.GetData() + (Entry.LocalHeaderOffset - Block.Offset), Entry.LocalHeaderOffset);
+					bDecoded = DataOffset >= 0 && DataOffset + Entry.CompressedSize <= Block.Offset + Block.Data.Num();
+					if (!bDecoded)
+					{
+						UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read local header of %s"), *Entry.Name);
+					}
+					else
+					{
+						Output.Data.SetNumUninitialized(Entry.Size);
+						bDecoded = FLibzipReaderPool::Decode(Entry, Block.Data.GetData() + (DataOffset - Block.Offset), Output.Data.GetData());
+					}
+					Item.Block.Reset();
+				}
+				else
+				{
+					FString Name;
+					bool bCacheHit = false;
+					bDecoded = Pool->Read(Item.Index, Name, [&Output](int64 Size) {
+						Output.Data.SetNumUninitialized(Size);
+						return Output.Data.GetData();
+					}, [](const FString&) {}, &bCacheHit);
+					if (bCacheHit && Collector != nullptr)
+					{
+						Collector->AddCacheHit();
+					}
+				}
+
+				if (!bDecoded)
+				{
+					DecodedBytes.fetch_sub(Entry.Size, std::memory_order_release);
+					bSucceeded = false;
+					continue;
+				}
+				EntryTimer.FinishRead(Entry.CompressedSize, Entry.Size);
+				PushToPipeline(WriteQueue, Output, WriteDepth);
+			}
+			ActiveWorkers.fetch_sub(1, std::memory_order_release);
+		}));
+	}
+
+	TFuture<void> Writer = Async(EAsyncExecution::Thread, [&]() {
+		FLibzipStatsCollector::FThreadCpuScope CpuScope(Collector);
+		FLibzipBatchedWriter BatchedWriter(Durability);
+		FWriteItem Item;
+		for (int32 Spins = 0;;)
+		{
+			const bool bDone = ActiveWorkers.load(std::memory_order_acquire) == 0;
+			if (!WriteQueue.TryPop(Item))
+			{
+				if (bDone)
+				{
+					break;
+				}
+				WaitForPipeline(Spins);
+				continue;
+			}
+			Spins = 0;
+
+			const FLibzipReaderPool::FEntry& Entry = Pool->GetEntry(Item.Index);
+			const FString Path = FPaths::Combine(BaseDir, Entry.Name);
+			if (Path.EndsWith(TEXT("/")))
+			{
+				FPlatformFileManager::Get().GetPlatformFile().CreateDirectoryTree(*Path);
+			}
+			else
+			{
+				BytesWritten.fetch_add(Item.Data.Num(), std::memory_order_relaxed);
+				if (!BatchedWriter.Add(Path, MoveTemp(Item.Data)))
+				{
+					bSucceeded = false;
+				}
+			}
+			// The batched writer holds up to one batch beyond this budget.
+			DecodedBytes.fetch_sub(Entry.Size, std::memory_order_release);
+		}
+		if (!BatchedWriter.Flush())
+		{
+			bSucceeded = false;
+		}
+	});
+
+	Reader.Wait();
+	for (TFuture<void>& Worker : Workers)
+	{
+		Worker.Wait();
+	}
+	Writer.Wait();
+
+	Stats.Entries = Order.Num();
+	Stats.CompressedBytesRead = BytesRead.load();
+	Stats.BytesWritten = BytesWritten.load();
+	Stats.AverageDecodeQueueDepth = DecodeDepth.Average();
+	Stats.MaxDecodeQueueDepth = DecodeDepth.Max.load();
+	Stats.AverageWriteQueueDepth = WriteDepth.Average();
+	Stats.MaxWriteQueueDepth = WriteDepth.Max.load();
+	Stats.Seconds = static_cast<float>(FPlatformTime::Seconds() - StartTime);
+	return bSucceeded.load();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LibzipArchiver.h"
+
+class FLibzipReaderPool;
+class FLibzipStatsCollector;
+
+/**
+ * Extracts all entries of an archive in three stages connected by bounded lock-free queues.
+ * One thread reads the compressed data with large sequential reads in archive order, a set of workers decodes and checks the entries,
+ * and one thread writes the files in batches, so that the disk and the CPUs are kept busy at the same time.
+ * Entries over 64 MiB are copied to their file by a worker in chunks, so the queues never hold them whole,
+ * and the workers wait while 256 MiB of decoded entries are waiting to be written.
+ */
+struct FLibzipExtractionPipeline
+{
+	/**
+	 * DecodeWorkers of 0 uses all cores but the two taken by the reading and writing threads. Every stage runs on its own threads.
+	 * Collector, if set, receives the entries and the CPU time of all stages.
+	 */
+	static bool Run(const TSharedRef<FLibzipReaderPool, ESPMode::ThreadSafe>& Pool, const FString& BaseDir, int32 DecodeWorkers,
+		ELibzipWriteDurability Durability, FLibzipPipelineStats& Stats, FLibzipStatsCollector* Collector = nullptr);
+};
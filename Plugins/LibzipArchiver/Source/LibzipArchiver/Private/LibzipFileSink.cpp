@@ -0,0 +1,156 @@
+#include "LibzipFileSink.h"
+#include "LibzipArchiverTrace.h"
+#include "HAL/PlatformFilemanager.h"
+
+namespace
+{
+	struct FFileSinkData
+	{
+		FString Path;
+		TUniquePtr<IFileHandle> Handle;
+		zip_error_t Error;
+	};
+
+	zip_int64_t FileSinkCallback(void* UserData, void* Data, zip_uint64_t Length, zip_source_cmd_t Command)
+	{
+		FFileSinkData* Sink = static_cast<FFileSinkData*>(UserData);
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		switch (Command)
+		{
+		// There is never anything to read, as the archive is new.
+		case ZIP_SOURCE_OPEN:
+		case ZIP_SOURCE_CLOSE:
+		case ZIP_SOURCE_READ:
+		case ZIP_SOURCE_SEEK:
+		case ZIP_SOURCE_TELL:
+			return 0;
+
+		case ZIP_SOURCE_STAT:
+		{
+			zip_stat_t* Stat = ZIP_SOURCE_GET_ARGS(zip_stat_t, Data, Length, &Sink->Error);
+			if (Stat == NULL)
+			{
+				return -1;
+			}
+			// An existing file makes libzip refuse to open with ZIP_EXCL.
+			const FFileStatData StatData = PlatformFile.GetStatData(*Sink->Path);
+			if (!StatData.bIsValid)
+			{
+				zip_error_set(&Sink->Error, ZIP_ER_NOENT, 0);
+				return -1;
+			}
+			zip_stat_init(Stat);
+			Stat->valid = ZIP_STAT_SIZE | ZIP_STAT_MTIME;
+			Stat->size = StatData.FileSize;
+			Stat->mtime = StatData.ModificationTime.ToUnixTimestamp();
+			return sizeof(zip_stat_t);
+		}
+
+		case ZIP_SOURCE_BEGIN_WRITE:
+			if (PlatformFile.FileExists(*Sink->Path))
+			{
+				zip_error_set(&Sink->Error, ZIP_ER_EXISTS, 0);
+				return -1;
+			}
+			Sink->Handle.Reset(PlatformFile.OpenWrite(*Sink->Path, false, true));
+			if (!Sink->Handle.IsValid())
+			{
+				zip_error_set(&Sink->Error, ZIP_ER_OPEN, 0);
+				return -1;
+			}
+			return 0;
+
+		case ZIP_SOURCE_WRITE:
+			if (!Sink->Handle.IsValid() || !Sink->Handle->Write(static_cast<const uint8*>(Data), Length))
+			{
+				zip_error_set(&Sink->Error, ZIP_ER_WRITE, 0);
+				return -1;
+			}
+			TRACE_COUNTER_ADD(LibzipArchiver_BytesWritten, Length);
+			return Length;
+
+		case ZIP_SOURCE_SEEK_WRITE:
+		{
+			zip_source_args_seek_t* Args = ZIP_SOURCE_GET_ARGS(zip_source_args_seek_t, Data, Length, &Sink->Error);
+			if (Args == NULL || !Sink->Handle.IsValid())
+			{
+				return -1;
+			}
+			const int64 Base = Args->whence == SEEK_CUR ? Sink->Handle->Tell() : Args->whence == SEEK_END ? Sink->Handle->Size() : 0;
+			if (Base + Args->offset < 0 || !Sink->Handle->Seek(Base + Args->offset))
+			{
+				zip_error_set(&Sink->Error, ZIP_ER_SEEK, 0);
+				return -1;
+			}
+			return 0;
+		}
+
+		case ZIP_SOURCE_TELL_WRITE:
+			return Sink->Handle.IsValid() ? Sink->Handle->Tell() : 0;
+
+		case ZIP_SOURCE_COMMIT_WRITE:
+		{
+			const bool bFlushed = Sink->Handle.IsValid() && Sink->Handle->Flush();
+			Sink->Handle.Reset();
+			if (!bFlushed)
+			{
+				zip_error_set(&Sink->Error, ZIP_ER_WRITE, 0);
+				return -1;
+			}
+			return 0;
+		}
+
+		case ZIP_SOURCE_ROLLBACK_WRITE:
+			// Never leave a partial archive behind.
+			Sink->Handle.Reset();
+			PlatformFile.DeleteFile(*Sink->Path);
+			return 0;
+
+		case ZIP_SOURCE_REMOVE:
+			// libzip removes the archive instead of writing one without entries.
+			Sink->Handle.Reset();
+			if (PlatformFile.FileExists(*Sink->Path) && !PlatformFile.DeleteFile(*Sink->Path))
+			{
+				zip_error_set(&Sink->Error, ZIP_ER_REMOVE, 0);
+				return -1;
+			}
+			return 0;
+
+		case ZIP_SOURCE_ERROR:
+			return zip_error_to_data(&Sink->Error, Data, Length);
+
+		case ZIP_SOURCE_FREE:
+			if (Sink->Handle.IsValid())
+			{
+				Sink->Handle.Reset();
+				PlatformFile.DeleteFile(*Sink->Path);
+			}
+			zip_error_fini(&Sink->Error);
+			delete Sink;
+			return 0;
+
+		case ZIP_SOURCE_SUPPORTS:
+			return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE,
+				ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_BEGIN_WRITE, ZIP_SOURCE_COMMIT_WRITE, ZIP_SOURCE_ROLLBACK_WRITE, ZIP_SOURCE_WRITE,
+				ZIP_SOURCE_SEEK_WRITE, ZIP_SOURCE_TELL_WRITE, ZIP_SOURCE_REMOVE, ZIP_SOURCE_SUPPORTS, -1);
+
+		default:
+			zip_error_set(&Sink->Error, ZIP_ER_OPNOTSUPP, 0);
+			return -1;
+		}
+	}
+}
+
+zip_source_t* FLibzipFileSink::Create(const FString& Path, zip_error_t* Error)
+{
+	FFileSinkData* SinkData = new FFileSinkData;
+	SinkData->Path = Path;
+	zip_error_init(&SinkData->Error);
+	zip_source_t* Source = zip_source_function_create(&FileSinkCallback, SinkData, Error);
+	if (Source == NULL)
+	{
+		zip_error_fini(&SinkData->Error);
+		delete SinkData;
+	}
+	return Source;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "zip.h"
+
+/**
+ * libzip source for creating a new archive directly at its final path.
+ * libzip's file source writes a temporary file next to the archive and renames it on commit; this one writes through a
+ * platform file handle in place, and deletes the file when libzip rolls the write back.
+ */
+struct FLibzipFileSink
+{
+	static zip_source_t* Create(const FString& Path, zip_error_t* Error);
+};
@@ -0,0 +1,114 @@
+#include "LibzipMemorySink.h"
+
+namespace
+{
+	struct FMemorySinkData
+	{
+		TSharedRef<TArray64<uint8>, ESPMode::ThreadSafe> Buffer;
+		int64 Position = 0;
+		zip_error_t Error;
+
+		explicit FMemorySinkData(const TSharedRef<TArray64<uint8>, ESPMode::ThreadSafe>& InBuffer)
+			: Buffer(InBuffer)
+		{
+		}
+	};
+
+	/** Makes Buffer at least Size long. Capacity is doubled rather than grown by TArray's default slack so that large archives are copied only a few times. */
+	void GrowMemorySink(TArray64<uint8>& Buffer, int64 Size)
+	{
+		if (Size > Buffer.Max())
+		{
+			Buffer.Reserve(FMath::Max(Size, 2 * Buffer.Max()));
+		}
+		if (Size > Buffer.Num())
+		{
+			Buffer.AddUninitialized(Size - Buffer.Num());
+		}
+	}
+
+	zip_int64_t MemorySinkCallback(void* UserData, void* Data, zip_uint64_t Length, zip_source_cmd_t Command)
+	{
+		FMemorySinkData* Sink = static_cast<FMemorySinkData*>(UserData);
+		TArray64<uint8>& Buffer = Sink->Buffer.Get();
+		switch (Command)
+		{
+		// There is never anything to read, as the archive is new.
+		case ZIP_SOURCE_OPEN:
+		case ZIP_SOURCE_CLOSE:
+		case ZIP_SOURCE_READ:
+		case ZIP_SOURCE_SEEK:
+		case ZIP_SOURCE_TELL:
+			return 0;
+
+		case ZIP_SOURCE_STAT:
+			zip_error_set(&Sink->Error, ZIP_ER_NOENT, 0);
+			return -1;
+
+		case ZIP_SOURCE_BEGIN_WRITE:
+			// Keeps the reserved capacity.
+			Buffer.Reset();
+			Sink->Position = 0;
+			return 0;
+
+		case ZIP_SOURCE_WRITE:
+			GrowMemorySink(Buffer, Sink->Position + Length);
+			FMemory::Memcpy(Buffer.GetData() + Sink->Position, Data, Length);
+			Sink->Position += Length;
+			return Length;
+
+		case ZIP_SOURCE_SEEK_WRITE:
+		{
+			zip_int64_t Position = zip_source_seek_compute_offset(Sink->Position, Buffer.Num(), Data, Length, &Sink->Error);
+			if (Position < 0)
+			{
+				return -1;
+			}
+			Sink->Position = Position;
+			return 0;
+		}
+
+		case ZIP_SOURCE_TELL_WRITE:
+			return Sink->Position;
+
+		case ZIP_SOURCE_COMMIT_WRITE:
+			return 0;
+
+		case ZIP_SOURCE_ROLLBACK_WRITE:
+		case ZIP_SOURCE_REMOVE:
+			Buffer.Empty();
+			Sink->Position = 0;
+			return 0;
+
+		case ZIP_SOURCE_ERROR:
+			return zip_error_to_data(&Sink->Error, Data, Length);
+
+		case ZIP_SOURCE_FREE:
+			zip_error_fini(&Sink->Error);
+			delete Sink;
+			return 0;
+
+		case ZIP_SOURCE_SUPPORTS:
+			return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE,
+				ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_BEGIN_WRITE, ZIP_SOURCE_COMMIT_WRITE, ZIP_SOURCE_ROLLBACK_WRITE, ZIP_SOURCE_WRITE,
+				ZIP_SOURCE_SEEK_WRITE, ZIP_SOURCE_TELL_WRITE, ZIP_SOURCE_REMOVE, ZIP_SOURCE_SUPPORTS, -1);
+
+		default:
+			zip_error_set(&Sink->Error, ZIP_ER_OPNOTSUPP, 0);
+			return -1;
+		}
+	}
+}
+
+zip_source_t* FLibzipMemorySink::Create(const TSharedRef<TArray64<uint8>, ESPMode::ThreadSafe>& Buffer, zip_error_t* Error)
+{
+	FMemorySinkData* SinkData = new FMemorySinkData(Buffer);
+	zip_error_init(&SinkData->Error);
+	zip_source_t* Source = zip_source_function_create(&MemorySinkCallback, SinkData, Error);
+	if (Source == NULL)
+	{
+		zip_error_fini(&SinkData->Error);
+		delete SinkData;
+	}
+	return Source;
+}
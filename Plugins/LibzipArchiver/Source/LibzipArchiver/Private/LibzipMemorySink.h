@@ -0,0 +1,14 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "zip.h"
+
+/**
+ * libzip source for creating a new archive in memory.
+ * The archive is written straight into Buffer, which grows geometrically, so that it can be moved out without a copy once the archive is closed.
+ * Buffer is emptied when libzip rolls the write back or the archive has no entries.
+ */
+struct FLibzipMemorySink
+{
+	static zip_source_t* Create(const TSharedRef<TArray64<uint8>, ESPMode::ThreadSafe>& Buffer, zip_error_t* Error);
+};
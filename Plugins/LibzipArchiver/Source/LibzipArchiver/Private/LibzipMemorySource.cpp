@@ -0,0 +1,86 @@
+#include "LibzipMemorySource.h"
+
+namespace
+{
+	struct FMemorySourceData
+	{
+		TArray64<uint8> Data;
+		int64 ReadPos = 0;
+		time_t ModificationTime = 0;
+		zip_error_t Error;
+	};
+
+	zip_int64_t MemorySourceCallback(void* UserData, void* Data, zip_uint64_t Length, zip_source_cmd_t Command)
+	{
+		FMemorySourceData* Source = static_cast<FMemorySourceData*>(UserData);
+		switch (Command)
+		{
+		case ZIP_SOURCE_OPEN:
+			Source->ReadPos = 0;
+			return 0;
+
+		case ZIP_SOURCE_READ:
+		{
+			const int64 ReadByte = FMath::Min<int64>(Length, Source->Data.Num() - Source->ReadPos);
+			FMemory::Memcpy(Data, Source->Data.GetData() + Source->ReadPos, ReadByte);
+			Source->ReadPos += ReadByte;
+			return ReadByte;
+		}
+
+		case ZIP_SOURCE_CLOSE:
+			return 0;
+
+		case ZIP_SOURCE_STAT:
+		{
+			zip_stat_t* Stat = ZIP_SOURCE_GET_ARGS(zip_stat_t, Data, Length, &Source->Error);
+			if (Stat == NULL)
+			{
+				return -1;
+			}
+			zip_stat_init(Stat);
+			Stat->valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_MTIME;
+			Stat->size = Source->Data.Num();
+			Stat->comp_size = Source->Data.Num();
+			Stat->comp_method = ZIP_CM_STORE;
+			Stat->encryption_method = ZIP_EM_NONE;
+			Stat->mtime = Source->ModificationTime;
+			return sizeof(zip_stat_t);
+		}
+
+		case ZIP_SOURCE_ERROR:
+			return zip_error_to_data(&Source->Error, Data, Length);
+
+		case ZIP_SOURCE_FREE:
+			zip_error_fini(&Source->Error);
+			delete Source;
+			return 0;
+
+		case ZIP_SOURCE_SUPPORTS:
+			return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+
+		default:
+			zip_error_set(&Source->Error, ZIP_ER_OPNOTSUPP, 0);
+			return -1;
+		}
+	}
+
+	zip_source_t* CreateSource(zip_t* Archive, FMemorySourceData* SourceData)
+	{
+		zip_error_init(&SourceData->Error);
+		zip_source_t* Source = zip_source_function(Archive, &MemorySourceCallback, SourceData);
+		if (Source == NULL)
+		{
+			zip_error_fini(&SourceData->Error);
+			delete SourceData;
+		}
+		return Source;
+	}
+}
+
+zip_source_t* FLibzipMemorySource::Create(zip_t* Archive, TArray64<uint8>&& Data, time_t ModificationTime)
+{
+	FMemorySourceData* SourceData = new FMemorySourceData;
+	SourceData->Data = MoveTemp(Data);
+	SourceData->ModificationTime = ModificationTime;
+	return CreateSource(Archive, SourceData);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "zip.h"
+
+/** libzip source serving an entry from memory it owns. */
+struct FLibzipMemorySource
+{
+	/** Source with uncompressed data, which libzip compresses when the archive is closed. */
+	static zip_source_t* Create(zip_t* Archive, TArray64<uint8>&& Data, time_t ModificationTime);
+};
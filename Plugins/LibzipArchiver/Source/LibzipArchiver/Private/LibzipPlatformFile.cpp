@@ -0,0 +1,315 @@
+#include "LibzipPlatformFile.h"
+#include "LibzipArchiveRegistry.h"
+#include "LibzipArchiverLog.h"
+#include "LibzipArchiverTrace.h"
+#include "LibzipEntryFileHandle.h"
+#include "LibzipReaderPool.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeRWLock.h"
+
+bool FLibzipPlatformFile::Initialize(IPlatformFile* Inner, const TCHAR* CmdLine)
+{
+	LowerLevel = Inner;
+	return LowerLevel != nullptr;
+}
+
+bool FLibzipPlatformFile::Mount(const FString& ArchivePath, const FString& MountPoint, const FString& Password)
+{
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_Mount);
+	const FString FullArchivePath = NormalizePath(*ArchivePath);
+	FLibzipArchiveRegistry* Registry = FLibzipArchiveRegistry::Get();
+	TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool = Registry != nullptr
+		? Registry->Acquire(FullArchivePath, Password)
+		: FLibzipReaderPool::Open(FullArchivePath, Password);
+	if (!Pool.IsValid())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to mount %s"), *ArchivePath);
+		return false;
+	}
+
+	FWriteScopeLock Lock(IndexLock);
+	Archives.RemoveAll([&FullArchivePath](const FMountedArchive& Archive) { return Archive.ArchivePath == FullArchivePath; });
+	Archives.Add({ FullArchivePath, NormalizePath(*MountPoint), Pool });
+	RebuildIndex();
+	return true;
+}
+
+bool FLibzipPlatformFile::Unmount(const FString& ArchivePath)
+{
+	const FString FullArchivePath = NormalizePath(*ArchivePath);
+	FWriteScopeLock Lock(IndexLock);
+	if (Archives.RemoveAll([&FullArchivePath](const FMountedArchive& Archive) { return Archive.ArchivePath == FullArchivePath; }) == 0)
+	{
+		return false;
+	}
+	RebuildIndex();
+	return true;
+}
+
+FString FLibzipPlatformFile::NormalizePath(const TCHAR* Path)
+{
+	FString Result = FPaths::ConvertRelativePathToFull(Path);
+	FPaths::NormalizeFilename(Result);
+	while (Result.Len() > 1 && Result.EndsWith(TEXT("/")))
+	{
+		Result.LeftChopInline(1, false);
+	}
+	return Result;
+}
+
+void FLibzipPlatformFile::RebuildIndex()
+{
+	Files.Reset();
+	Directories.Reset();
+	for (const FMountedArchive& Archive : Archives)
+	{
+		Directories.FindOrAdd(Archive.MountPoint);
+		AddToParents(Archive.MountPoint);
+		for (int64 Index = 0; Index < Archive.Pool->Num(); ++Index)
+		{
+			const FString& Name = Archive.Pool->GetEntry(Index).Name;
+			if (Name.EndsWith(TEXT("/")))
+			{
+				const FString Path = NormalizePath(*(Archive.MountPoint / Name));
+				Directories.FindOrAdd(Path);
+				AddToParents(Path);
+			}
+			else
+			{
+				const FString Path = Archive.MountPoint / Name;
+				Files.Add(Path, { Archive.Pool, Index });
+				AddToParents(Path);
+			}
+		}
+	}
+}
+
+void FLibzipPlatformFile::AddToParents(const FString& Path)
+{
+	FString Child = Path;
+	for (FString Parent = FPaths::GetPath(Child); !Parent.IsEmpty() && Parent != Child; Parent = FPaths::GetPath(Child))
+	{
+		bool bAlreadyAdded = false;
+		Directories.FindOrAdd(Parent).Add(Child, &bAlreadyAdded);
+		if (bAlreadyAdded)
+		{
+			break;
+		}
+		Child = MoveTemp(Parent);
+	}
+}
+
+bool FLibzipPlatformFile::FindFile(const TCHAR* Filename, FMountedFile& File)
+{
+	const FString Path = NormalizePath(Filename);
+	FReadScopeLock Lock(IndexLock);
+	if (const FMountedFile* Found = Files.Find(Path))
+	{
+		File = *Found;
+		return true;
+	}
+	return false;
+}
+
+bool FLibzipPlatformFile::IsMountedDirectory(const TCHAR* Directory)
+{
+	const FString Path = NormalizePath(Directory);
+	FReadScopeLock Lock(IndexLock);
+	return Directories.Contains(Path);
+}
+
+FFileStatData FLibzipPlatformFile::GetMountedStatData(const FString& Path)
+{
+	FReadScopeLock Lock(IndexLock);
+	if (const FMountedFile* File = Files.Find(Path))
+	{
+		const FLibzipReaderPool::FEntry& Entry = File->Pool->GetEntry(File->Index);
+		return FFileStatData(Entry.ModificationTime, Entry.ModificationTime, Entry.ModificationTime, Entry.Size, false, true);
+	}
+	if (Directories.Contains(Path))
+	{
+		return FFileStatData(FDateTime::MinValue(), FDateTime::MinValue(), FDateTime::MinValue(), -1, true, true);
+	}
+	return FFileStatData();
+}
+
+bool FLibzipPlatformFile::GetMountedChildren(const TCHAR* Directory, TArray<TPair<FString, bool>>& Children)
+{
+	const FString Path = NormalizePath(Directory);
+	FString Prefix = Directory;
+	if (!Prefix.EndsWith(TEXT("/")) && !Prefix.EndsWith(TEXT("\\")))
+	{
+		Prefix += TEXT("/");
+	}
+
+	FReadScopeLock Lock(IndexLock);
+	const TSet<FString>* MountedChildren = Directories.Find(Path);
+	if (MountedChildren == nullptr)
+	{
+		return false;
+	}
+	Children.Reserve(MountedChildren->Num());
+	for (const FString& Child : *MountedChildren)
+	{
+		Children.Emplace(Prefix + FPaths::GetCleanFilename(Child), Directories.Contains(Child));
+	}
+	return true;
+}
+
+bool FLibzipPlatformFile::FileExists(const TCHAR* Filename)
+{
+	FMountedFile File;
+	return FindFile(Filename, File) || LowerLevel->FileExists(Filename);
+}
+
+int64 FLibzipPlatformFile::FileSize(const TCHAR* Filename)
+{
+	FMountedFile File;
+	return FindFile(Filename, File) ? File.Pool->GetEntry(File.Index).Size : LowerLevel->FileSize(Filename);
+}
+
+bool FLibzipPlatformFile::DeleteFile(const TCHAR* Filename)
+{
+	FMountedFile File;
+	return !FindFile(Filename, File) && LowerLevel->DeleteFile(Filename);
+}
+
+bool FLibzipPlatformFile::IsReadOnly(const TCHAR* Filename)
+{
+	FMountedFile File;
+	return FindFile(Filename, File) || LowerLevel->IsReadOnly(Filename);
+}
+
+bool FLibzipPlatformFile::MoveFile(const TCHAR* To, const TCHAR* From)
+{
+	FMountedFile File;
+	return !FindFile(From, File) && LowerLevel->MoveFile(To, From);
+}
+
+bool FLibzipPlatformFile::SetReadOnly(const TCHAR* Filename, bool bNewReadOnlyValue)
+{
+	FMountedFile File;
+	if (FindFile(Filename, File))
+	{
+		return bNewReadOnlyValue;
+	}
+	return LowerLevel->SetReadOnly(Filename, bNewReadOnlyValue);
+}
+
+FDateTime FLibzipPlatformFile::GetTimeStamp(const TCHAR* Filename)
+{
+	FMountedFile File;
+	return FindFile(Filename, File) ? File.Pool->GetEntry(File.Index).ModificationTime : LowerLevel->GetTimeStamp(Filename);
+}
+
+void FLibzipPlatformFile::SetTimeStamp(const TCHAR* Filename, FDateTime DateTime)
+{
+	FMountedFile File;
+	if (!FindFile(Filename, File))
+	{
+		LowerLevel->SetTimeStamp(Filename, DateTime);
+	}
+}
+
+FDateTime FLibzipPlatformFile::GetAccessTimeStamp(const TCHAR* Filename)
+{
+	FMountedFile File;
+	return FindFile(Filename, File) ? File.Pool->GetEntry(File.Index).ModificationTime : LowerLevel->GetAccessTimeStamp(Filename);
+}
+
+FString FLibzipPlatformFile::GetFilenameOnDisk(const TCHAR* Filename)
+{
+	FMountedFile File;
+	return FindFile(Filename, File) ? FString(Filename) : LowerLevel->GetFilenameOnDisk(Filename);
+}
+
+IFileHandle* FLibzipPlatformFile::OpenRead(const TCHAR* Filename, bool bAllowWrite)
+{
+	FMountedFile File;
+	if (FindFile(Filename, File))
+	{
+		return FLibzipEntryFileHandle::Open(*LowerLevel, File.Pool, File.Index);
+	}
+	return LowerLevel->OpenRead(Filename, bAllowWrite);
+}
+
+IFileHandle* FLibzipPlatformFile::OpenWrite(const TCHAR* Filename, bool bAppend, bool bAllowRead)
+{
+	FMountedFile File;
+	return FindFile(Filename, File) ? nullptr : LowerLevel->OpenWrite(Filename, bAppend, bAllowRead);
+}
+
+bool FLibzipPlatformFile::DirectoryExists(const TCHAR* Directory)
+{
+	return IsMountedDirectory(Directory) || LowerLevel->DirectoryExists(Directory);
+}
+
+bool FLibzipPlatformFile::CreateDirectory(const TCHAR* Directory)
+{
+	return LowerLevel->CreateDirectory(Directory);
+}
+
+bool FLibzipPlatformFile::DeleteDirectory(const TCHAR* Directory)
+{
+	return !IsMountedDirectory(Directory) && LowerLevel->DeleteDirectory(Directory);
+}
+
+FFileStatData FLibzipPlatformFile::GetStatData(const TCHAR* FilenameOrDirectory)
+{
+	const FFileStatData StatData = GetMountedStatData(NormalizePath(FilenameOrDirectory));
+	return StatData.bIsValid ? StatData : LowerLevel->GetStatData(FilenameOrDirectory);
+}
+
+bool FLibzipPlatformFile::IterateDirectory(const TCHAR* Directory, FDirectoryVisitor& Visitor)
+{
+	TArray<TPair<FString, bool>> Children;
+	const bool bMounted = GetMountedChildren(Directory, Children);
+	// Visit without holding the lock, as visitors may call back into the platform file.
+	TSet<FString> Visited;
+	for (const TPair<FString, bool>& Child : Children)
+	{
+		if (!Visitor.Visit(*Child.Key, Child.Value))
+		{
+			return false;
+		}
+		Visited.Add(NormalizePath(*Child.Key));
+	}
+
+	bool bStopped = false;
+	const bool bLowerResult = LowerLevel->IterateDirectory(Directory, [&](const TCHAR* FilenameOrDirectory, bool bIsDirectory) {
+		if (Visited.Num() > 0 && Visited.Contains(NormalizePath(FilenameOrDirectory)))
+		{
+			return true;
+		}
+		bStopped = !Visitor.Visit(FilenameOrDirectory, bIsDirectory);
+		return !bStopped;
+	});
+	return !bStopped && (bLowerResult || bMounted);
+}
+
+bool FLibzipPlatformFile::IterateDirectoryStat(const TCHAR* Directory, FDirectoryStatVisitor& Visitor)
+{
+	TArray<TPair<FString, bool>> Children;
+	const bool bMounted = GetMountedChildren(Directory, Children);
+	TSet<FString> Visited;
+	for (const TPair<FString, bool>& Child : Children)
+	{
+		FString Path = NormalizePath(*Child.Key);
+		if (!Visitor.Visit(*Child.Key, GetMountedStatData(Path)))
+		{
+			return false;
+		}
+		Visited.Add(MoveTemp(Path));
+	}
+
+	bool bStopped = false;
+	const bool bLowerResult = LowerLevel->IterateDirectoryStat(Directory, [&](const TCHAR* FilenameOrDirectory, const FFileStatData& StatData) {
+		if (Visited.Num() > 0 && Visited.Contains(NormalizePath(FilenameOrDirectory)))
+		{
+			return true;
+		}
+		bStopped = !Visitor.Visit(FilenameOrDirectory, StatData);
+		return !bStopped;
+	});
+	return !bStopped && (bLowerResult || bMounted);
+}
@@ -0,0 +1,229 @@
+#include "LibzipPlatformFileSource.h"
+#include "LibzipArchiverTrace.h"
+#include "Async/AsyncFileHandle.h"
+#include "HAL/PlatformFilemanager.h"
+
+namespace
+{
+	constexpr int64 PlatformFileBlockSize = 256 * 1024;
+
+	/** Blocks requested past the current one while reads are sequential. */
+	constexpr int64 PlatformFileReadAheadBlocks = 4;
+	constexpr int32 PlatformFileMaxBlocks = 16;
+
+	typedef TSharedPtr<FLibzipPlatformFileSource, ESPMode::ThreadSafe> FPlatformFileSourcePtr;
+}
+
+TSharedPtr<FLibzipPlatformFileSource, ESPMode::ThreadSafe> FLibzipPlatformFileSource::Open(const FString& Path)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	const FFileStatData StatData = PlatformFile.GetStatData(*Path);
+	if (!StatData.bIsValid || StatData.bIsDirectory)
+	{
+		return nullptr;
+	}
+
+	IAsyncReadFileHandle* Handle = PlatformFile.OpenAsyncRead(*Path);
+	if (Handle == nullptr)
+	{
+		return nullptr;
+	}
+
+	FPlatformFileSourcePtr Source = MakeShareable(new FLibzipPlatformFileSource());
+	Source->Handle.Reset(Handle);
+	Source->FileSize = StatData.FileSize;
+	Source->ModificationTime = StatData.ModificationTime.ToUnixTimestamp();
+	Source->Blocks.Reserve(PlatformFileMaxBlocks);
+	zip_error_init(&Source->Error);
+	return Source;
+}
+
+FLibzipPlatformFileSource::~FLibzipPlatformFileSource()
+{
+	for (FBlock& Block : Blocks)
+	{
+		ReleaseBlock(Block);
+	}
+	// Requests have to be gone before the handle is.
+	Handle.Reset();
+	zip_error_fini(&Error);
+}
+
+zip_source_t* FLibzipPlatformFileSource::CreateSource(zip_error_t* OutError)
+{
+	FPlatformFileSourcePtr* Reference = new FPlatformFileSourcePtr(AsShared());
+	zip_source_t* Source = zip_source_function_create(&SourceCallback, Reference, OutError);
+	if (Source == NULL)
+	{
+		delete Reference;
+	}
+	return Source;
+}
+
+void FLibzipPlatformFileSource::Prefetch(int64 Offset, int64 Size)
+{
+	if (Size <= 0 || Offset >= FileSize)
+	{
+		return;
+	}
+
+	const int64 LastIndex = FMath::Min(Offset + Size, FileSize) - 1;
+	for (int64 Index = Offset / PlatformFileBlockSize; Index <= LastIndex / PlatformFileBlockSize && Index < Offset / PlatformFileBlockSize + PlatformFileReadAheadBlocks; ++Index)
+	{
+		RequestBlock(Index);
+	}
+}
+
+zip_int64_t FLibzipPlatformFileSource::SourceCallback(void* UserData, void* Data, zip_uint64_t Length, zip_source_cmd_t Command)
+{
+	FPlatformFileSourcePtr* Reference = static_cast<FPlatformFileSourcePtr*>(UserData);
+	FLibzipPlatformFileSource* Source = Reference->Get();
+	switch (Command)
+	{
+	case ZIP_SOURCE_OPEN:
+		Source->Position = 0;
+		Source->LastReadEnd = -1;
+		return 0;
+
+	case ZIP_SOURCE_READ:
+		return Source->Read(static_cast<uint8*>(Data), FMath::Min<zip_uint64_t>(Length, MAX_int64));
+
+	case ZIP_SOURCE_CLOSE:
+		return 0;
+
+	case ZIP_SOURCE_SEEK:
+	{
+		const zip_int64_t NewPosition = zip_source_seek_compute_offset(Source->Position, Source->FileSize, Data, Length, &Source->Error);
+		if (NewPosition < 0)
+		{
+			return -1;
+		}
+		Source->Position = NewPosition;
+		return 0;
+	}
+
+	case ZIP_SOURCE_TELL:
+		return Source->Position;
+
+	case ZIP_SOURCE_STAT:
+	{
+		zip_stat_t* Stat = ZIP_SOURCE_GET_ARGS(zip_stat_t, Data, Length, &Source->Error);
+		if (Stat == NULL)
+		{
+			return -1;
+		}
+		zip_stat_init(Stat);
+		Stat->valid = ZIP_STAT_SIZE | ZIP_STAT_MTIME;
+		Stat->size = Source->FileSize;
+		Stat->mtime = Source->ModificationTime;
+		return sizeof(zip_stat_t);
+	}
+
+	case ZIP_SOURCE_ERROR:
+		return zip_error_to_data(&Source->Error, Data, Length);
+
+	case ZIP_SOURCE_FREE:
+		delete Reference;
+		return 0;
+
+	case ZIP_SOURCE_SUPPORTS:
+		return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+
+	default:
+		zip_error_set(&Source->Error, ZIP_ER_OPNOTSUPP, 0);
+		return -1;
+	}
+}
+
+int64 FLibzipPlatformFileSource::Read(uint8* Data, int64 Length)
+{
+	const bool bSequential = Position == LastReadEnd;
+	Length = FMath::Clamp<int64>(FileSize - Position, 0, Length);
+
+	int64 Total = 0;
+	while (Total < Length)
+	{
+		const int64 Index = (Position + Total) / PlatformFileBlockSize;
+		RequestBlock(Index);
+		if (bSequential)
+		{
+			const int64 LastIndex = (FileSize - 1) / PlatformFileBlockSize;
+			for (int64 AheadIndex = Index + 1; AheadIndex <= FMath::Min(Index + PlatformFileReadAheadBlocks, LastIndex); ++AheadIndex)
+			{
+				RequestBlock(AheadIndex);
+			}
+		}
+
+		FBlock* Block = Blocks.FindByPredicate([Index](const FBlock& Candidate) { return Candidate.Index == Index; });
+		if (Block == nullptr || !WaitBlock(*Block))
+		{
+			zip_error_set(&Error, ZIP_ER_READ, 0);
+			return -1;
+		}
+
+		const int64 BlockStart = Index * PlatformFileBlockSize;
+		const int64 BlockOffset = Position + Total - BlockStart;
+		const int64 CopySize = FMath::Min(Length - Total, FMath::Min(PlatformFileBlockSize, FileSize - BlockStart) - BlockOffset);
+		FMemory::Memcpy(Data + Total, Block->Data + BlockOffset, CopySize);
+		Total += CopySize;
+	}
+
+	Position += Total;
+	LastReadEnd = Position;
+	TRACE_COUNTER_ADD(LibzipArchiver_BytesRead, Total);
+	return Total;
+}
+
+FLibzipPlatformFileSource::FBlock* FLibzipPlatformFileSource::RequestBlock(int64 Index)
+{
+	FBlock* Block = Blocks.FindByPredicate([Index](const FBlock& Candidate) { return Candidate.Index == Index; });
+	if (Block == nullptr)
+	{
+		if (Blocks.Num() >= PlatformFileMaxBlocks)
+		{
+			int32 Oldest = 0;
+			for (int32 Candidate = 1; Candidate < Blocks.Num(); ++Candidate)
+			{
+				if (Blocks[Candidate].LastUse < Blocks[Oldest].LastUse)
+				{
+					Oldest = Candidate;
+				}
+			}
+			ReleaseBlock(Blocks[Oldest]);
+			Blocks.RemoveAtSwap(Oldest, 1, false);
+		}
+
+		Block = &Blocks.AddDefaulted_GetRef();
+		Block->Index = Index;
+		const int64 Offset = Index * PlatformFileBlockSize;
+		Block->Request = Handle->ReadRequest(Offset, FMath::Min(PlatformFileBlockSize, FileSize - Offset));
+	}
+
+	Block->LastUse = ++UseCounter;
+	return Block;
+}
+
+bool FLibzipPlatformFileSource::WaitBlock(FBlock& Block)
+{
+	if (Block.Data == nullptr && Block.Request != nullptr)
+	{
+		Block.Request->WaitCompletion();
+		Block.Data = Block.Request->GetReadResults();
+		delete Block.Request;
+		Block.Request = nullptr;
+	}
+	return Block.Data != nullptr;
+}
+
+void FLibzipPlatformFileSource::ReleaseBlock(FBlock& Block)
+{
+	if (Block.Request != nullptr)
+	{
+		Block.Request->WaitCompletion();
+		FMemory::Free(Block.Request->GetReadResults());
+		delete Block.Request;
+		Block.Request = nullptr;
+	}
+	FMemory::Free(Block.Data);
+	Block.Data = nullptr;
+}
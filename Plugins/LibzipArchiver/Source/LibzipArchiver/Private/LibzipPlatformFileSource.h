@@ -0,0 +1,52 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "zip.h"
+
+class IAsyncReadFileHandle;
+class IAsyncReadRequest;
+
+/**
+ * Archive reader on IPlatformFile, so that archives inside pak files and sandboxed platform files can be opened.
+ * Reads go through IAsyncReadFileHandle in fixed blocks, and blocks ahead of sequential reads are requested before they are needed.
+ */
+class FLibzipPlatformFileSource : public TSharedFromThis<FLibzipPlatformFileSource, ESPMode::ThreadSafe>
+{
+public:
+	static TSharedPtr<FLibzipPlatformFileSource, ESPMode::ThreadSafe> Open(const FString& Path);
+
+	~FLibzipPlatformFileSource();
+
+	/** Creates a libzip source which keeps this reader alive until libzip frees it. */
+	zip_source_t* CreateSource(zip_error_t* Error);
+
+	/** Starts reading a range that is about to be needed. Only called on the thread using the archive. */
+	void Prefetch(int64 Offset, int64 Size);
+
+private:
+	struct FBlock
+	{
+		int64 Index = 0;
+		IAsyncReadRequest* Request = nullptr;
+		uint8* Data = nullptr;
+		uint64 LastUse = 0;
+	};
+
+	FLibzipPlatformFileSource() = default;
+
+	static zip_int64_t SourceCallback(void* UserData, void* Data, zip_uint64_t Length, zip_source_cmd_t Command);
+	int64 Read(uint8* Data, int64 Length);
+	FBlock* RequestBlock(int64 Index);
+	bool WaitBlock(FBlock& Block);
+	void ReleaseBlock(FBlock& Block);
+
+	TUniquePtr<IAsyncReadFileHandle> Handle;
+	int64 FileSize = 0;
+	time_t ModificationTime = 0;
+
+	int64 Position = 0;
+	int64 LastReadEnd = -1;
+	uint64 UseCounter = 0;
+	TArray<FBlock> Blocks;
+	zip_error_t Error;
+};
@@ -0,0 +1,463 @@
+#include "LibzipPosixFileSource.h"
+
+#if PLATFORM_LINUX
+
+#include "LibzipArchiverTrace.h"
+#include "zipint.h"
+extern "C"
+{
+#include "zip_source_file.h"
+}
+
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Older kernel headers, like the ones of the engine's sysroot, predate the generic clone ioctl, which btrfs introduced with the same number.
+#ifndef FICLONERANGE
+struct file_clone_range
+{
+	__s64 src_fd;
+	__u64 src_offset;
+	__u64 src_length;
+	__u64 dest_offset;
+};
+#define FICLONERANGE _IOW(0x94, 13, struct file_clone_range)
+#endif
+
+namespace
+{
+	/** How far ahead of the current read the kernel is asked to fetch. */
+	constexpr int64 ReadAheadBytes = 4 * 1024 * 1024;
+
+	/** O_DIRECT transfers have to be aligned to the logical block size, which 4 KiB covers on common devices. */
+	constexpr int64 DirectIOAlignment = 4096;
+	constexpr int64 DirectIOBufferSize = 8 * 1024 * 1024;
+
+	std::atomic<int64> CloneCount(0);
+
+	struct FPosixFile
+	{
+		int Fd = -1;
+		int DirectFd = -1;
+
+		/** Range last passed to posix_fadvise. */
+		int64 AdvisedBegin = 0;
+		int64 AdvisedEnd = 0;
+
+		/** Aligned block last read through DirectFd. */
+		uint8* DirectBuffer = nullptr;
+		int64 DirectBufferOffset = 0;
+		int64 DirectBufferLength = 0;
+	};
+
+	bool OpenFile(zip_source_file_context_t* Ctx, bool bDirectIO)
+	{
+		const int Fd = open(Ctx->fname, O_RDONLY | O_CLOEXEC);
+		if (Fd < 0)
+		{
+			zip_error_set(&Ctx->error, errno == ENOENT ? ZIP_ER_NOENT : ZIP_ER_OPEN, errno);
+			return false;
+		}
+
+		// Linux applies this to the whole file and doubles its read-ahead window.
+		posix_fadvise(Fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+		FPosixFile* File = new FPosixFile();
+		File->Fd = Fd;
+#ifdef O_DIRECT
+		if (bDirectIO)
+		{
+			// Not every file system supports O_DIRECT, reads stay buffered then.
+			File->DirectFd = open(Ctx->fname, O_RDONLY | O_CLOEXEC | O_DIRECT);
+		}
+#endif
+		Ctx->f = File;
+		return true;
+	}
+
+	bool OpenBuffered(zip_source_file_context_t* Ctx)
+	{
+		return OpenFile(Ctx, false);
+	}
+
+	bool OpenDirect(zip_source_file_context_t* Ctx)
+	{
+		return OpenFile(Ctx, true);
+	}
+
+	void CloseFile(zip_source_file_context_t* Ctx)
+	{
+		FPosixFile* File = static_cast<FPosixFile*>(Ctx->f);
+		if (File == nullptr)
+		{
+			return;
+		}
+
+		close(File->Fd);
+		if (File->DirectFd >= 0)
+		{
+			close(File->DirectFd);
+		}
+		FMemory::Free(File->DirectBuffer);
+		delete File;
+		Ctx->f = NULL;
+	}
+
+	int64 ReadBuffered(FPosixFile* File, uint8* Data, int64 Offset, int64 Length)
+	{
+		// Advise again once half of the window is consumed so the next part is already on its way.
+		if (Offset < File->AdvisedBegin || Offset + Length > File->AdvisedBegin + (File->AdvisedEnd - File->AdvisedBegin) / 2)
+		{
+			const int64 AdviseLength = FMath::Max(Length, ReadAheadBytes);
+			posix_fadvise(File->Fd, Offset, AdviseLength, POSIX_FADV_WILLNEED);
+			File->AdvisedBegin = Offset;
+			File->AdvisedEnd = Offset + AdviseLength;
+		}
+
+		int64 Total = 0;
+		while (Total < Length)
+		{
+			const ssize_t Read = pread(File->Fd, Data + Total, Length - Total, Offset + Total);
+			if (Read < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return -1;
+			}
+			if (Read == 0)
+			{
+				break;
+			}
+			Total += Read;
+		}
+		return Total;
+	}
+
+	int64 ReadDirect(FPosixFile* File, uint8* Data, int64 Offset, int64 Length)
+	{
+		if (File->DirectBuffer == nullptr)
+		{
+			File->DirectBuffer = static_cast<uint8*>(FMemory::Malloc(DirectIOBufferSize, DirectIOAlignment));
+		}
+
+		int64 Total = 0;
+		while (Total < Length)
+		{
+			const int64 Position = Offset + Total;
+			if (Position < File->DirectBufferOffset || Position >= File->DirectBufferOffset + File->DirectBufferLength)
+			{
+				const int64 AlignedPosition = Position & ~(DirectIOAlignment - 1);
+				const ssize_t Read = pread(File->DirectFd, File->DirectBuffer, DirectIOBufferSize, AlignedPosition);
+				if (Read < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					return -1;
+				}
+				File->DirectBufferOffset = AlignedPosition;
+				File->DirectBufferLength = Read;
+				if (Position >= AlignedPosition + Read)
+				{
+					break;
+				}
+			}
+
+			const int64 CopySize = FMath::Min(Length - Total, File->DirectBufferOffset + File->DirectBufferLength - Position);
+			FMemory::Memcpy(Data + Total, File->DirectBuffer + (Position - File->DirectBufferOffset), CopySize);
+			Total += CopySize;
+		}
+		return Total;
+	}
+
+	zip_int64_t ReadFileData(zip_source_file_context_t* Ctx, void* Buffer, zip_uint64_t Length)
+	{
+		// libzip keeps the position itself, so every read goes to an explicit offset.
+		FPosixFile* File = static_cast<FPosixFile*>(Ctx->f);
+		const int64 Offset = Ctx->start + Ctx->offset;
+		const int64 Size = FMath::Min<zip_uint64_t>(Length, MAX_int64);
+		if (File->DirectFd >= 0)
+		{
+			const int64 Read = ReadDirect(File, static_cast<uint8*>(Buffer), Offset, Size);
+			if (Read >= 0)
+			{
+				TRACE_COUNTER_ADD(LibzipArchiver_BytesRead, Read);
+				return Read;
+			}
+			if (errno != EINVAL)
+			{
+				zip_error_set(&Ctx->error, ZIP_ER_READ, errno);
+				return -1;
+			}
+
+			// The device refused the alignment, stay buffered from here on.
+			close(File->DirectFd);
+			File->DirectFd = -1;
+		}
+
+		const int64 Read = ReadBuffered(File, static_cast<uint8*>(Buffer), Offset, Size);
+		if (Read < 0)
+		{
+			zip_error_set(&Ctx->error, ZIP_ER_READ, errno);
+			return -1;
+		}
+		TRACE_COUNTER_ADD(LibzipArchiver_BytesRead, Read);
+		return Read;
+	}
+
+	bool SeekFile(zip_source_file_context_t* Ctx, void* File, zip_int64_t Offset, int Whence)
+	{
+		// Nothing to move for reads, they use the offset libzip tracks.
+		if (File == NULL || File != Ctx->fout)
+		{
+			return true;
+		}
+		if (lseek(static_cast<FPosixFile*>(File)->Fd, Offset, Whence) < 0)
+		{
+			zip_error_set(&Ctx->error, ZIP_ER_SEEK, errno);
+			return false;
+		}
+		return true;
+	}
+
+	zip_int64_t TellFile(zip_source_file_context_t* Ctx, void* File)
+	{
+		if (File == NULL || File != Ctx->fout)
+		{
+			return Ctx->offset;
+		}
+		const off_t Position = lseek(static_cast<FPosixFile*>(File)->Fd, 0, SEEK_CUR);
+		if (Position < 0)
+		{
+			zip_error_set(&Ctx->error, ZIP_ER_TELL, errno);
+		}
+		return Position;
+	}
+
+	void CloseOutput(zip_source_file_context_t* Ctx)
+	{
+		FPosixFile* Output = static_cast<FPosixFile*>(Ctx->fout);
+		if (Output != nullptr)
+		{
+			close(Output->Fd);
+			delete Output;
+			Ctx->fout = NULL;
+		}
+	}
+
+	zip_int64_t CreateTempOutput(zip_source_file_context_t* Ctx)
+	{
+		const size_t NameSize = strlen(Ctx->fname) + 8;
+		char* TempName = static_cast<char*>(malloc(NameSize));
+		if (TempName == NULL)
+		{
+			zip_error_set(&Ctx->error, ZIP_ER_MEMORY, 0);
+			return -1;
+		}
+		snprintf(TempName, NameSize, "%s.XXXXXX", Ctx->fname);
+
+		const int Fd = mkostemp(TempName, O_CLOEXEC);
+		if (Fd < 0)
+		{
+			zip_error_set(&Ctx->error, ZIP_ER_TMPOPEN, errno);
+			free(TempName);
+			return -1;
+		}
+
+		// Keep the permissions of the archive being replaced.
+		struct stat Stat;
+		if (stat(Ctx->fname, &Stat) == 0)
+		{
+			fchmod(Fd, Stat.st_mode & 07777);
+		}
+
+		FPosixFile* Output = new FPosixFile();
+		Output->Fd = Fd;
+		Ctx->fout = Output;
+		Ctx->tmpname = TempName;
+		return 0;
+	}
+
+	zip_int64_t CreateTempOutputCloning(zip_source_file_context_t* Ctx, zip_uint64_t Offset)
+	{
+		const FPosixFile* File = static_cast<const FPosixFile*>(Ctx->f);
+		struct stat Stat;
+		if (File == nullptr || fstat(File->Fd, &Stat) < 0)
+		{
+			zip_error_set(&Ctx->error, ZIP_ER_READ, File == nullptr ? EBADF : errno);
+			return -1;
+		}
+		if (CreateTempOutput(Ctx) < 0)
+		{
+			return -1;
+		}
+
+		// The cloned range has to end on a block boundary, or at the end of the file, which is what a length of 0 means.
+		const int Fd = static_cast<FPosixFile*>(Ctx->fout)->Fd;
+		file_clone_range Range;
+		Range.src_fd = File->Fd;
+		Range.src_offset = 0;
+		Range.src_length = (Offset + Stat.st_blksize - 1) / Stat.st_blksize * Stat.st_blksize;
+		if (Range.src_length > static_cast<zip_uint64_t>(Stat.st_size))
+		{
+			Range.src_length = 0;
+		}
+		Range.dest_offset = 0;
+		if (ioctl(Fd, FICLONERANGE, &Range) < 0 || ftruncate(Fd, Offset) < 0 || lseek(Fd, Offset, SEEK_SET) < 0)
+		{
+			// libzip then begins a regular write and copies everything.
+			zip_error_set(&Ctx->error, ZIP_ER_OPNOTSUPP, errno);
+			CloseOutput(Ctx);
+			unlink(Ctx->tmpname);
+			free(Ctx->tmpname);
+			Ctx->tmpname = NULL;
+			return -1;
+		}
+		CloneCount.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	zip_int64_t RefuseCloning(zip_source_file_context_t* Ctx, zip_uint64_t Offset)
+	{
+		// Fails like a file system that cannot clone, rather than leaving cloning out, so libzip takes the same fallback.
+		zip_error_set(&Ctx->error, ZIP_ER_OPNOTSUPP, 0);
+		return -1;
+	}
+
+	zip_int64_t WriteFileData(zip_source_file_context_t* Ctx, const void* Data, zip_uint64_t Length)
+	{
+		const int Fd = static_cast<FPosixFile*>(Ctx->fout)->Fd;
+		zip_uint64_t Total = 0;
+		while (Total < Length)
+		{
+			const ssize_t Written = write(Fd, static_cast<const uint8*>(Data) + Total, Length - Total);
+			if (Written < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				zip_error_set(&Ctx->error, ZIP_ER_WRITE, errno);
+				return -1;
+			}
+			Total += Written;
+		}
+		TRACE_COUNTER_ADD(LibzipArchiver_BytesWritten, Total);
+		return Total;
+	}
+
+	zip_int64_t CommitWrite(zip_source_file_context_t* Ctx)
+	{
+		FPosixFile* Output = static_cast<FPosixFile*>(Ctx->fout);
+		const int Result = close(Output->Fd);
+		delete Output;
+		Ctx->fout = NULL;
+		if (Result < 0)
+		{
+			zip_error_set(&Ctx->error, ZIP_ER_WRITE, errno);
+			return -1;
+		}
+		if (rename(Ctx->tmpname, Ctx->fname) < 0)
+		{
+			zip_error_set(&Ctx->error, ZIP_ER_RENAME, errno);
+			return -1;
+		}
+		return 0;
+	}
+
+	void RollbackWrite(zip_source_file_context_t* Ctx)
+	{
+		CloseOutput(Ctx);
+		if (Ctx->tmpname != NULL)
+		{
+			unlink(Ctx->tmpname);
+		}
+	}
+
+	zip_int64_t RemoveFile(zip_source_file_context_t* Ctx)
+	{
+		if (unlink(Ctx->fname) < 0 && errno != ENOENT)
+		{
+			zip_error_set(&Ctx->error, ZIP_ER_REMOVE, errno);
+			return -1;
+		}
+		return 0;
+	}
+
+	bool StatFile(zip_source_file_context_t* Ctx, zip_source_file_stat_t* St)
+	{
+		struct stat Stat;
+		const FPosixFile* File = static_cast<const FPosixFile*>(Ctx->f);
+		if ((File != nullptr ? fstat(File->Fd, &Stat) : stat(Ctx->fname, &Stat)) < 0)
+		{
+			if (errno == ENOENT)
+			{
+				St->exists = false;
+				return true;
+			}
+			zip_error_set(&Ctx->error, ZIP_ER_READ, errno);
+			return false;
+		}
+
+		St->size = Stat.st_size;
+		St->mtime = Stat.st_mtime;
+		St->regular_file = S_ISREG(Stat.st_mode);
+		St->exists = true;
+
+		Ctx->attributes.valid |= ZIP_FILE_ATTRIBUTES_HOST_SYSTEM | ZIP_FILE_ATTRIBUTES_EXTERNAL_FILE_ATTRIBUTES;
+		Ctx->attributes.host_system = ZIP_OPSYS_UNIX;
+		Ctx->attributes.external_file_attributes = (static_cast<zip_uint32_t>(Stat.st_mode) << 16) | ((Stat.st_mode & S_IWUSR) ? 0 : 1);
+		return true;
+	}
+
+	char* DuplicateString(zip_source_file_context_t* Ctx, const char* String)
+	{
+		return strdup(String);
+	}
+
+	zip_source_file_operations_t BufferedOperations = {
+		CloseFile, NULL, NULL, NULL, OpenBuffered, ReadFileData, NULL, NULL, SeekFile, StatFile, DuplicateString, NULL, NULL
+	};
+
+	zip_source_file_operations_t DirectOperations = {
+		CloseFile, NULL, NULL, NULL, OpenDirect, ReadFileData, NULL, NULL, SeekFile, StatFile, DuplicateString, NULL, NULL
+	};
+
+	zip_source_file_operations_t WritableOperations = {
+		CloseFile, CommitWrite, CreateTempOutput, CreateTempOutputCloning, OpenBuffered, ReadFileData, RemoveFile, RollbackWrite, SeekFile, StatFile,
+		DuplicateString, TellFile, WriteFileData
+	};
+
+	zip_source_file_operations_t CopyingWritableOperations = {
+		CloseFile, CommitWrite, CreateTempOutput, RefuseCloning, OpenBuffered, ReadFileData, RemoveFile, RollbackWrite, SeekFile, StatFile,
+		DuplicateString, TellFile, WriteFileData
+	};
+}
+
+zip_source_t* FLibzipPosixFileSource::Create(const FString& Path, bool bDirectIO, zip_error_t* Error)
+{
+	return zip_source_file_common_new(TCHAR_TO_UTF8(*Path), NULL, 0, 0, NULL, bDirectIO ? &DirectOperations : &BufferedOperations, NULL, Error);
+}
+
+zip_source_t* FLibzipPosixFileSource::CreateWritable(const FString& Path, bool bClone, zip_error_t* Error)
+{
+	return zip_source_file_common_new(TCHAR_TO_UTF8(*Path), NULL, 0, 0, NULL, bClone ? &WritableOperations : &CopyingWritableOperations, NULL, Error);
+}
+
+int64 FLibzipPosixFileSource::GetCloneCount()
+{
+	return CloneCount.load(std::memory_order_relaxed);
+}
+
+#endif
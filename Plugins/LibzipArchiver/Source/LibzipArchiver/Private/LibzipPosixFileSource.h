@@ -0,0 +1,28 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "zip.h"
+
+#if PLATFORM_LINUX
+
+/**
+ * libzip file source for Linux.
+ * Reads with pread so no seek position is shared, and advises the kernel of the range about to be read.
+ * With bDirectIO the file is read through O_DIRECT into a large aligned buffer, bypassing the page cache.
+ */
+struct FLibzipPosixFileSource
+{
+	static zip_source_t* Create(const FString& Path, bool bDirectIO, zip_error_t* Error);
+
+	/**
+	 * Source that can also write the archive back, through a temporary file renamed over it on commit.
+	 * The unchanged part at the start of the archive is cloned into the temporary file with FICLONERANGE on file systems
+	 * that share extents, such as btrfs and XFS, instead of being copied. Elsewhere, and without bClone, libzip copies it as usual.
+	 */
+	static zip_source_t* CreateWritable(const FString& Path, bool bClone, zip_error_t* Error);
+
+	/** Number of rewrites so far that cloned the start of the archive instead of copying it. */
+	static int64 GetCloneCount();
+};
+
+#endif
@@ -0,0 +1,314 @@
+#include "LibzipReaderPool.h"
+#include "LibzipArchiverLog.h"
+#include "LibzipArchiverTrace.h"
+#include "LibzipCoreArchive.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	/** Larger buffers for compressed data are freed after use instead of being kept by the reader. */
+	constexpr int64 ReaderBufferMaxBytes = 16 * 1024 * 1024;
+
+	LibzipCore::FEntry ToCoreEntry(const FLibzipReaderPool::FEntry& Entry)
+	{
+		LibzipCore::FEntry CoreEntry;
+		CoreEntry.Size = Entry.Size;
+		CoreEntry.CompressedSize = Entry.CompressedSize;
+		CoreEntry.Crc = Entry.Crc;
+		CoreEntry.Method = Entry.bStored ? LibzipCore::MethodStore : LibzipCore::MethodDeflate;
+		return CoreEntry;
+	}
+}
+
+int64 FLibzipReaderPool::GetDataOffset(const uint8* Header, int64 LocalHeaderOffset)
+{
+	return LibzipCore::GetDataOffset(Header, LocalHeaderOffset);
+}
+
+bool FLibzipReaderPool::Decode(const FEntry& Entry, const uint8* Compressed, uint8* Data)
+{
+	LIBZIP_TRACE_NAME_SCOPE(*Entry.Name);
+	TRACE_COUNTER_ADD(LibzipArchiver_BytesInflated, Entry.Size);
+	bool bDecoded;
+	if (Entry.bStored)
+	{
+		// Stored data is copied unless it was read in place, and only has its CRC checked.
+		LIBZIP_TRACE_SCOPE(LibzipArchiver_Crc);
+		bDecoded = LibzipCore::Decode(ToCoreEntry(Entry), Compressed, Data);
+	}
+	else
+	{
+		LIBZIP_TRACE_SCOPE(LibzipArchiver_Inflate);
+		bDecoded = LibzipCore::Decode(ToCoreEntry(Entry), Compressed, Data);
+	}
+	if (!bDecoded)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to decode entry %s"), *Entry.Name);
+		return false;
+	}
+	return true;
+}
+
+TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> FLibzipReaderPool::Open(const FString& ArchivePath, const FString& Password)
+{
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_ParseCentralDirectory);
+	LIBZIP_TRACE_NAME_SCOPE(*ArchivePath);
+	TUniquePtr<IFileHandle> File(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*ArchivePath));
+	if (!File.IsValid())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to open archive %s"), *ArchivePath);
+		return nullptr;
+	}
+
+	std::vector<LibzipCore::FEntry> CoreEntries;
+	const LibzipCore::FReadFunction ReadArchive = [&File](uint64_t Offset, uint64_t Size, uint8_t* Out) {
+		TRACE_COUNTER_ADD(LibzipArchiver_BytesRead, Size);
+		return File->Seek(Offset) && File->Read(Out, Size);
+	};
+	const int64 ArchiveSize = File->Size();
+	if (ArchiveSize < 0 || !LibzipCore::ReadCentralDirectory(ArchiveSize, ReadArchive, CoreEntries))
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read central directory of %s"), *ArchivePath);
+		return nullptr;
+	}
+	const int64 NumEntries = CoreEntries.size();
+	if (NumEntries > TNumericLimits<int32>::Max())
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Too many entries in %s"), *ArchivePath);
+		return nullptr;
+	}
+
+	TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool = MakeShareable(new FLibzipReaderPool());
+	Pool->ArchivePath = ArchivePath;
+	Pool->Password = Password;
+	Pool->Entries.Reserve(NumEntries);
+	Pool->EntryIndices.Reserve(NumEntries);
+	Pool->DataOffsets = MakeUnique<std::atomic<int64>[]>(NumEntries);
+	for (int64 Index = 0; Index < NumEntries; ++Index)
+	{
+		const LibzipCore::FEntry& CoreEntry = CoreEntries[Index];
+		FEntry& Entry = Pool->Entries.AddDefaulted_GetRef();
+		Entry.Name = UTF8_TO_TCHAR(CoreEntry.Name.c_str());
+		Entry.Size = CoreEntry.Size;
+		Entry.CompressedSize = CoreEntry.CompressedSize;
+		Entry.LocalHeaderOffset = CoreEntry.LocalHeaderOffset;
+		Entry.Crc = CoreEntry.Crc;
+		Entry.ModificationTime = FDateTime::FromUnixTimestamp(CoreEntry.ModificationTime);
+		Entry.bStored = CoreEntry.Method == LibzipCore::MethodStore && CoreEntry.CompressedSize == CoreEntry.Size;
+		Entry.bDirect = LibzipCore::CanDecode(CoreEntry);
+		Pool->EntryIndices.Add(Entry.Name, Index);
+		Pool->DataOffsets[Index] = -1;
+	}
+
+	// The handle the directory was read with serves the first reader.
+	FReader* Reader = new FReader();
+	Reader->File = MoveTemp(File);
+	Pool->Readers.Emplace(Reader);
+	Pool->FreeReaders.Push(Reader);
+	return Pool;
+}
+
+bool FLibzipReaderPool::Stat(int64 Index, FString& Name, int64& Size) const
+{
+	if (!Entries.IsValidIndex(Index))
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_stat_index %lld"), Index);
+		return false;
+	}
+
+	Name = Entries[Index].Name;
+	Size = Entries[Index].Size;
+	return true;
+}
+
+TArray<zip_uint64_t> FLibzipReaderPool::GetIndicesInOffsetOrder() const
+{
+	TArray<zip_uint64_t> Indices;
+	Indices.Reserve(Entries.Num());
+	for (int32 Index = 0; Index < Entries.Num(); ++Index)
+	{
+		Indices.Add(Index);
+	}
+	Indices.Sort([this](zip_uint64_t A, zip_uint64_t B) {
+		return Entries[A].LocalHeaderOffset < Entries[B].LocalHeaderOffset;
+	});
+	return Indices;
+}
+
+FLibzipReaderPool::~FLibzipReaderPool()
+{
+	for (const TUniquePtr<FReader>& Reader : Readers)
+	{
+		if (Reader->Archive != nullptr)
+		{
+			zip_discard(Reader->Archive);
+		}
+	}
+}
+
+int64 FLibzipReaderPool::Find(const FString& Name) const
+{
+	const int64* Index = EntryIndices.Find(Name);
+	return Index != nullptr ? *Index : -1;
+}
+
+bool FLibzipReaderPool::Read(int64 Index, FString& Name, TFunctionRef<uint8*(int64 Size)> Allocate, TFunctionRef<void(const FString& Name)> OnRead,
+	bool* bOutCacheHit)
+{
+	if (!Entries.IsValidIndex(Index))
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_stat_index %lld"), Index);
+		return false;
+	}
+
+	const FEntry& Entry = Entries[Index];
+	FLibzipTraceEntryInFlight InFlight;
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_ReadEntry);
+	OnRead(Entry.Name);
+	uint8* Data = Allocate(Entry.Size);
+	if (Data == nullptr && Entry.Size > 0)
+	{
+		return false;
+	}
+	if (Entry.Size == 0)
+	{
+		Name = Entry.Name;
+		return true;
+	}
+
+	FReader* Reader = Lease();
+	if (Reader == nullptr)
+	{
+		return false;
+	}
+	if (bOutCacheHit != nullptr)
+	{
+		*bOutCacheHit = Entry.bDirect && DataOffsets[Index].load(std::memory_order_relaxed) >= 0;
+	}
+	const bool bResult = Entry.bDirect ? ReadDirect(*Reader, Index, Data) : ReadThroughLibzip(*Reader, Index, Data);
+	Release(Reader);
+
+	if (bResult)
+	{
+		Name = Entry.Name;
+	}
+	return bResult;
+}
+
+FLibzipReaderPool::FReader* FLibzipReaderPool::Lease()
+{
+	{
+		FScopeLock Lock(&ReadersLock);
+		if (FreeReaders.Num() > 0)
+		{
+			return FreeReaders.Pop(false);
+		}
+	}
+
+	// Opening the file is left outside of the lock, so that threads arriving at once do not wait on each other.
+	IFileHandle* File = FPlatformFileManager::Get().GetPlatformFile().OpenRead(*ArchivePath);
+	if (File == nullptr)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to open archive %s"), *ArchivePath);
+		return nullptr;
+	}
+
+	FReader* Reader = new FReader();
+	Reader->File.Reset(File);
+	FScopeLock Lock(&ReadersLock);
+	Readers.Emplace(Reader);
+	return Reader;
+}
+
+void FLibzipReaderPool::Release(FReader* Reader)
+{
+	FScopeLock Lock(&ReadersLock);
+	FreeReaders.Push(Reader);
+}
+
+bool FLibzipReaderPool::ReadDirect(FReader& Reader, int64 Index, uint8* Data)
+{
+	const FEntry& Entry = Entries[Index];
+	int64 DataOffset = DataOffsets[Index].load(std::memory_order_relaxed);
+	if (DataOffset < 0)
+	{
+		uint8 Header[LocalHeaderSize];
+		if (!Reader.File->Seek(Entry.LocalHeaderOffset) || !Reader.File->Read(Header, LocalHeaderSize)
+			|| (DataOffset = GetDataOffset(Header, Entry.LocalHeaderOffset)) < 0)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read local header of %s"), *Entry.Name);
+			return false;
+		}
+		DataOffsets[Index].store(DataOffset, std::memory_order_relaxed);
+		TRACE_COUNTER_ADD(LibzipArchiver_BytesRead, LocalHeaderSize);
+	}
+
+	if (Entry.bStored)
+	{
+		if (!Reader.File->Seek(DataOffset) || !Reader.File->Read(Data, Entry.Size))
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read entry %s"), *Entry.Name);
+			return false;
+		}
+		TRACE_COUNTER_ADD(LibzipArchiver_BytesRead, Entry.Size);
+		return Decode(Entry, Data, Data);
+	}
+
+	Reader.Compressed.SetNumUninitialized(Entry.CompressedSize, false);
+	if (!Reader.File->Seek(DataOffset) || !Reader.File->Read(Reader.Compressed.GetData(), Entry.CompressedSize))
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read entry %s"), *Entry.Name);
+		return false;
+	}
+	TRACE_COUNTER_ADD(LibzipArchiver_BytesRead, Entry.CompressedSize);
+	const bool bDecoded = Decode(Entry, Reader.Compressed.GetData(), Data);
+	if (Reader.Compressed.Max() > ReaderBufferMaxBytes)
+	{
+		Reader.Compressed.Empty();
+	}
+	return bDecoded;
+}
+
+bool FLibzipReaderPool::ReadThroughLibzip(FReader& Reader, int64 Index, uint8* Data)
+{
+	if (Reader.Archive == nullptr)
+	{
+		int errorp;
+		Reader.Archive = zip_open(TCHAR_TO_UTF8(*ArchivePath), ZIP_RDONLY, &errorp);
+		if (Reader.Archive == nullptr)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_open %d"), errorp);
+			return false;
+		}
+	}
+
+	// libzip decrypts, decompresses and checks the CRC of entries that cannot be read directly.
+	LIBZIP_TRACE_SCOPE(LibzipArchiver_ReadThroughLibzip);
+	LIBZIP_TRACE_NAME_SCOPE(*Entries[Index].Name);
+	TRACE_COUNTER_ADD(LibzipArchiver_BytesRead, Entries[Index].CompressedSize);
+	TRACE_COUNTER_ADD(LibzipArchiver_BytesInflated, Entries[Index].Size);
+	zip_file* File = Password.IsEmpty() ? zip_fopen_index(Reader.Archive, Index, 0)
+		: zip_fopen_index_encrypted(Reader.Archive, Index, 0, TCHAR_TO_UTF8(*Password));
+	if (File == nullptr)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_fopen %s"), UTF8_TO_TCHAR(zip_strerror(Reader.Archive)));
+		return false;
+	}
+
+	bool bResult = true;
+	for (int64 Remaining = Entries[Index].Size; Remaining > 0;)
+	{
+		const zip_int64_t ReadByte = zip_fread(File, Data, Remaining);
+		if (ReadByte <= 0)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to zip_fread %s"), UTF8_TO_TCHAR(zip_file_strerror(File)));
+			bResult = false;
+			break;
+		}
+		Data += ReadByte;
+		Remaining -= ReadByte;
+	}
+	zip_fclose(File);
+	return bResult;
+}
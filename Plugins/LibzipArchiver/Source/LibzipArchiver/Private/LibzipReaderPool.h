@@ -0,0 +1,101 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "zip.h"
+#include <atomic>
+
+class IFileHandle;
+
+/**
+ * Reads entries of one archive from any number of threads at once.
+ * The entry table is read once with LibzipCore::ReadCentralDirectory and then only read. Every reading thread leases a reader
+ * with its own file handle and buffer, so reads only synchronize on the lease. Unencrypted stored and deflate entries are read
+ * straight from the file and decoded by LibzipCore::Decode; other entries go through a zip handle that the reader opens the
+ * first time it needs one, whose entry indices follow the same central directory.
+ */
+class FLibzipReaderPool
+{
+public:
+	struct FEntry
+	{
+		FString Name;
+		int64 Size;
+		int64 CompressedSize;
+		int64 LocalHeaderOffset;
+		uint32 Crc;
+		FDateTime ModificationTime;
+		bool bStored;
+		/** Read without libzip. */
+		bool bDirect;
+	};
+
+	static constexpr int64 LocalHeaderSize = 30;
+
+	/** Returns the offset of the data following the local header at LocalHeaderOffset, or -1 if Header is no local header. */
+	static int64 GetDataOffset(const uint8* Header, int64 LocalHeaderOffset);
+
+	/** Decodes the data of a directly readable entry into Data and checks its CRC. Stored data may be decoded in place. */
+	static bool Decode(const FEntry& Entry, const uint8* Compressed, uint8* Data);
+
+	/** Reads the entry table of ArchivePath. Use FLibzipArchiveRegistry to share the result between users of the same archive. */
+	static TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Open(const FString& ArchivePath, const FString& Password);
+
+	~FLibzipReaderPool();
+
+	int64 Num() const { return Entries.Num(); }
+
+	/** Returns the index of the entry named Name, or -1 if there is none. */
+	int64 Find(const FString& Name) const;
+
+	bool Stat(int64 Index, FString& Name, int64& Size) const;
+
+	/** Entry indices in the order their data is stored in the archive. */
+	TArray<zip_uint64_t> GetIndicesInOffsetOrder() const;
+
+	const FEntry& GetEntry(int64 Index) const { return Entries[Index]; }
+	const FString& GetArchivePath() const { return ArchivePath; }
+
+	/**
+	 * Reads entry Index on the calling thread. Allocate is called with the entry size and returns where to put the content,
+	 * or nullptr to fail unless the size is 0.
+	 * OnRead, if set, is called with the entry name before the content is read.
+	 * bOutCacheHit tells whether the entry was read without reading its local header again.
+	 */
+	bool Read(int64 Index, FString& Name, TFunctionRef<uint8*(int64 Size)> Allocate, TFunctionRef<void(const FString& Name)> OnRead,
+		bool* bOutCacheHit = nullptr);
+
+private:
+	struct FReader
+	{
+		TUniquePtr<IFileHandle> File;
+		zip* Archive = nullptr;
+		TArray64<uint8> Compressed;
+	};
+
+	FLibzipReaderPool() = default;
+
+	FReader* Lease();
+	void Release(FReader* Reader);
+	bool ReadDirect(FReader& Reader, int64 Index, uint8* Data);
+	bool ReadThroughLibzip(FReader& Reader, int64 Index, uint8* Data);
+
+	FString ArchivePath;
+	FString Password;
+	TArray<FEntry> Entries;
+	/** Entry names are case sensitive like in libzip, unlike the default FString keys. */
+	struct FEntryNameKeyFuncs : BaseKeyFuncs<TPair<FString, int64>, FString>
+	{
+		static const FString& GetSetKey(const TPair<FString, int64>& Element) { return Element.Key; }
+		static bool Matches(const FString& A, const FString& B) { return A.Equals(B, ESearchCase::CaseSensitive); }
+		static uint32 GetKeyHash(const FString& Key) { return FCrc::StrCrc32(*Key); }
+	};
+
+	TMap<FString, int64, FDefaultSetAllocator, FEntryNameKeyFuncs> EntryIndices;
+
+	/** Offset of the entry data behind the local header, or -1 until the header was read. */
+	TUniquePtr<std::atomic<int64>[]> DataOffsets;
+
+	FCriticalSection ReadersLock;
+	TArray<FReader*> FreeReaders;
+	TArray<TUniquePtr<FReader>> Readers;
+};
@@ -0,0 +1,341 @@
+#include "LibzipShardedArchiver.h"
+#include "LibzipArchiver.h"
+#include "LibzipArchiverLog.h"
+#include "Misc/Paths.h"
+#include "Misc/FileHelper.h"
+#include "Async/ParallelFor.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace
+{
+	constexpr int32 ManifestVersion = 1;
+
+	FString GetShardPath(const FString& BaseName, int32 Shard)
+	{
+		return FString::Printf(TEXT("%s.%03d.zip"), *BaseName, Shard);
+	}
+
+	/** Shards and the manifest are written under this name and only moved into place once all of them are complete. */
+	FString GetTemporaryPath(const FString& Path)
+	{
+		return Path + TEXT(".tmp");
+	}
+
+	/** The previous build is moved aside under this name while the new one is moved into place. */
+	FString GetBackupPath(const FString& Path)
+	{
+		return Path + TEXT(".old");
+	}
+
+	/** Moves every file of Moves from its value to its key, and on failure moves the ones done so far back. */
+	bool MoveFiles(const TArray<TPair<FString, FString>>& Moves)
+	{
+		for (int32 Index = 0; Index < Moves.Num(); ++Index)
+		{
+			if (!IFileManager::Get().Move(*Moves[Index].Key, *Moves[Index].Value))
+			{
+				UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to move %s to %s"), *Moves[Index].Value, *Moves[Index].Key);
+				while (--Index >= 0)
+				{
+					IFileManager::Get().Move(*Moves[Index].Value, *Moves[Index].Key);
+				}
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/** Swaps the previous build of BaseName, including shards beyond the new count, for the temporary files of the new one. */
+	bool ReplaceShards(const FString& BaseName, const FString& ManifestPath, int32 ShardCount)
+	{
+		TArray<TPair<FString, FString>> Backups;
+		if (FPaths::FileExists(ManifestPath))
+		{
+			Backups.Emplace(GetBackupPath(ManifestPath), ManifestPath);
+		}
+		for (int32 Shard = 0; FPaths::FileExists(GetShardPath(BaseName, Shard)); ++Shard)
+		{
+			Backups.Emplace(GetBackupPath(GetShardPath(BaseName, Shard)), GetShardPath(BaseName, Shard));
+		}
+
+		// The new manifest goes last, so that it never points at shards that are not in place yet.
+		TArray<TPair<FString, FString>> Replacements;
+		for (int32 Shard = 0; Shard < ShardCount; ++Shard)
+		{
+			Replacements.Emplace(GetShardPath(BaseName, Shard), GetTemporaryPath(GetShardPath(BaseName, Shard)));
+		}
+		Replacements.Emplace(ManifestPath, GetTemporaryPath(ManifestPath));
+
+		if (!MoveFiles(Backups))
+		{
+			return false;
+		}
+		if (!MoveFiles(Replacements))
+		{
+			for (const TPair<FString, FString>& Backup : Backups)
+			{
+				IFileManager::Get().Move(*Backup.Value, *Backup.Key);
+			}
+			return false;
+		}
+		for (const TPair<FString, FString>& Backup : Backups)
+		{
+			IFileManager::Get().Delete(*Backup.Key, false, false, true);
+		}
+		return true;
+	}
+
+	/** Assigns every entry to a shard and returns the entries of each shard in input order. */
+	bool PartitionEntries(const TArray<TPair<FString, FString>>& Entries, int64 MaxShardBytes, int32 ShardCount, TArray<TArray<int32>>& ShardEntries)
+	{
+		TArray<int64> Sizes;
+		Sizes.Reserve(Entries.Num());
+		for (const TPair<FString, FString>& Entry : Entries)
+		{
+			Sizes.Add(FMath::Max<int64>(IFileManager::Get().FileSize(*Entry.Value), 0));
+		}
+
+		if (ShardCount > 0)
+		{
+			// Largest entries first, each into the currently smallest shard.
+			TArray<int32> Order;
+			for (int32 Index = 0; Index < Entries.Num(); ++Index)
+			{
+				Order.Add(Index);
+			}
+			Order.StableSort([&Sizes](int32 A, int32 B) { return Sizes[A] > Sizes[B]; });
+
+			TArray<int64> ShardSizes;
+			ShardSizes.SetNumZeroed(ShardCount);
+			ShardEntries.SetNum(ShardCount);
+			for (int32 Index : Order)
+			{
+				int32 Smallest = 0;
+				for (int32 Shard = 1; Shard < ShardCount; ++Shard)
+				{
+					if (ShardSizes[Shard] < ShardSizes[Smallest])
+					{
+						Smallest = Shard;
+					}
+				}
+				ShardSizes[Smallest] += Sizes[Index];
+				ShardEntries[Smallest].Add(Index);
+			}
+			for (TArray<int32>& Shard : ShardEntries)
+			{
+				Shard.Sort();
+			}
+		}
+		else if (MaxShardBytes > 0)
+		{
+			int64 ShardSize = 0;
+			for (int32 Index = 0; Index < Entries.Num(); ++Index)
+			{
+				if (ShardEntries.Num() == 0 || (ShardSize > 0 && ShardSize + Sizes[Index] > MaxShardBytes))
+				{
+					ShardEntries.AddDefaulted();
+					ShardSize = 0;
+				}
+				ShardEntries.Last().Add(Index);
+				ShardSize += Sizes[Index];
+			}
+		}
+		else
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Either shard count or max shard bytes has to be specified"));
+			return false;
+		}
+
+		// libzip does not write archives without entries.
+		ShardEntries.RemoveAll([](const TArray<int32>& Shard) { return Shard.Num() == 0; });
+		return true;
+	}
+}
+
+bool ULibzipShardedArchiver::CreateShardedArchive(const FString& BaseName, const TMap<FString, FString>& EntryAndFilePaths, int64 MaxShardBytes, int32 ShardCount, const FString& Password)
+{
+	const TArray<TPair<FString, FString>> Entries = EntryAndFilePaths.Array();
+	TArray<TArray<int32>> ShardEntries;
+	if (!PartitionEntries(Entries, MaxShardBytes, ShardCount, ShardEntries))
+	{
+		return false;
+	}
+
+	// Archivers are created up front because UObjects cannot be constructed on worker threads, and rooted because nothing else references them.
+	TArray<ULibzipArchiver*> Archivers;
+	for (int32 Shard = 0; Shard < ShardEntries.Num(); ++Shard)
+	{
+		Archivers.Add(NewObject<ULibzipArchiver>());
+		Archivers.Last()->AddToRoot();
+	}
+
+	TArray<bool> Results;
+	Results.SetNumZeroed(ShardEntries.Num());
+	ParallelFor(ShardEntries.Num(), [&](int32 Shard) {
+		ULibzipArchiver* Archiver = Archivers[Shard];
+		const FString ShardPath = GetTemporaryPath(GetShardPath(BaseName, Shard));
+		// Left behind by an earlier build that did not finish.
+		IFileManager::Get().Delete(*ShardPath, false, false, true);
+		bool bResult = Password.IsEmpty() ? Archiver->CreateArchiveFromStorage(ShardPath) : Archiver->CreateEncryptedArchiveFromStorage(ShardPath, Password);
+		for (int32 Index : ShardEntries[Shard])
+		{
+			bResult = bResult && Archiver->AddEntryFromStorage(Entries[Index].Key, Entries[Index].Value);
+		}
+		Results[Shard] = Archiver->CloseArchive() && bResult;
+	});
+	for (ULibzipArchiver* Archiver : Archivers)
+	{
+		Archiver->RemoveFromRoot();
+	}
+
+	TSharedRef<FJsonObject> Manifest = MakeShared<FJsonObject>();
+	TArray<TSharedPtr<FJsonValue>> ShardValues;
+	TArray<TSharedPtr<FJsonValue>> EntryValues;
+	bool bResult = !Results.Contains(false);
+	for (int32 Shard = 0; Shard < ShardEntries.Num(); ++Shard)
+	{
+		ShardValues.Add(MakeShared<FJsonValueString>(FPaths::GetCleanFilename(GetShardPath(BaseName, Shard))));
+		for (int32 Index : ShardEntries[Shard])
+		{
+			TSharedRef<FJsonObject> EntryValue = MakeShared<FJsonObject>();
+			EntryValue->SetStringField(TEXT("Name"), Entries[Index].Key);
+			EntryValue->SetNumberField(TEXT("Shard"), Shard);
+			EntryValues.Add(MakeShared<FJsonValueObject>(EntryValue));
+		}
+	}
+	Manifest->SetNumberField(TEXT("Version"), ManifestVersion);
+	Manifest->SetArrayField(TEXT("Shards"), ShardValues);
+	Manifest->SetArrayField(TEXT("Entries"), EntryValues);
+
+	const FString ManifestPath = GetManifestPath(BaseName);
+	FString ManifestString;
+	if (bResult)
+	{
+		bResult = FJsonSerializer::Serialize(Manifest, TJsonWriterFactory<>::Create(&ManifestString))
+			&& FFileHelper::SaveStringToFile(ManifestString, *GetTemporaryPath(ManifestPath));
+		if (!bResult)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to write shard manifest"));
+		}
+	}
+
+	if (bResult)
+	{
+		bResult = ReplaceShards(BaseName, ManifestPath, ShardEntries.Num());
+		if (!bResult)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to move shards of %s into place"), *BaseName);
+		}
+	}
+
+	if (!bResult)
+	{
+		for (int32 Shard = 0; Shard < ShardEntries.Num(); ++Shard)
+		{
+			IFileManager::Get().Delete(*GetTemporaryPath(GetShardPath(BaseName, Shard)), false, false, true);
+		}
+		IFileManager::Get().Delete(*GetTemporaryPath(ManifestPath), false, false, true);
+	}
+	return bResult;
+}
+
+FString ULibzipShardedArchiver::GetManifestPath(const FString& BaseName)
+{
+	return BaseName + TEXT(".zipshards");
+}
+
+bool ULibzipShardedArchiver::OpenShardedArchive(const FString& ManifestPath, const FString& Password)
+{
+	CloseShardedArchive();
+
+	FString ManifestString;
+	TSharedPtr<FJsonObject> Manifest;
+	if (!FFileHelper::LoadFileToString(ManifestString, *ManifestPath)
+		|| !FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(ManifestString), Manifest)
+		|| !Manifest.IsValid()
+		|| Manifest->GetIntegerField(TEXT("Version")) != ManifestVersion)
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Failed to read shard manifest"));
+		return false;
+	}
+
+	const FString BaseDir = FPaths::GetPath(ManifestPath);
+	for (const TSharedPtr<FJsonValue>& ShardValue : Manifest->GetArrayField(TEXT("Shards")))
+	{
+		ULibzipArchiver* Shard = NewObject<ULibzipArchiver>(this);
+		const FString ShardPath = FPaths::Combine(BaseDir, ShardValue->AsString());
+		if (!(Password.IsEmpty() ? Shard->OpenArchiveFromStorage(ShardPath) : Shard->OpenEncryptedArchiveFromStorage(ShardPath, Password)))
+		{
+			CloseShardedArchive();
+			return false;
+		}
+		Shards.Add(Shard);
+	}
+
+	for (const TSharedPtr<FJsonValue>& EntryValue : Manifest->GetArrayField(TEXT("Entries")))
+	{
+		const TSharedPtr<FJsonObject>& Entry = EntryValue->AsObject();
+		const FString Name = Entry->GetStringField(TEXT("Name"));
+		const int32 Shard = Entry->GetIntegerField(TEXT("Shard"));
+		const int64 Index = Shards.IsValidIndex(Shard) ? Shards[Shard]->FindEntry(Name) : -1;
+		if (Index < 0)
+		{
+			UE_LOG(LogLibzipArchiver, Error, TEXT("Not found entry in shard %s"), *Name);
+			CloseShardedArchive();
+			return false;
+		}
+		EntryIndices.Add(Name, Entries.Add({ Shard, Index }));
+	}
+
+	return true;
+}
+
+bool ULibzipShardedArchiver::CloseShardedArchive()
+{
+	bool bResult = true;
+	for (ULibzipArchiver* Shard : Shards)
+	{
+		bResult = Shard->CloseArchive() && bResult;
+	}
+	Shards.Reset();
+	Entries.Reset();
+	EntryIndices.Reset();
+	return bResult;
+}
+
+int64 ULibzipShardedArchiver::GetArchiveEntries()
+{
+	return Entries.Num();
+}
+
+int64 ULibzipShardedArchiver::FindEntry(const FString& Name)
+{
+	const int64* Index = EntryIndices.Find(Name);
+	return Index != nullptr ? *Index : -1;
+}
+
+bool ULibzipShardedArchiver::GetEntryToMemory(int64 Index, FString& Name, TArray<uint8>& Data)
+{
+	if (!Entries.IsValidIndex(Index))
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Invalid entry index %lld"), Index);
+		return false;
+	}
+
+	const FShardedEntry& Entry = Entries[Index];
+	return Shards[Entry.Shard]->GetEntryToMemory(Entry.Index, Name, Data);
+}
+
+bool ULibzipShardedArchiver::WriteEntryToStorage(int64 Index, const FString& BaseDir)
+{
+	if (!Entries.IsValidIndex(Index))
+	{
+		UE_LOG(LogLibzipArchiver, Error, TEXT("Invalid entry index %lld"), Index);
+		return false;
+	}
+
+	const FShardedEntry& Entry = Entries[Index];
+	return Shards[Entry.Shard]->WriteEntryToStorage(Entry.Index, BaseDir);
+}
@@ -2,9 +2,133 @@
 
 #include "CoreMinimal.h"
 #include "UObject/NoExportTypes.h"
+#include "Async/Future.h"
+#include "HAL/CriticalSection.h"
+#include "Memory/SharedBuffer.h"
 #include "LibzipArchiver.generated.h"
 
 struct zip;
+struct zip_source;
+struct zip_file;
+struct zip_stat;
+struct FLibzipAsyncCloseState;
+class FLibzipPlatformFileSource;
+class FLibzipReaderPool;
+class FLibzipDirectoryIndex;
+class FLibzipStatsCollector;
+
+/** How an input file is matched against the entry of the same name in a reference archive. */
+UENUM(BlueprintType)
+enum class ELibzipReuseMatch : uint8
+{
+	/** Same size and modification time. */
+	SizeAndTime,
+	/** Same size and CRC-32 of the content. */
+	Content,
+};
+
+/** What MergeArchives does when several input archives contain an entry with the same name. */
+UENUM(BlueprintType)
+enum class ELibzipMergeConflictPolicy : uint8
+{
+	/** Keep the entry of the archive that comes first in the input list. */
+	KeepFirst,
+	/** Keep the entry of the archive that comes last in the input list. */
+	KeepLast,
+	/** Fail the merge. */
+	Fail,
+};
+
+/** When files written by a bulk extraction are flushed to the device. */
+UENUM(BlueprintType)
+enum class ELibzipWriteDurability : uint8
+{
+	/** Left to the operating system. */
+	None,
+	/** Once per batch of files, before the batch is closed. */
+	SyncPerBatch,
+	/** Every file before it is closed. */
+	SyncPerFile,
+};
+
+/** Measurements of one pipelined extraction. Queue depths are sampled whenever an item is queued. */
+USTRUCT(BlueprintType)
+struct FLibzipPipelineStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		int32 Entries = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		int64 CompressedBytesRead = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		int64 BytesWritten = 0;
+
+	/** Entries waiting to be decoded. Near the capacity the decoding workers are the bottleneck, near 0 the reading stage is. */
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		float AverageDecodeQueueDepth = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		int32 MaxDecodeQueueDepth = 0;
+
+	/** Entries waiting to be written. Near the capacity the writing stage is the bottleneck. */
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		float AverageWriteQueueDepth = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		int32 MaxWriteQueueDepth = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		float Seconds = 0.0f;
+};
+
+/** Measurements of archiver operations, cheap enough to be collected in shipping builds. */
+USTRUCT(BlueprintType)
+struct FLibzipOperationStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		float WallSeconds = 0.0f;
+
+	/** CPU time of the calling threads and of the threads of pipelined extraction. */
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		float CpuSeconds = 0.0f;
+
+	/** Compressed bytes of entries read, or uncompressed bytes of entries added. */
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		int64 BytesIn = 0;
+
+	/** Decoded bytes of entries read, or compressed bytes of entries added and of archives created on close. */
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		int64 BytesOut = 0;
+
+	/** Uncompressed over compressed size of the entries whose compressed size is known, or 0. */
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		float CompressionRatio = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		int64 Entries = 0;
+
+	/** Archives found already open for concurrent reads, and entries read without reading their local header again. */
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		int64 CacheHits = 0;
+
+	/** Time to read or add one entry, with a relative error of at most 1/16. */
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		float P50EntryLatencyMs = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		float P95EntryLatencyMs = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "LibzipArchiver")
+		float P99EntryLatencyMs = 0.0f;
+};
+
+DECLARE_DYNAMIC_DELEGATE_OneParam(FOnArchiveCloseProgress, float, Progress);
+DECLARE_DYNAMIC_DELEGATE_OneParam(FOnArchiveClosed, bool, bSuccess);
 
 UCLASS(Blueprintable)
 class LIBZIPARCHIVER_API ULibzipArchiver : public UObject
@@ -12,6 +136,7 @@ class LIBZIPARCHIVER_API ULibzipArchiver : public UObject
 	GENERATED_BODY()
 
 public:
+	ULibzipArchiver();
 	virtual ~ULibzipArchiver();
 
 	UFUNCTION(BlueprintCallable)
@@ -24,31 +149,295 @@ public:
 	UFUNCTION(BlueprintCallable)
 		bool CreateArchiveFromStorage(const FString& ArchivePath);
 
+	/**
+	 * Creates an archive in memory, to be taken with CloseArchiveToMemory. Nothing is written to disk.
+	 * ReserveBytes preallocates the buffer when the size of the archive can be estimated.
+	 */
+	UFUNCTION(BlueprintCallable)
+		bool CreateArchiveInMemory(int64 ReserveBytes = 0);
+
+	UFUNCTION(BlueprintCallable)
+		bool CreateEncryptedArchiveInMemory(const FString& Password, int64 ReserveBytes = 0);
+
 	UFUNCTION(BlueprintCallable)
 		bool OpenEncryptedArchiveFromStorage(const FString& ArchivePath, const FString& Password);
 
 	UFUNCTION(BlueprintCallable)
 		bool CreateEncryptedArchiveFromStorage(const FString& ArchivePath, const FString& Password);
 
+	/**
+	 * Opens an archive through the engine's platform file, so that it can also be inside a pak file or a sandbox.
+	 * Reads are asynchronous requests of the platform file, issued ahead of the entry being read and of the next entry's header.
+	 */
+	UFUNCTION(BlueprintCallable)
+		bool OpenArchiveFromPlatformFile(const FString& ArchivePath);
+
+	UFUNCTION(BlueprintCallable)
+		bool OpenEncryptedArchiveFromPlatformFile(const FString& ArchivePath, const FString& Password);
+
+	/**
+	 * Opens an archive whose entries can be read from any number of threads at once with GetEntryToMemory, GetEntryToMemory64,
+	 * GetEntryToSharedBuffer and WriteEntryToStorage, as well as looked up with FindEntry and GetArchiveEntries.
+	 * The entry table is shared and every reading thread uses a reader of its own. The archive must not be closed while reads are running.
+	 * Archivers opening the same unchanged archive share the entry table and the readers, so only the first one parses the directory.
+	 */
+	UFUNCTION(BlueprintCallable)
+		bool OpenArchiveForConcurrentReads(const FString& ArchivePath);
+
+	UFUNCTION(BlueprintCallable)
+		bool OpenEncryptedArchiveForConcurrentReads(const FString& ArchivePath, const FString& Password);
+
+	/**
+	 * Opens an existing archive for adding entries. On close the new entries are written behind the end of the archive
+	 * followed by a new central directory, so the cost is proportional to the added data instead of the archive size,
+	 * and a failed write leaves the archive as it was.
+	 * The added entries are first written to a temporary archive next to ArchivePath, which takes as much disk space as their
+	 * compressed data until the archive is closed. Only the central directories are held in memory.
+	 * The old central directory and entries replaced by an added entry of the same name are left behind until CompactArchive is called.
+	 */
+	UFUNCTION(BlueprintCallable)
+		bool OpenArchiveForAppend(const FString& ArchivePath);
+
+	UFUNCTION(BlueprintCallable)
+		bool OpenEncryptedArchiveForAppend(const FString& ArchivePath, const FString& Password);
+
+	/**
+	 * Opens an existing archive for adding and deleting entries. The archive is rewritten on close, but on Linux the data
+	 * in front of the first deleted entry is cloned instead of copied on file systems that support it, such as btrfs and XFS.
+	 */
+	UFUNCTION(BlueprintCallable)
+		bool OpenArchiveForUpdate(const FString& ArchivePath);
+
+	UFUNCTION(BlueprintCallable)
+		bool OpenEncryptedArchiveForUpdate(const FString& ArchivePath, const FString& Password);
+
+	/** Rewrites the archive without the data left behind by replaced entries. Entry data is copied without recompression. */
+	UFUNCTION(BlueprintCallable)
+		static bool CompactArchive(const FString& ArchivePath);
+
+	/**
+	 * Makes AddEntryFromStorage copy the already compressed data of the entry with the same name in ReferenceArchivePath
+	 * instead of compressing the file again when the file matches that entry.
+	 * Must be called after the archive is created. The reference archive is kept open until the archive is closed.
+	 */
+	UFUNCTION(BlueprintCallable)
+		bool SetReferenceArchive(const FString& ReferenceArchivePath, ELibzipReuseMatch Match = ELibzipReuseMatch::SizeAndTime);
+
+	/** Creates OutputPath from the entries of InputPaths. Entry data is copied without decompressing or recompressing it. */
+	UFUNCTION(BlueprintCallable)
+		static bool MergeArchives(const FString& OutputPath, const TArray<FString>& InputPaths, ELibzipMergeConflictPolicy ConflictPolicy);
+
+	/**
+	 * Writes the entries of SourcePath to OutputPath with the entries named in AccessOrder first and in that order,
+	 * followed by the remaining entries in their stored order. Data of replaced entries is dropped and entry data is copied without recompression.
+	 * AccessOrder is typically a trace from GetAccessTrace or a hand-written manifest.
+	 */
+	UFUNCTION(BlueprintCallable)
+		static bool OptimizeArchiveLayout(const FString& SourcePath, const FString& OutputPath, const TArray<FString>& AccessOrder);
+
+	/** Records the names of read entries in the order they are first read. */
+	UFUNCTION(BlueprintCallable)
+		void SetAccessTraceEnabled(bool bEnabled);
+
+	UFUNCTION(BlueprintCallable)
+		TArray<FString> GetAccessTrace() const;
+
+	UFUNCTION(BlueprintCallable)
+		void ClearAccessTrace();
+
 	UFUNCTION(BlueprintCallable)
 		bool CloseArchive();
 
+	/** Closes an archive created with CreateArchiveInMemory and moves its content to Data. Data is empty if no entry was added. */
+	bool CloseArchiveToMemory(TArray64<uint8>& Data);
+
+	/** Copies the archive into a 32-bit array, so it fails for archives of 2 GiB or more. */
+	UFUNCTION(BlueprintCallable, meta = (DisplayName = "Close Archive To Memory"))
+		bool K2_CloseArchiveToMemory(TArray<uint8>& Data);
+
+	/** Commits the archive on a worker thread. Progress and completion are reported on the game thread. Archives in memory are not supported. */
+	void CloseArchiveAsync(TFunction<void(float)> OnProgress, TFunction<void(bool)> OnClosed);
+
+	UFUNCTION(BlueprintCallable, meta = (DisplayName = "Close Archive Async"))
+		void K2_CloseArchiveAsync(const FOnArchiveCloseProgress& OnProgress, const FOnArchiveClosed& OnClosed);
+
+	/** Aborts a pending CloseArchiveAsync. The partially written archive is discarded. */
+	UFUNCTION(BlueprintCallable)
+		void CancelCloseArchive();
+
+	UFUNCTION(BlueprintCallable)
+		bool IsClosingArchive() const;
+
+	/** Statistics of the last operation. Calls that overlap in time, like concurrent reads, count as one operation. */
+	UFUNCTION(BlueprintCallable)
+		FLibzipOperationStats GetLastOperationStats() const;
+
+	/** Statistics of all operations since the archiver was created or its statistics were reset. */
+	UFUNCTION(BlueprintCallable)
+		FLibzipOperationStats GetArchiverStats() const;
+
+	UFUNCTION(BlueprintCallable)
+		void ResetArchiverStats();
+
 	UFUNCTION(BlueprintCallable)
 		bool AddEntryFromStorage(const FString& EntryName, const FString& FilePath);
 
+	UFUNCTION(BlueprintCallable)
+		bool AddEntryFromMemory(const FString& EntryName, const TArray<uint8>& Data);
+
+	bool AddEntryFromMemory(const FString& EntryName, TArray64<uint8>&& Data);
+
+	/** Deletes an entry of an archive opened with OpenArchiveForUpdate. */
+	UFUNCTION(BlueprintCallable)
+		bool DeleteEntry(int64 Index);
+
 	UFUNCTION(BlueprintCallable)
 		int64 GetArchiveEntries();
 
+	/** Returns the index of the entry named Name, or -1 if there is none. */
+	UFUNCTION(BlueprintCallable)
+		int64 FindEntry(const FString& Name);
+
+	/**
+	 * Lists the entry names below the directory Path, which is empty for the root. Without bRecursive these are the files and
+	 * subdirectories directly in Path, with subdirectories ending in a slash; with it, all files below Path.
+	 * Answered from an index of the entry names that is built on first use, so the cost follows the size of the result.
+	 */
+	UFUNCTION(BlueprintCallable)
+		TArray<FString> ListDirectory(const FString& Path, bool bRecursive = false);
+
+	/** Whether any entry is below Path. */
+	UFUNCTION(BlueprintCallable)
+		bool DirectoryExists(const FString& Path);
+
+	/** Total uncompressed size of the entries below Path. */
+	UFUNCTION(BlueprintCallable)
+		int64 GetDirectorySize(const FString& Path);
+
+	/** Fails for entries of 2 GiB or more, which need GetEntryToMemory64 or GetEntryToSharedBuffer. */
 	UFUNCTION(BLueprintCallable)
 		bool GetEntryToMemory(int64 Index, FString& Name, TArray<uint8>& Data);
 
+	bool GetEntryToMemory64(int64 Index, FString& Name, TArray64<uint8>& Data);
+
+	/** Returns a null buffer on failure. */
+	FSharedBuffer GetEntryToSharedBuffer(int64 Index, FString& Name);
+
 	UFUNCTION(BLueprintCallable)
 		bool WriteEntryToStorage(int64 Index, const FString& BaseDir);
 
+	/**
+	 * Writes all entries under BaseDir in archive order. Small entries are decoded into memory and written in batches,
+	 * through io_uring on Linux, so that extracting many small files is not bound by per-file system calls.
+	 */
+	UFUNCTION(BlueprintCallable)
+		bool WriteAllEntriesToStorage(const FString& BaseDir, ELibzipWriteDurability Durability = ELibzipWriteDurability::None);
+
+	/**
+	 * Writes all entries under BaseDir with reading, decoding and writing running concurrently: one thread reads the compressed data
+	 * in archive order with large sequential reads, DecodeWorkers threads decode it and one thread writes the files in batches.
+	 * Entries over 64 MiB are written by the decoding threads in chunks instead.
+	 * Needs an archive opened with OpenArchiveFromStorage or OpenArchiveForConcurrentReads.
+	 */
+	UFUNCTION(BlueprintCallable)
+		bool WriteAllEntriesToStoragePipelined(const FString& BaseDir, FLibzipPipelineStats& Stats, int32 DecodeWorkers = 0,
+			ELibzipWriteDurability Durability = ELibzipWriteDurability::None);
+
+	/**
+	 * Opens an entry for streaming reads, so that it can be deserialized without reading all of it into memory first.
+	 * Seeking forward is cheap, and seeking back inflates again from the closest kept inflate state.
+	 * Needs an archive opened with OpenArchiveFromStorage or OpenArchiveForConcurrentReads. Returns null on failure.
+	 */
+	TUniquePtr<FArchive> OpenEntryReader(int64 Index);
+	TUniquePtr<FArchive> OpenEntryReader(const FString& Name);
+
 protected:
 	void WriteArchiveErrLog(const FString& BaseMessage);
+	static void WriteArchiveErrLog(zip* Archive, const FString& BaseMessage);
+
+	void WaitForPendingClose();
+
+	bool AddEntryFromSource(const FString& EntryName, struct zip_source* Source);
+
+	/** Opens an entry for reading. With bOutRaw, small deflate entries are opened without decompression and bOutRaw tells whether that happened. */
+	TSharedPtr<zip_file> OpenEntry(int64 Index, struct zip_stat& Stat, bool* bOutRaw = nullptr);
+	static bool ReadEntryData(zip_file* File, uint8* Data, int64 Size);
+	static bool ReadEntryData(zip_file* File, const struct zip_stat& Stat, bool bRaw, uint8* Data);
+
+	void RecordAccess(const FString& Name);
+	bool ReadEntryConcurrently(int64 Index, FString& Name, TFunctionRef<uint8*(int64 Size)> Allocate);
+
+	/** Readers of the archive file that was opened, shared through FLibzipArchiveRegistry. */
+	TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> GetReaderPool();
+
+	/** Returns null if no archive is open. */
+	TSharedPtr<const FLibzipDirectoryIndex, ESPMode::ThreadSafe> GetDirectoryIndex();
+
+	static bool FinishAppend(const FString& DeltaPath, const FString& ArchivePath);
+
+	bool TryAddEntryFromReference(const FString& EntryName, const FString& FilePath);
+	void CloseReferenceArchive();
+
+public:
+	/** Largest deflate entry read into memory in one go and decoded in a single call. Larger and encrypted entries are streamed through libzip. */
+	UPROPERTY(BlueprintReadWrite, Category = "LibzipArchiver")
+		int64 OneShotDecodeMaxBytes = 64 * 1024 * 1024;
+
+	/** Linux only. Archives opened afterwards are read with O_DIRECT, bypassing the page cache for huge sequential extraction. */
+	UPROPERTY(BlueprintReadWrite, Category = "LibzipArchiver")
+		bool bUseDirectIO = false;
+
+	/** Linux only. Archives opened for update afterwards have their unchanged start cloned where the file system supports it, instead of copied. */
+	UPROPERTY(BlueprintReadWrite, Category = "LibzipArchiver")
+		bool bCloneOnUpdate = true;
+
+	/**
+	 * Archives created afterwards are written in place at their final path instead of to a temporary file renamed on close,
+	 * which halves the peak disk usage. The file is deleted if closing fails, but may be left partial if the process dies meanwhile.
+	 */
+	UPROPERTY(BlueprintReadWrite, Category = "LibzipArchiver")
+		bool bDirectWrite = false;
 
 protected:
 	zip* Zipper;
 	FString Password;
+
+	/** Temporary archive receiving the entries added in append mode. */
+	FString AppendDeltaPath;
+	FString AppendArchivePath;
+
+	/** Previous build of the archive whose compressed entries are reused. */
+	zip* ReferenceZipper;
+	ELibzipReuseMatch ReferenceMatch;
+
+	bool bRecordAccessTrace;
+	TArray<FString> AccessTrace;
+	TSet<FString> TracedEntries;
+	mutable FCriticalSection AccessTraceLock;
+
+	/** Path of an archive opened read-only from storage. */
+	FString OpenedArchivePath;
+
+	/** Path of an archive created in storage, whose size is counted as output when it is closed. */
+	FString CreatedArchivePath;
+
+	/** Created by the constructor. */
+	TSharedPtr<FLibzipStatsCollector, ESPMode::ThreadSafe> OperationStats;
+
+	/** Readers of an archive opened for concurrent reads. */
+	TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> ReaderPool;
+
+	/** Built on first use and dropped whenever entries are added or deleted. */
+	TSharedPtr<const FLibzipDirectoryIndex, ESPMode::ThreadSafe> DirectoryIndex;
+	FCriticalSection DirectoryIndexLock;
+
+	TSharedPtr<FLibzipAsyncCloseState, ESPMode::ThreadSafe> PendingClose;
+	TFuture<bool> PendingCloseResult;
+
+	/** Buffer written by an archive created in memory. */
+	TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe> MemoryArchive;
+
+	/** Reader of an archive opened from the platform file, and its local header offsets in ascending order for prefetching. */
+	TSharedPtr<FLibzipPlatformFileSource, ESPMode::ThreadSafe> PlatformFileSource;
+	TArray<zip_uint64_t> LocalHeaderOffsets;
 };
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "HAL/CriticalSection.h"
+
+class FLibzipReaderPool;
+
+/**
+ * Read-only platform file layer that shows the entries of mounted archives as files below their mount points.
+ * Existence, sizes, time stamps and directory listings come from the central directory, and opened entries are decompressed
+ * on demand. Paths outside the mounted entries, and all writes, go to the lower level.
+ *
+ * Put it on top of the platform file chain before mounting:
+ *   FLibzipPlatformFile* ZipFile = new FLibzipPlatformFile();
+ *   ZipFile->Initialize(&FPlatformFileManager::Get().GetPlatformFile(), TEXT(""));
+ *   FPlatformFileManager::Get().SetPlatformFile(*ZipFile);
+ *   ZipFile->Mount(ArchivePath, FPaths::ProjectModsDir() / TEXT("MyMod"));
+ */
+class LIBZIPARCHIVER_API FLibzipPlatformFile : public IPlatformFile
+{
+public:
+	static const TCHAR* GetTypeName() { return TEXT("LibzipFile"); }
+
+	/**
+	 * Shows the entries of ArchivePath below MountPoint. An archive mounted later hides entries of the same path in
+	 * archives mounted earlier. Mounting an archive again moves it to MountPoint.
+	 */
+	bool Mount(const FString& ArchivePath, const FString& MountPoint, const FString& Password = FString());
+
+	/** Handles opened before stay readable. */
+	bool Unmount(const FString& ArchivePath);
+
+	virtual bool Initialize(IPlatformFile* Inner, const TCHAR* CmdLine) override;
+	virtual IPlatformFile* GetLowerLevel() override { return LowerLevel; }
+	virtual void SetLowerLevel(IPlatformFile* NewLowerLevel) override { LowerLevel = NewLowerLevel; }
+	virtual const TCHAR* GetName() const override { return GetTypeName(); }
+
+	virtual bool FileExists(const TCHAR* Filename) override;
+	virtual int64 FileSize(const TCHAR* Filename) override;
+	virtual bool DeleteFile(const TCHAR* Filename) override;
+	virtual bool IsReadOnly(const TCHAR* Filename) override;
+	virtual bool MoveFile(const TCHAR* To, const TCHAR* From) override;
+	virtual bool SetReadOnly(const TCHAR* Filename, bool bNewReadOnlyValue) override;
+	virtual FDateTime GetTimeStamp(const TCHAR* Filename) override;
+	virtual void SetTimeStamp(const TCHAR* Filename, FDateTime DateTime) override;
+	virtual FDateTime GetAccessTimeStamp(const TCHAR* Filename) override;
+	virtual FString GetFilenameOnDisk(const TCHAR* Filename) override;
+	virtual IFileHandle* OpenRead(const TCHAR* Filename, bool bAllowWrite = false) override;
+	virtual IFileHandle* OpenWrite(const TCHAR* Filename, bool bAppend = false, bool bAllowRead = false) override;
+	virtual bool DirectoryExists(const TCHAR* Directory) override;
+	virtual bool CreateDirectory(const TCHAR* Directory) override;
+	virtual bool DeleteDirectory(const TCHAR* Directory) override;
+	virtual FFileStatData GetStatData(const TCHAR* FilenameOrDirectory) override;
+
+	using IPlatformFile::IterateDirectory;
+	using IPlatformFile::IterateDirectoryStat;
+	virtual bool IterateDirectory(const TCHAR* Directory, FDirectoryVisitor& Visitor) override;
+	virtual bool IterateDirectoryStat(const TCHAR* Directory, FDirectoryStatVisitor& Visitor) override;
+
+private:
+	struct FMountedArchive
+	{
+		FString ArchivePath;
+		FString MountPoint;
+		TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool;
+	};
+
+	struct FMountedFile
+	{
+		TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Pool;
+		int64 Index = -1;
+	};
+
+	/** Full path with forward slashes and without a trailing slash, which is how the mounted paths are keyed. */
+	static FString NormalizePath(const TCHAR* Path);
+
+	void RebuildIndex();
+	void AddToParents(const FString& Path);
+	bool FindFile(const TCHAR* Filename, FMountedFile& File);
+	bool IsMountedDirectory(const TCHAR* Directory);
+	/** Returns invalid stat data for paths that are not mounted. */
+	FFileStatData GetMountedStatData(const FString& Path);
+	/** Lists the mounted children of Directory as paths below Directory as given. Returns false if Directory is not mounted. */
+	bool GetMountedChildren(const TCHAR* Directory, TArray<TPair<FString, bool>>& Children);
+
+	IPlatformFile* LowerLevel = nullptr;
+
+	/** Like the platform file layers of the engine, mounted paths are not case sensitive. */
+	FRWLock IndexLock;
+	TArray<FMountedArchive> Archives;
+	TMap<FString, FMountedFile> Files;
+	/** Every directory that contains mounted entries, with the full paths of its files and subdirectories. */
+	TMap<FString, TSet<FString>> Directories;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "LibzipShardedArchiver.generated.h"
+
+class ULibzipArchiver;
+
+/**
+ * Set of independent zip archives (shards) that are written in parallel and read as one logical archive.
+ * A manifest next to the shards maps every entry name to the shard that contains it.
+ */
+UCLASS(Blueprintable)
+class LIBZIPARCHIVER_API ULibzipShardedArchiver : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * Writes the files of EntryAndFilePaths into the shards BaseName.000.zip, BaseName.001.zip, ... concurrently and the manifest BaseName.zipshards.
+	 * Entries are balanced by size over ShardCount shards, or, if ShardCount is 0, filled in order into shards of at most MaxShardBytes of input.
+	 * An existing build of BaseName is only replaced once all shards are complete, including shards beyond the new count.
+	 * It is moved aside meanwhile and restored if any shard fails or a file cannot be moved into place.
+	 */
+	UFUNCTION(BlueprintCallable)
+		static bool CreateShardedArchive(const FString& BaseName, const TMap<FString, FString>& EntryAndFilePaths, int64 MaxShardBytes, int32 ShardCount, const FString& Password);
+
+	UFUNCTION(BlueprintCallable)
+		static FString GetManifestPath(const FString& BaseName);
+
+public:
+	UFUNCTION(BlueprintCallable)
+		bool OpenShardedArchive(const FString& ManifestPath, const FString& Password);
+
+	UFUNCTION(BlueprintCallable)
+		bool CloseShardedArchive();
+
+	UFUNCTION(BlueprintCallable)
+		int64 GetArchiveEntries();
+
+	/** Returns the index of the entry named Name, or -1 if there is none. */
+	UFUNCTION(BlueprintCallable)
+		int64 FindEntry(const FString& Name);
+
+	UFUNCTION(BlueprintCallable)
+		bool GetEntryToMemory(int64 Index, FString& Name, TArray<uint8>& Data);
+
+	UFUNCTION(BlueprintCallable)
+		bool WriteEntryToStorage(int64 Index, const FString& BaseDir);
+
+protected:
+	struct FShardedEntry
+	{
+		int32 Shard;
+		int64 Index;
+	};
+
+	UPROPERTY(Transient)
+		TArray<ULibzipArchiver*> Shards;
+
+	TArray<FShardedEntry> Entries;
+	TMap<FString, int64> EntryIndices;
+};
@@ -1,10 +1,53 @@
 #include "LibzipArchiver.h"
+#include "LibzipArchiveRegistry.h"
+#include "LibzipArchiverStats.h"
+#include "LibzipCentralDirectory.h"
+#include "LibzipCoreArchive.h"
+#include "LibzipReaderPool.h"
 #include "Misc/AutomationTest.h"
 #include "HAL/PlatformFilemanager.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryWriter.h"
+#include "Async/ParallelFor.h"
+#include <atomic>
+
+namespace
+{
+	/** Passes through to another handle but fails writing after a number of bytes, like a full disk. */
+	class FFailingWriteHandle : public IFileHandle
+	{
+	public:
+		FFailingWriteHandle(IFileHandle& InInner, int64 InWritableBytes)
+			: Inner(InInner), WritableBytes(InWritableBytes)
+		{
+		}
+
+		virtual int64 Tell() override { return Inner.Tell(); }
+		virtual bool Seek(int64 NewPosition) override { return Inner.Seek(NewPosition); }
+		virtual bool SeekFromEnd(int64 NewPositionRelativeToEnd) override { return Inner.SeekFromEnd(NewPositionRelativeToEnd); }
+		virtual bool Read(uint8* Destination, int64 BytesToRead) override { return Inner.Read(Destination, BytesToRead); }
+		virtual bool Flush(const bool bFullFlush) override { return Inner.Flush(bFullFlush); }
+		virtual bool Truncate(int64 NewSize) override { return Inner.Truncate(NewSize); }
+		virtual int64 Size() override { return Inner.Size(); }
+
+		virtual bool Write(const uint8* Source, int64 BytesToWrite) override
+		{
+			const int64 Written = FMath::Min(BytesToWrite, WritableBytes);
+			WritableBytes -= Written;
+			return Inner.Write(Source, Written) && Written == BytesToWrite;
+		}
+
+	private:
+		IFileHandle& Inner;
+		int64 WritableBytes;
+	};
+}
 
 BEGIN_DEFINE_SPEC(Archive, "LibzipArchiver.Archive", EAutomationTestFlags::ProductFilter | EAutomationTestFlags::ApplicationContextMask)
 	void ArchiveFilesTest(const FString& ZipPath, const FString& Password, const TMap<FString, FString>& EntryAndFilePaths);
 	void UnarchiveFilesTest(const FString& ZipPath, const FString& OutDir, const FString& Password, const TArray<FString>& UnarchiveFiles);
+	/** Stored bytes of the first entry, still compressed and encrypted. */
+	TArray<uint8> ReadRawEntryData(const FString& ZipPath);
 
     UPROPERTY(Transient)
 	ULibzipArchiver* Archiver;
@@ -33,8 +76,11 @@ void Archive::UnarchiveFilesTest(const FString& ZipPath, const FString& OutDir,
 		Archiver->OpenEncryptedArchiveFromStorage(ZipPath, Password);
 	TestTrue("open archive", bOpenResult);
 	TestEqual("archive entry number", FString::Printf(TEXT("%lld"), Archiver->GetArchiveEntries()), FString::FromInt(UnarchiveFiles.Num()));
-	bool bWriteResult = Archiver->WriteEntryToStorage(0, OutDir);
-	TestTrue("write entry", bWriteResult);
+	for (int64 Index = 0; Index < Archiver->GetArchiveEntries(); ++Index)
+	{
+		bool bWriteResult = Archiver->WriteEntryToStorage(Index, OutDir);
+		TestTrue("write entry", bWriteResult);
+	}
 	bool bReadCloseResult = Archiver->CloseArchive();
 	TestTrue("close archive", bReadCloseResult);
 	for (auto File : UnarchiveFiles)
@@ -45,6 +91,27 @@ void Archive::UnarchiveFilesTest(const FString& ZipPath, const FString& OutDir,
 
 }
 
+TArray<uint8> Archive::ReadRawEntryData(const FString& ZipPath)
+{
+	TArray<uint8> ArchiveBytes;
+	std::vector<LibzipCore::FEntry> Entries;
+	const bool bRead = FFileHelper::LoadFileToArray(ArchiveBytes, *ZipPath) && LibzipCore::ReadCentralDirectory(ArchiveBytes.Num(),
+		[&ArchiveBytes](uint64_t Offset, uint64_t Size, uint8_t* Out) {
+			FMemory::Memcpy(Out, ArchiveBytes.GetData() + Offset, Size);
+			return true;
+		}, Entries);
+	if (!bRead || Entries.empty() || Entries[0].LocalHeaderOffset + LibzipCore::LocalHeaderSize > static_cast<uint64>(ArchiveBytes.Num()))
+	{
+		return TArray<uint8>();
+	}
+	const int64 DataOffset = LibzipCore::GetDataOffset(&ArchiveBytes[Entries[0].LocalHeaderOffset], Entries[0].LocalHeaderOffset);
+	if (DataOffset < 0 || static_cast<uint64>(DataOffset) + Entries[0].CompressedSize > static_cast<uint64>(ArchiveBytes.Num()))
+	{
+		return TArray<uint8>();
+	}
+	return TArray<uint8>(&ArchiveBytes[DataOffset], Entries[0].CompressedSize);
+}
+
 void Archive::Define()
 {
 	Describe("archive files", [this]() {
@@ -199,6 +266,673 @@ void Archive::Define()
 			TestFalse("write entry", bWriteResult);
 		});
 
+		LatentIt("should archive asynchronously", [this](const FDoneDelegate& Done) {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString TargetFileName = FPaths::GetCleanFilename(TargetFilePath);
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+
+			bool bOpenResult = Archiver->CreateArchiveFromStorage(OutZipPath);
+			TestTrue("open archive", bOpenResult);
+			bool bAddResult = Archiver->AddEntryFromStorage(TargetFileName, TargetFilePath);
+			TestTrue("add entry", bAddResult);
+
+			Archiver->CloseArchiveAsync([this](float Progress) {
+				TestTrue("close progress", Progress >= 0.0f && Progress <= 1.0f);
+			}, [this, OutZipPath, Done](bool bSuccess) {
+				TestTrue("close archive", bSuccess);
+				TestTrue("archive exist", FPaths::FileExists(OutZipPath));
+				Done.Execute();
+			});
+		});
+
+		LatentIt("should discard archive when closing is cancelled", [this](const FDoneDelegate& Done) {
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+
+			bool bOpenResult = Archiver->CreateArchiveFromStorage(OutZipPath);
+			TestTrue("open archive", bOpenResult);
+			// libzip polls for cancellation before every entry and while compressing, so many incompressible entries
+			// keep zip_close busy long after the cancel is requested
+			FRandomStream Random(26);
+			for (int32 Index = 0; Index < 64; ++Index)
+			{
+				TArray64<uint8> Data;
+				Data.SetNumUninitialized(1024 * 1024);
+				for (uint8& Byte : Data)
+				{
+					Byte = static_cast<uint8>(Random.RandHelper(256));
+				}
+				TestTrue("add entry", Archiver->AddEntryFromMemory(FString::Printf(TEXT("entry%02d.bin"), Index), MoveTemp(Data)));
+			}
+
+			Archiver->CloseArchiveAsync([this](float Progress) {
+				Archiver->CancelCloseArchive();
+			}, [this, OutZipPath, Done](bool bSuccess) {
+				TestFalse("close archive", bSuccess);
+				TestFalse("archive exist", FPaths::FileExists(OutZipPath));
+				Done.Execute();
+			});
+			Archiver->CancelCloseArchive();
+		});
+
+		It("should append entries to archive", [this]() {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+
+			ArchiveFilesTest(OutZipPath, "", { { "first.lib", TargetFilePath } });
+			int64 ArchiveSize = FileManager.FileSize(*OutZipPath);
+
+			bool bOpenResult = Archiver->OpenArchiveForAppend(OutZipPath);
+			TestTrue("open archive for append", bOpenResult);
+			bool bAddResult = Archiver->AddEntryFromStorage("second.lib", TargetFilePath);
+			TestTrue("add entry", bAddResult);
+			bool bCloseResult = Archiver->CloseArchive();
+			TestTrue("close archive", bCloseResult);
+			TestTrue("archive grows", FileManager.FileSize(*OutZipPath) > ArchiveSize);
+			TArray<FString> Files;
+			FileManager.FindFiles(Files, *TempDirPath, nullptr);
+			TestEqual("no delta archive left", Files.Num(), 1);
+
+			UnarchiveFilesTest(OutZipPath, TempDirPath, "", { FPaths::Combine(TempDirPath, "first.lib"), FPaths::Combine(TempDirPath, "second.lib") });
+			bool bReopenResult = Archiver->OpenArchiveFromStorage(OutZipPath);
+			TestTrue("open archive", bReopenResult);
+			FString Name;
+			TArray<uint8> Data;
+			bool bGetResult = Archiver->GetEntryToMemory(1, Name, Data);
+			TestTrue("get appended entry", bGetResult);
+			TestEqual("appended entry name", Name, "second.lib");
+			TestEqual("appended entry size", static_cast<int64>(Data.Num()), FileManager.FileSize(*TargetFilePath));
+		});
+
+		It("should keep archive when append fails", [this]() {
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			TArray<uint8> Data;
+			Data.Init('a', 100000);
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(OutZipPath));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("first.txt", Data));
+			TestTrue("close archive", Archiver->CloseArchive());
+			TArray<uint8> ArchiveBytes;
+			FFileHelper::LoadFileToArray(ArchiveBytes, *OutZipPath);
+
+			FString DeltaZipPath = FPaths::Combine(TempDirPath, "delta.zip");
+			TestTrue("create delta", Archiver->CreateArchiveFromStorage(DeltaZipPath));
+			TestTrue("add delta entry", Archiver->AddEntryFromMemory("second.txt", Data));
+			TestTrue("close delta", Archiver->CloseArchive());
+
+			{
+				TUniquePtr<IFileHandle> File(FileManager.OpenWrite(*OutZipPath, true, true));
+				TUniquePtr<IFileHandle> DeltaFile(FileManager.OpenRead(*DeltaZipPath));
+				TestTrue("open archive files", File.IsValid() && DeltaFile.IsValid());
+				if (!File.IsValid() || !DeltaFile.IsValid())
+				{
+					return;
+				}
+				FFailingWriteHandle FailingFile(*File, DeltaFile->Size() / 2);
+				AddExpectedError("Failed to write appended entries", EAutomationExpectedErrorFlags::Contains, 1);
+				TestFalse("append", FLibzipAppender::Append(FailingFile, *DeltaFile));
+			}
+
+			TArray<uint8> RestoredBytes;
+			FFileHelper::LoadFileToArray(RestoredBytes, *OutZipPath);
+			TestTrue("archive unchanged", RestoredBytes == ArchiveBytes);
+			TestTrue("open archive", Archiver->OpenArchiveFromStorage(OutZipPath));
+			TestEqual("entries", Archiver->GetArchiveEntries(), 1ll);
+			FString Name;
+			TArray<uint8> Entry;
+			TestTrue("get entry", Archiver->GetEntryToMemory(0, Name, Entry) && Entry == Data);
+		});
+
+		It("should replace entry on append and compact archive", [this]() {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+
+			ArchiveFilesTest(OutZipPath, "", { { "first.lib", TargetFilePath } });
+			int64 ArchiveSize = FileManager.FileSize(*OutZipPath);
+
+			bool bOpenResult = Archiver->OpenArchiveForAppend(OutZipPath);
+			TestTrue("open archive for append", bOpenResult);
+			bool bAddResult = Archiver->AddEntryFromStorage("first.lib", TargetFilePath);
+			TestTrue("add entry", bAddResult);
+			bool bCloseResult = Archiver->CloseArchive();
+			TestTrue("close archive", bCloseResult);
+			int64 AppendedSize = FileManager.FileSize(*OutZipPath);
+			TestTrue("replaced data is kept", AppendedSize > ArchiveSize);
+
+			UnarchiveFilesTest(OutZipPath, TempDirPath, "", { FPaths::Combine(TempDirPath, "first.lib") });
+
+			bool bCompactResult = ULibzipArchiver::CompactArchive(OutZipPath);
+			TestTrue("compact archive", bCompactResult);
+			TestTrue("compacted archive shrinks", FileManager.FileSize(*OutZipPath) < AppendedSize);
+
+			UnarchiveFilesTest(OutZipPath, TempDirPath, "", { FPaths::Combine(TempDirPath, "first.lib") });
+		});
+
+		It("should rebuild archive reusing entries of reference archive", [this]() {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString TargetFileName = FPaths::GetCleanFilename(TargetFilePath);
+			FString ReferenceZipPath = FPaths::Combine(TempDirPath, "reference.zip");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			FString Password = "Password";
+
+			ArchiveFilesTest(ReferenceZipPath, Password, { { TargetFileName, TargetFilePath } });
+
+			for (ELibzipReuseMatch Match : { ELibzipReuseMatch::SizeAndTime, ELibzipReuseMatch::Content })
+			{
+				bool bCreateResult = Archiver->CreateEncryptedArchiveFromStorage(OutZipPath, Password);
+				TestTrue("create archive", bCreateResult);
+				bool bReferenceResult = Archiver->SetReferenceArchive(ReferenceZipPath, Match);
+				TestTrue("set reference archive", bReferenceResult);
+				bool bAddResult = Archiver->AddEntryFromStorage(TargetFileName, TargetFilePath);
+				TestTrue("add entry", bAddResult);
+				bool bCloseResult = Archiver->CloseArchive();
+				TestTrue("close archive", bCloseResult);
+				// AES salts are random, so the stored data only matches when it was copied instead of encrypted again
+				TArray<uint8> ReferenceData = ReadRawEntryData(ReferenceZipPath);
+				TestTrue("entry data read", ReferenceData.Num() > 0);
+				TestTrue("entry data reused", ReadRawEntryData(OutZipPath) == ReferenceData);
+
+				UnarchiveFilesTest(OutZipPath, TempDirPath, Password, { FPaths::Combine(TempDirPath, TargetFileName) });
+				FileManager.DeleteFile(*OutZipPath);
+			}
+		});
+
+		It("should merge archives", [this]() {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString FirstZipPath = FPaths::Combine(TempDirPath, "first.zip");
+			FString SecondZipPath = FPaths::Combine(TempDirPath, "second.zip");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+
+			ArchiveFilesTest(FirstZipPath, "", { { "first.lib", TargetFilePath } });
+			ArchiveFilesTest(SecondZipPath, "", { { "first.lib", TargetFilePath }, { "second.lib", TargetFilePath } });
+
+			bool bMergeResult = ULibzipArchiver::MergeArchives(OutZipPath, { FirstZipPath, SecondZipPath }, ELibzipMergeConflictPolicy::KeepLast);
+			TestTrue("merge archives", bMergeResult);
+
+			UnarchiveFilesTest(OutZipPath, TempDirPath, "", { FPaths::Combine(TempDirPath, "first.lib"), FPaths::Combine(TempDirPath, "second.lib") });
+		});
+
+		It("should not merge archives with conflicting entries", [this]() {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString FirstZipPath = FPaths::Combine(TempDirPath, "first.zip");
+			FString SecondZipPath = FPaths::Combine(TempDirPath, "second.zip");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+
+			ArchiveFilesTest(FirstZipPath, "", { { "first.lib", TargetFilePath } });
+			ArchiveFilesTest(SecondZipPath, "", { { "first.lib", TargetFilePath } });
+
+			AddExpectedError("Conflicting entry", EAutomationExpectedErrorFlags::Contains, 0);
+			bool bMergeResult = ULibzipArchiver::MergeArchives(OutZipPath, { FirstZipPath, SecondZipPath }, ELibzipMergeConflictPolicy::Fail);
+			TestFalse("merge archives", bMergeResult);
+			TestFalse("archive exist", FPaths::FileExists(OutZipPath));
+		});
+
+		It("should reorder entries by access trace", [this]() {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString SourceZipPath = FPaths::Combine(TempDirPath, "source.zip");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+
+			ArchiveFilesTest(SourceZipPath, "", { { "first.lib", TargetFilePath }, { "second.lib", TargetFilePath } });
+
+			bool bOpenResult = Archiver->OpenArchiveFromStorage(SourceZipPath);
+			TestTrue("open archive", bOpenResult);
+			Archiver->SetAccessTraceEnabled(true);
+			FString Name;
+			TArray<uint8> Data;
+			Archiver->GetEntryToMemory(Archiver->FindEntry("second.lib"), Name, Data);
+			Archiver->GetEntryToMemory(Archiver->FindEntry("first.lib"), Name, Data);
+			TArray<FString> AccessTrace = Archiver->GetAccessTrace();
+			TestEqual("access trace", AccessTrace, TArray<FString>({ "second.lib", "first.lib" }));
+			Archiver->CloseArchive();
+
+			bool bOptimizeResult = ULibzipArchiver::OptimizeArchiveLayout(SourceZipPath, OutZipPath, AccessTrace);
+			TestTrue("optimize archive layout", bOptimizeResult);
+
+			bool bReopenResult = Archiver->OpenArchiveFromStorage(OutZipPath);
+			TestTrue("open archive", bReopenResult);
+			bool bGetResult = Archiver->GetEntryToMemory(0, Name, Data);
+			TestTrue("get entry", bGetResult);
+			TestEqual("first entry", Name, "second.lib");
+			TestEqual("first entry size", static_cast<int64>(Data.Num()), FileManager.FileSize(*TargetFilePath));
+		});
+
+		It("should add entries from memory", [this]() {
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			TArray<uint8> Data;
+			for (int32 Index = 0; Index < 256 * 1024; ++Index)
+			{
+				Data.Add(static_cast<uint8>(Index % 251));
+			}
+
+			bool bCreateResult = Archiver->CreateArchiveFromStorage(OutZipPath);
+			TestTrue("create archive", bCreateResult);
+			TestTrue("add entry", Archiver->AddEntryFromMemory("libzip.bin", Data));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("second.bin", Data));
+			TestTrue("close archive", Archiver->CloseArchive());
+
+			bool bOpenResult = Archiver->OpenArchiveFromStorage(OutZipPath);
+			TestTrue("open archive", bOpenResult);
+			for (const FString EntryName : { FString("libzip.bin"), FString("second.bin") })
+			{
+				FString Name;
+				TArray<uint8> EntryData;
+				bool bGetResult = Archiver->GetEntryToMemory(Archiver->FindEntry(EntryName), Name, EntryData);
+				TestTrue("get entry", bGetResult);
+				TestEqual("entry name", Name, EntryName);
+				TestTrue("entry data", EntryData == Data);
+			}
+		});
+
+		It("should read entries the same with and without one-shot decoding", [this]() {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString TargetFileName = FPaths::GetCleanFilename(TargetFilePath);
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+
+			ArchiveFilesTest(OutZipPath, "", { { TargetFileName, TargetFilePath } });
+
+			bool bOpenResult = Archiver->OpenArchiveFromStorage(OutZipPath);
+			TestTrue("open archive", bOpenResult);
+			FString Name;
+			TArray<uint8> OneShotData;
+			bool bOneShotResult = Archiver->GetEntryToMemory(0, Name, OneShotData);
+			TestTrue("get entry with one-shot decoding", bOneShotResult);
+			Archiver->OneShotDecodeMaxBytes = 0;
+			TArray<uint8> StreamedData;
+			bool bStreamedResult = Archiver->GetEntryToMemory(0, Name, StreamedData);
+			TestTrue("get entry with streaming", bStreamedResult);
+			TestEqual("entry size", static_cast<int64>(OneShotData.Num()), FileManager.FileSize(*TargetFilePath));
+			TestTrue("entry data", OneShotData == StreamedData);
+		});
+
+		It("should unarchive through the platform file", [this]() {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			FString Password = "Password";
+
+			ArchiveFilesTest(OutZipPath, Password, { { "first.lib", TargetFilePath }, { "second.lib", TargetFilePath } });
+
+			bool bOpenResult = Archiver->OpenEncryptedArchiveFromPlatformFile(OutZipPath, Password);
+			TestTrue("open archive", bOpenResult);
+			TestEqual("archive entry number", FString::Printf(TEXT("%lld"), Archiver->GetArchiveEntries()), "2");
+			for (int64 Index = 0; Index < Archiver->GetArchiveEntries(); ++Index)
+			{
+				bool bWriteResult = Archiver->WriteEntryToStorage(Index, TempDirPath);
+				TestTrue("write entry", bWriteResult);
+			}
+			TestEqual("unarchive file size", FileManager.FileSize(*FPaths::Combine(TempDirPath, "first.lib")), FileManager.FileSize(*TargetFilePath));
+			TestEqual("unarchive file size", FileManager.FileSize(*FPaths::Combine(TempDirPath, "second.lib")), FileManager.FileSize(*TargetFilePath));
+		});
+
+		It("should write all entries in batches", [this]() {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			FString OutDir = FPaths::Combine(TempDirPath, "out");
+
+			bool bCreateResult = Archiver->CreateArchiveFromStorage(OutZipPath);
+			TestTrue("create archive", bCreateResult);
+			for (int32 Index = 0; Index < 200; ++Index)
+			{
+				TArray<uint8> Data;
+				Data.Init(static_cast<uint8>(Index), Index);
+				TestTrue("add entry", Archiver->AddEntryFromMemory(FString::Printf(TEXT("dir%d/file%03d.txt"), Index % 3, Index), Data));
+			}
+			TestTrue("add entry", Archiver->AddEntryFromStorage("large.lib", TargetFilePath));
+			TestTrue("close archive", Archiver->CloseArchive());
+
+			bool bOpenResult = Archiver->OpenArchiveFromStorage(OutZipPath);
+			TestTrue("open archive", bOpenResult);
+			bool bWriteResult = Archiver->WriteAllEntriesToStorage(OutDir, ELibzipWriteDurability::SyncPerBatch);
+			TestTrue("write all entries", bWriteResult);
+			TestEqual("small file size", FileManager.FileSize(*FPaths::Combine(OutDir, "dir1", "file199.txt")), 199ll);
+			TestEqual("empty file size", FileManager.FileSize(*FPaths::Combine(OutDir, "dir0", "file000.txt")), 0ll);
+			TestEqual("large file size", FileManager.FileSize(*FPaths::Combine(OutDir, "large.lib")), FileManager.FileSize(*TargetFilePath));
+		});
+
+		It("should write all entries through the pipeline", [this]() {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			FString OutDir = FPaths::Combine(TempDirPath, "out");
+
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(OutZipPath));
+			for (int32 Index = 0; Index < 200; ++Index)
+			{
+				TArray<uint8> Data;
+				Data.Init(static_cast<uint8>(Index), Index * 100);
+				TestTrue("add entry", Archiver->AddEntryFromMemory(FString::Printf(TEXT("dir%d/file%03d.txt"), Index % 3, Index), Data));
+			}
+			TestTrue("add entry", Archiver->AddEntryFromStorage("large.lib", TargetFilePath));
+			// over the size up to which entries are queued for the writing thread
+			const int64 HugeSize = 80ll * 1024 * 1024;
+			TArray64<uint8> HugeData;
+			HugeData.Init('h', HugeSize);
+			TestTrue("add entry", Archiver->AddEntryFromMemory("huge/huge.txt", MoveTemp(HugeData)));
+			TestTrue("close archive", Archiver->CloseArchive());
+
+			TestTrue("open archive", Archiver->OpenArchiveFromStorage(OutZipPath));
+			FLibzipPipelineStats Stats;
+			TestTrue("write all entries", Archiver->WriteAllEntriesToStoragePipelined(OutDir, Stats, 2));
+			TestEqual("entries", Stats.Entries, 202);
+			TestEqual("bytes written", Stats.BytesWritten, 100ll * 199 * 200 / 2 + FileManager.FileSize(*TargetFilePath) + HugeSize);
+			TestEqual("huge file size", FileManager.FileSize(*FPaths::Combine(OutDir, "huge", "huge.txt")), HugeSize);
+			TestEqual("small file size", FileManager.FileSize(*FPaths::Combine(OutDir, "dir1", "file199.txt")), 19900ll);
+			TestEqual("large file size", FileManager.FileSize(*FPaths::Combine(OutDir, "large.lib")), FileManager.FileSize(*TargetFilePath));
+			TArray<uint8> Content;
+			TestTrue("load file", FFileHelper::LoadFileToArray(Content, *FPaths::Combine(OutDir, "dir2", "file050.txt")));
+			TestTrue("file content", Content.Num() == 5000 && Content[4999] == 50);
+		});
+
+		It("should write archive directly to its final path", [this]() {
+			FString TargetFilePath = FPaths::Combine(FPaths::ProjectPluginsDir(),
+				"LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64", "libzip-static.lib");
+			FString TargetFileName = FPaths::GetCleanFilename(TargetFilePath);
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+
+			Archiver->bDirectWrite = true;
+			ArchiveFilesTest(OutZipPath, "", { { TargetFileName, TargetFilePath } });
+			TArray<FString> Files;
+			FileManager.FindFiles(Files, *TempDirPath, nullptr);
+			TestEqual("no temporary file left", Files.Num(), 1);
+
+			// an existing archive is never overwritten
+			const int64 ZipSize = FileManager.FileSize(*OutZipPath);
+			AddExpectedError("Failed to zip_open", EAutomationExpectedErrorFlags::Contains, 0);
+			TestFalse("create existing archive", Archiver->CreateArchiveFromStorage(OutZipPath));
+			TestEqual("existing archive intact", FileManager.FileSize(*OutZipPath), ZipSize);
+
+			UnarchiveFilesTest(OutZipPath, TempDirPath, "", { FPaths::Combine(TempDirPath, TargetFileName) });
+		});
+
+		It("should create archive in memory", [this]() {
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			TArray<uint8> Data;
+			Data.Init('a', 100000);
+
+			TestTrue("create archive", Archiver->CreateArchiveInMemory(1024));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("a.txt", Data));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("dir/b.txt", Data));
+			TArray64<uint8> ZipData;
+			TestTrue("close archive", Archiver->CloseArchiveToMemory(ZipData));
+			TestTrue("local header signature", ZipData.Num() > 4 && FMemory::Memcmp(ZipData.GetData(), "PK\x03\x04", 4) == 0);
+			TArray<FString> Files;
+			FileManager.FindFiles(Files, *TempDirPath, nullptr);
+			TestEqual("nothing written to disk", Files.Num(), 0);
+
+			TestTrue("save archive", FFileHelper::SaveArrayToFile(TArrayView<const uint8>(ZipData.GetData(), static_cast<int32>(ZipData.Num())), *OutZipPath));
+			TestTrue("open archive", Archiver->OpenArchiveFromStorage(OutZipPath));
+			TestEqual("archive entry number", Archiver->GetArchiveEntries(), 2ll);
+			FString Name;
+			TArray<uint8> Entry;
+			TestTrue("get entry", Archiver->GetEntryToMemory(Archiver->FindEntry("dir/b.txt"), Name, Entry));
+			TestTrue("same entry data", Entry == Data);
+		});
+
+		It("should keep archive in memory open when closing it asynchronously", [this]() {
+			TArray<uint8> Data;
+			Data.Init('a', 1000);
+
+			TestTrue("create archive", Archiver->CreateArchiveInMemory());
+			TestTrue("add entry", Archiver->AddEntryFromMemory("a.txt", Data));
+			AddExpectedError("can not be closed asynchronously", EAutomationExpectedErrorFlags::Contains, 1);
+			bool bClosed = true;
+			Archiver->CloseArchiveAsync(nullptr, [&bClosed](bool bSuccess) {
+				bClosed = bSuccess;
+			});
+			TestFalse("close archive async", bClosed);
+
+			TArray64<uint8> ZipData;
+			TestTrue("close archive", Archiver->CloseArchiveToMemory(ZipData));
+			TestTrue("local header signature", ZipData.Num() > 4 && FMemory::Memcmp(ZipData.GetData(), "PK\x03\x04", 4) == 0);
+		});
+
+		It("should update archive", [this]() {
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			TArray<uint8> Data;
+			Data.Init('a', 1000);
+
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(OutZipPath));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("a.txt", Data));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("b.txt", Data));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("c.txt", Data));
+			TestTrue("close archive", Archiver->CloseArchive());
+
+			TestTrue("open archive", Archiver->OpenArchiveForUpdate(OutZipPath));
+			TestTrue("delete entry", Archiver->DeleteEntry(Archiver->FindEntry("c.txt")));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("d.txt", Data));
+			TestTrue("close archive", Archiver->CloseArchive());
+			TArray<FString> Files;
+			FileManager.FindFiles(Files, *TempDirPath, nullptr);
+			TestEqual("no temporary file left", Files.Num(), 1);
+
+			TestTrue("open archive", Archiver->OpenArchiveFromStorage(OutZipPath));
+			TestEqual("archive entry number", Archiver->GetArchiveEntries(), 3ll);
+			TestEqual("deleted entry", Archiver->FindEntry("c.txt"), -1ll);
+			FString Name;
+			TArray<uint8> Entry;
+			TestTrue("get kept entry", Archiver->GetEntryToMemory(Archiver->FindEntry("a.txt"), Name, Entry) && Entry == Data);
+			TestTrue("get added entry", Archiver->GetEntryToMemory(Archiver->FindEntry("d.txt"), Name, Entry) && Entry == Data);
+		});
+
+		It("should read entries concurrently", [this]() {
+			for (const FString& ArchivePassword : { FString(), FString("password") })
+			{
+				FString OutZipPath = FPaths::Combine(TempDirPath, ArchivePassword.IsEmpty() ? "test.zip" : "encrypted.zip");
+				constexpr int32 EntryCount = 32;
+				TArray<TArray<uint8>> Contents;
+				TestTrue("create archive", ArchivePassword.IsEmpty() ? Archiver->CreateArchiveFromStorage(OutZipPath)
+					: Archiver->CreateEncryptedArchiveFromStorage(OutZipPath, ArchivePassword));
+				for (int32 Index = 0; Index < EntryCount; ++Index)
+				{
+					TArray<uint8>& Data = Contents.AddDefaulted_GetRef();
+					for (int32 Pos = 0; Pos < Index * 1000; ++Pos)
+					{
+						Data.Add(static_cast<uint8>(Pos % (Index + 1)));
+					}
+					TestTrue("add entry", Archiver->AddEntryFromMemory(FString::Printf(TEXT("entry%02d.bin"), Index), Data));
+				}
+				TestTrue("close archive", Archiver->CloseArchive());
+
+				TestTrue("open archive", ArchivePassword.IsEmpty() ? Archiver->OpenArchiveForConcurrentReads(OutZipPath)
+					: Archiver->OpenEncryptedArchiveForConcurrentReads(OutZipPath, ArchivePassword));
+				Archiver->SetAccessTraceEnabled(true);
+				Archiver->ClearAccessTrace();
+				std::atomic<int32> Failures{ 0 };
+				ParallelFor(EntryCount * 8, [this, &Contents, &Failures](int32 Task) {
+					const int32 Entry = Task % EntryCount;
+					FString Name;
+					TArray<uint8> Data;
+					if (!Archiver->GetEntryToMemory(Archiver->FindEntry(FString::Printf(TEXT("entry%02d.bin"), Entry)), Name, Data) || Data != Contents[Entry])
+					{
+						++Failures;
+					}
+				});
+				TestEqual("failed reads", Failures.load(), 0);
+				TestEqual("traced entries", Archiver->GetAccessTrace().Num(), EntryCount);
+				TestTrue("close archive", Archiver->CloseArchive());
+			}
+		});
+
+		It("should share archives opened for concurrent reads", [this]() {
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			TArray<uint8> Data;
+			Data.Init('a', 1000);
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(OutZipPath));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("a.txt", Data));
+			TestTrue("close archive", Archiver->CloseArchive());
+
+			FLibzipArchiveRegistry* Registry = FLibzipArchiveRegistry::Get();
+			TestNotNull(TEXT("registry"), Registry);
+			if (Registry == nullptr)
+			{
+				return;
+			}
+			TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> First = Registry->Acquire(OutZipPath, "");
+			TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Second = Registry->Acquire(FPaths::ConvertRelativePathToFull(OutZipPath), "");
+			TestTrue("same archive shared", First.IsValid() && First == Second);
+
+			ULibzipArchiver* OtherArchiver = NewObject<ULibzipArchiver>(ULibzipArchiver::StaticClass());
+			TestTrue("open archive", Archiver->OpenArchiveForConcurrentReads(OutZipPath));
+			TestTrue("open archive again", OtherArchiver->OpenArchiveForConcurrentReads(OutZipPath));
+			FString Name;
+			TArray<uint8> Entry;
+			TestTrue("get entry", OtherArchiver->GetEntryToMemory(OtherArchiver->FindEntry("a.txt"), Name, Entry) && Entry == Data);
+			TestTrue("close archive", OtherArchiver->CloseArchive());
+			// an archive only opened for reading is released at once, also when closed asynchronously
+			bool bClosed = false;
+			Archiver->CloseArchiveAsync(nullptr, [&bClosed](bool bSuccess) {
+				bClosed = bSuccess;
+			});
+			TestTrue("close archive async", bClosed);
+			TestEqual("readers released", First.GetSharedReferenceCount(), 2);
+
+			// a changed file is opened anew
+			TestTrue("update archive", Archiver->OpenArchiveForUpdate(OutZipPath));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("b.txt", Data));
+			TestTrue("close archive", Archiver->CloseArchive());
+			TSharedPtr<FLibzipReaderPool, ESPMode::ThreadSafe> Changed = Registry->Acquire(OutZipPath, "");
+			TestTrue("changed archive reopened", Changed.IsValid() && Changed != First && Changed->Num() == 2);
+
+			First.Reset();
+			Second.Reset();
+			Changed.Reset();
+			TestEqual("released archives", Registry->Num(), 0);
+		});
+
+		It("should create empty archive in memory", [this]() {
+			TestTrue("create archive", Archiver->CreateArchiveInMemory());
+			TArray64<uint8> ZipData;
+			ZipData.Add(1);
+			TestTrue("close archive", Archiver->CloseArchiveToMemory(ZipData));
+			TestEqual("empty data", ZipData.Num(), 0ll);
+
+			AddExpectedError("Not an archive in memory", EAutomationExpectedErrorFlags::Contains, 0);
+			TestFalse("close again", Archiver->CloseArchiveToMemory(ZipData));
+		});
+
+		It("should stream entries through an archive reader", [this]() {
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			TArray<int32> Values;
+			for (int32 Index = 0; Index < 4 * 1024 * 1024; ++Index)
+			{
+				Values.Add(Index / 3);
+			}
+			TArray<uint8> Data;
+			FMemoryWriter Writer(Data);
+			Writer << Values;
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(OutZipPath));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("values.bin", Data));
+			TestTrue("close archive", Archiver->CloseArchive());
+
+			TestTrue("open archive", Archiver->OpenArchiveFromStorage(OutZipPath));
+			TUniquePtr<FArchive> Reader = Archiver->OpenEntryReader("values.bin");
+			TestTrue("open entry reader", Reader.IsValid());
+			if (!Reader.IsValid())
+			{
+				return;
+			}
+			TestEqual("entry size", Reader->TotalSize(), static_cast<int64>(Data.Num()));
+			TArray<int32> ReadValues;
+			*Reader << ReadValues;
+			TestFalse("no error", Reader->IsError());
+			TestTrue("entry values", ReadValues == Values);
+			TestEqual("not traced", Archiver->GetAccessTrace().Num(), 0);
+
+			// back to before the first inflate checkpoint, then forward past it
+			int32 Value = 0;
+			Reader->Seek(sizeof(int32) * (1 + 300001));
+			*Reader << Value;
+			TestEqual("value after seeking back", Value, 100000);
+			Reader->Seek(sizeof(int32) * (1 + 3000001));
+			*Reader << Value;
+			TestEqual("value after seeking forward", Value, 1000000);
+
+			AddExpectedError("Failed to find entry", EAutomationExpectedErrorFlags::Contains, 1);
+			TestFalse("missing entry", Archiver->OpenEntryReader("missing.bin").IsValid());
+		});
+
+		It("should list directories of archive", [this]() {
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			TArray<uint8> Data;
+			Data.Init('a', 100);
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(OutZipPath));
+			for (const FString EntryName : { FString("Maps/Forest/Forest.umap"), FString("Maps/Forest/Trees/Oak.uasset"), FString("Maps/Forest/Trees/Pine.uasset"),
+				FString("Maps/Forest.txt"), FString("Maps/Desert/Desert.umap"), FString("Readme.txt") })
+			{
+				TestTrue("add entry", Archiver->AddEntryFromMemory(EntryName, Data));
+			}
+			TestEqual("root", FString::Join(Archiver->ListDirectory(""), TEXT(",")), "Maps/,Readme.txt");
+			TestTrue("close archive", Archiver->CloseArchive());
+
+			TestTrue("open archive", Archiver->OpenArchiveFromStorage(OutZipPath));
+			TestEqual("directory", FString::Join(Archiver->ListDirectory("Maps/Forest"), TEXT(",")), "Maps/Forest/Forest.umap,Maps/Forest/Trees/");
+			TestEqual("directory recursively", FString::Join(Archiver->ListDirectory("/Maps/Forest/", true), TEXT(",")),
+				"Maps/Forest/Forest.umap,Maps/Forest/Trees/Oak.uasset,Maps/Forest/Trees/Pine.uasset");
+			TestTrue("directory exist", Archiver->DirectoryExists("Maps/Desert"));
+			TestFalse("file is no directory", Archiver->DirectoryExists("Maps/Forest.txt"));
+			TestFalse("directory not exist", Archiver->DirectoryExists("Maps/Swamp"));
+			TestEqual("directory size", Archiver->GetDirectorySize("Maps/Forest"), 300ll);
+			TestEqual("root size", Archiver->GetDirectorySize(""), 600ll);
+		});
+
+		It("should collect operation statistics", [this]() {
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			TArray<uint8> Data;
+			Data.Init('a', 100000);
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(OutZipPath));
+			for (int32 Index = 0; Index < 4; ++Index)
+			{
+				TestTrue("add entry", Archiver->AddEntryFromMemory(FString::Printf(TEXT("entry%d.txt"), Index), Data));
+			}
+			FLibzipOperationStats Stats = Archiver->GetLastOperationStats();
+			TestEqual("added entries", Stats.Entries, 1ll);
+			TestEqual("added bytes", Stats.BytesIn, 100000ll);
+			TestTrue("close archive", Archiver->CloseArchive());
+			TestEqual("archive bytes", Archiver->GetLastOperationStats().BytesOut, FileManager.FileSize(*OutZipPath));
+
+			TestTrue("open archive", Archiver->OpenArchiveForConcurrentReads(OutZipPath));
+			TestTrue("write entries", Archiver->WriteAllEntriesToStorage(TempDirPath));
+			Stats = Archiver->GetLastOperationStats();
+			TestEqual("read entries", Stats.Entries, 4ll);
+			TestEqual("read bytes", Stats.BytesOut, 400000ll);
+			TestTrue("read compressed", Stats.BytesIn > 0 && Stats.BytesIn < Stats.BytesOut);
+			TestTrue("compression ratio", Stats.CompressionRatio > 1.0f);
+			TestTrue("wall time", Stats.WallSeconds > 0.0f);
+			TestTrue("latency percentiles", Stats.P50EntryLatencyMs > 0.0f && Stats.P50EntryLatencyMs <= Stats.P95EntryLatencyMs
+				&& Stats.P95EntryLatencyMs <= Stats.P99EntryLatencyMs);
+
+			FLibzipOperationStats Cumulative = Archiver->GetArchiverStats();
+			TestEqual("all entries", Cumulative.Entries, 8ll);
+			TestTrue("all bytes", Cumulative.BytesOut > Stats.BytesOut);
+			Archiver->ResetArchiverStats();
+			TestEqual("reset entries", Archiver->GetArchiverStats().Entries, 0ll);
+		});
+
+		It("should estimate latency percentiles", [this]() {
+			FLibzipLatencyHistogram Histogram;
+			TestEqual("no samples", Histogram.GetPercentile(0.5), 0ull);
+			for (uint64 Value = 1; Value <= 1000; ++Value)
+			{
+				Histogram.Record(Value * 1000);
+			}
+			// buckets are at most 1/16 of their values wide
+			for (const double Fraction : { 0.5, 0.95, 0.99 })
+			{
+				const double Expected = Fraction * 1000 * 1000;
+				const double Estimate = Histogram.GetPercentile(Fraction);
+				TestTrue(FString::Printf(TEXT("percentile %g"), Fraction), Estimate >= Expected && Estimate <= Expected * (1.0 + 1.0 / 16));
+			}
+			Histogram.Record(TNumericLimits<uint64>::Max());
+			TestTrue("largest value", Histogram.GetPercentile(1.0) > 0);
+		});
+
 		AfterEach([this]() {
 			if (FPaths::DirectoryExists(TempDirPath))
 			{
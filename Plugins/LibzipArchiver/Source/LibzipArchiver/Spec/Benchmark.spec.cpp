@@ -0,0 +1,282 @@
+#include "LibzipArchiver.h"
+#include "Misc/AutomationTest.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace
+{
+	enum class EBenchmarkContent : uint8
+	{
+		/** Words of a small vocabulary, which deflate compresses a few times. */
+		Text,
+		/** Incompressible bytes. */
+		Random,
+	};
+
+	struct FBenchmarkCorpus
+	{
+		const TCHAR* Name;
+		int32 FileCount;
+		int64 FileSize;
+		EBenchmarkContent Content;
+		const TCHAR* Password;
+	};
+
+	const FBenchmarkCorpus BenchmarkCorpora[] = {
+		{ TEXT("TinyFiles"), 20000, 256, EBenchmarkContent::Text, TEXT("") },
+		{ TEXT("HugeFiles"), 3, 128 * 1024 * 1024, EBenchmarkContent::Text, TEXT("") },
+		{ TEXT("Text"), 64, 4 * 1024 * 1024, EBenchmarkContent::Text, TEXT("") },
+		{ TEXT("Random"), 64, 4 * 1024 * 1024, EBenchmarkContent::Random, TEXT("") },
+		{ TEXT("EncryptedTinyFiles"), 20000, 256, EBenchmarkContent::Text, TEXT("Benchmark") },
+		{ TEXT("EncryptedText"), 64, 4 * 1024 * 1024, EBenchmarkContent::Text, TEXT("Benchmark") },
+	};
+
+	const TCHAR* const BenchmarkWords[] = {
+		TEXT("archive "), TEXT("entry "), TEXT("deflate "), TEXT("header "), TEXT("central "), TEXT("directory "), TEXT("level "),
+		TEXT("forest "), TEXT("desert "), TEXT("texture "), TEXT("mesh "), TEXT("sound "), TEXT("0123 "), TEXT("4567 "), TEXT("\n"),
+	};
+
+	TAutoConsoleVariable<float> CVarBenchmarkRegressionThreshold(
+		TEXT("LibzipArchiver.Benchmark.RegressionThreshold"),
+		0.1f,
+		TEXT("Fraction of the baseline throughput a benchmark may lose before it fails."));
+
+	TAutoConsoleVariable<FString> CVarBenchmarkBaselinePath(
+		TEXT("LibzipArchiver.Benchmark.BaselinePath"),
+		TEXT(""),
+		TEXT("Baseline results to compare benchmarks with. Defaults to Saved/Benchmarks/LibzipArchiver/Baseline.json."));
+
+	TAutoConsoleVariable<bool> CVarBenchmarkUpdateBaseline(
+		TEXT("LibzipArchiver.Benchmark.UpdateBaseline"),
+		false,
+		TEXT("Stores the results of the benchmarks that run as their new baseline."));
+
+	FString GetBenchmarkDir()
+	{
+		return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmarks"), TEXT("LibzipArchiver"));
+	}
+
+	FString GetBaselinePath()
+	{
+		const FString Path = CVarBenchmarkBaselinePath.GetValueOnAnyThread();
+		return Path.IsEmpty() ? FPaths::Combine(GetBenchmarkDir(), TEXT("Baseline.json")) : Path;
+	}
+
+	TSharedRef<FJsonObject> LoadBenchmarkJson(const FString& Path)
+	{
+		FString JsonString;
+		TSharedPtr<FJsonObject> Object;
+		if (!FFileHelper::LoadFileToString(JsonString, *Path) || !FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(JsonString), Object) || !Object.IsValid())
+		{
+			return MakeShared<FJsonObject>();
+		}
+		return Object.ToSharedRef();
+	}
+
+	bool SaveBenchmarkJson(const TSharedRef<FJsonObject>& Object, const FString& Path)
+	{
+		FString JsonString;
+		return FJsonSerializer::Serialize(Object, TJsonWriterFactory<>::Create(&JsonString)) && FFileHelper::SaveStringToFile(JsonString, *Path);
+	}
+
+	/** Same content for the same corpus and file on every run and platform. */
+	TArray64<uint8> GenerateBenchmarkFile(const FBenchmarkCorpus& Corpus, int32 File)
+	{
+		FRandomStream Random(static_cast<int32>(FCrc::StrCrc32(Corpus.Name) ^ static_cast<uint32>(File)));
+		TArray64<uint8> Data;
+		Data.SetNumUninitialized(Corpus.FileSize);
+		int64 Pos = 0;
+		if (Corpus.Content == EBenchmarkContent::Random)
+		{
+			for (; Pos < Corpus.FileSize; Pos += sizeof(uint32))
+			{
+				const uint32 Value = Random.GetUnsignedInt();
+				FMemory::Memcpy(Data.GetData() + Pos, &Value, FMath::Min<int64>(sizeof(uint32), Corpus.FileSize - Pos));
+			}
+			return Data;
+		}
+		while (Pos < Corpus.FileSize)
+		{
+			const TCHAR* Word = BenchmarkWords[Random.RandHelper(UE_ARRAY_COUNT(BenchmarkWords))];
+			for (; *Word != TEXT('\0') && Pos < Corpus.FileSize; ++Word, ++Pos)
+			{
+				Data[Pos] = static_cast<uint8>(*Word);
+			}
+		}
+		return Data;
+	}
+}
+
+// Generates large corpora and takes minutes, so it only runs with the perf filter.
+BEGIN_DEFINE_SPEC(Benchmark, "LibzipArchiver.Benchmark", EAutomationTestFlags::PerfFilter | EAutomationTestFlags::ApplicationContextMask)
+	void RunCorpus(const FBenchmarkCorpus& Corpus);
+	void Record(const FBenchmarkCorpus& Corpus, const TCHAR* Operation, double Seconds, int64 Bytes, int32 Files);
+	void CompareWithBaseline(const FBenchmarkCorpus& Corpus);
+
+	UPROPERTY(Transient)
+	ULibzipArchiver* Archiver;
+	FString TempDirPath;
+	TSharedPtr<FJsonObject> CorpusResults;
+	IPlatformFile& FileManager = FPlatformFileManager::Get().GetPlatformFile();
+END_DEFINE_SPEC(Benchmark)
+
+void Benchmark::Record(const FBenchmarkCorpus& Corpus, const TCHAR* Operation, double Seconds, int64 Bytes, int32 Files)
+{
+	Seconds = FMath::Max(Seconds, 1e-6);
+	TSharedRef<FJsonObject> Result = MakeShared<FJsonObject>();
+	Result->SetNumberField(TEXT("Seconds"), Seconds);
+	Result->SetNumberField(TEXT("MBps"), Bytes / (1024.0 * 1024.0) / Seconds);
+	Result->SetNumberField(TEXT("FilesPerSecond"), Files / Seconds);
+	CorpusResults->SetObjectField(Operation, Result);
+	AddInfo(FString::Printf(TEXT("%s %s: %.1f MB/s, %.0f files/s"), Corpus.Name, Operation, Bytes / (1024.0 * 1024.0) / Seconds, Files / Seconds));
+}
+
+void Benchmark::CompareWithBaseline(const FBenchmarkCorpus& Corpus)
+{
+	FileManager.CreateDirectoryTree(*GetBenchmarkDir());
+	const FString ResultsPath = FPaths::Combine(GetBenchmarkDir(), TEXT("Results.json"));
+	TSharedRef<FJsonObject> Results = LoadBenchmarkJson(ResultsPath);
+	Results->SetObjectField(Corpus.Name, CorpusResults);
+	TestTrue("write results", SaveBenchmarkJson(Results, ResultsPath));
+
+	const FString BaselinePath = GetBaselinePath();
+	TSharedRef<FJsonObject> Baseline = LoadBenchmarkJson(BaselinePath);
+	const TSharedPtr<FJsonObject>* CorpusBaseline;
+	if (!Baseline->TryGetObjectField(Corpus.Name, CorpusBaseline))
+	{
+		AddInfo(FString::Printf(TEXT("%s: no baseline in %s"), Corpus.Name, *BaselinePath));
+	}
+	else
+	{
+		const double Threshold = CVarBenchmarkRegressionThreshold.GetValueOnAnyThread();
+		for (const TPair<FString, TSharedPtr<FJsonValue>>& Operation : CorpusResults->Values)
+		{
+			const TSharedPtr<FJsonObject>* OperationBaseline;
+			if (!(*CorpusBaseline)->TryGetObjectField(Operation.Key, OperationBaseline))
+			{
+				continue;
+			}
+			for (const TCHAR* Metric : { TEXT("MBps"), TEXT("FilesPerSecond") })
+			{
+				const double Current = Operation.Value->AsObject()->GetNumberField(Metric);
+				double Expected = 0.0;
+				if (!(*OperationBaseline)->TryGetNumberField(Metric, Expected) || Expected <= 0.0)
+				{
+					continue;
+				}
+				const FString Message = FString::Printf(TEXT("%s %s %s: %.1f against baseline %.1f (%+.1f%%)"),
+					Corpus.Name, *Operation.Key, Metric, Current, Expected, (Current / Expected - 1.0) * 100.0);
+				if (Current < Expected * (1.0 - Threshold))
+				{
+					AddError(TEXT("Regression of ") + Message);
+				}
+				else
+				{
+					AddInfo(Message);
+				}
+			}
+		}
+	}
+
+	if (CVarBenchmarkUpdateBaseline.GetValueOnAnyThread())
+	{
+		Baseline->SetObjectField(Corpus.Name, CorpusResults);
+		TestTrue("write baseline", SaveBenchmarkJson(Baseline, BaselinePath));
+	}
+}
+
+void Benchmark::RunCorpus(const FBenchmarkCorpus& Corpus)
+{
+	const FString CorpusDir = FPaths::Combine(TempDirPath, TEXT("Corpus"));
+	const FString ZipPath = FPaths::Combine(TempDirPath, TEXT("Corpus.zip"));
+	const FString Password = Corpus.Password;
+	const int64 TotalBytes = Corpus.FileCount * Corpus.FileSize;
+	TMap<FString, FString> EntryAndFilePaths;
+	TMap<FString, uint32> EntryCrcs;
+	for (int32 File = 0; File < Corpus.FileCount; ++File)
+	{
+		const FString EntryName = FString::Printf(TEXT("dir%02d/file%06d.dat"), File % 100, File);
+		const TArray64<uint8> Data = GenerateBenchmarkFile(Corpus, File);
+		const FString FilePath = FPaths::Combine(CorpusDir, EntryName);
+		TestTrue("write corpus file", FFileHelper::SaveArrayToFile(Data, *FilePath));
+		EntryAndFilePaths.Add(EntryName, FilePath);
+		EntryCrcs.Add(EntryName, FCrc::MemCrc32(Data.GetData(), static_cast<int32>(Data.Num())));
+	}
+	CorpusResults = MakeShared<FJsonObject>();
+
+	double StartTime = FPlatformTime::Seconds();
+	TestTrue("create archive", Password.IsEmpty() ? Archiver->CreateArchiveFromStorage(ZipPath) : Archiver->CreateEncryptedArchiveFromStorage(ZipPath, Password));
+	for (const TPair<FString, FString>& EntryAndFilePath : EntryAndFilePaths)
+	{
+		TestTrue("add entry", Archiver->AddEntryFromStorage(EntryAndFilePath.Key, EntryAndFilePath.Value));
+	}
+	TestTrue("close archive", Archiver->CloseArchive());
+	Record(Corpus, TEXT("Create"), FPlatformTime::Seconds() - StartTime, TotalBytes, Corpus.FileCount);
+	CorpusResults->GetObjectField(TEXT("Create"))->SetNumberField(TEXT("CompressionRatio"),
+		static_cast<double>(TotalBytes) / FMath::Max<int64>(FileManager.FileSize(*ZipPath), 1));
+
+	StartTime = FPlatformTime::Seconds();
+	TestTrue("open archive", Password.IsEmpty() ? Archiver->OpenArchiveFromStorage(ZipPath) : Archiver->OpenEncryptedArchiveFromStorage(ZipPath, Password));
+	TestEqual("archive entries", Archiver->GetArchiveEntries(), static_cast<int64>(Corpus.FileCount));
+	Record(Corpus, TEXT("Open"), FPlatformTime::Seconds() - StartTime, FileManager.FileSize(*ZipPath), Corpus.FileCount);
+
+	StartTime = FPlatformTime::Seconds();
+	TestEqual("listed entries", Archiver->ListDirectory(TEXT(""), true).Num(), Corpus.FileCount);
+	Record(Corpus, TEXT("List"), FPlatformTime::Seconds() - StartTime, 0, Corpus.FileCount);
+
+	StartTime = FPlatformTime::Seconds();
+	TestTrue("extract entries", Archiver->WriteAllEntriesToStorage(FPaths::Combine(TempDirPath, TEXT("Extracted"))));
+	Record(Corpus, TEXT("Extract"), FPlatformTime::Seconds() - StartTime, TotalBytes, Corpus.FileCount);
+
+	StartTime = FPlatformTime::Seconds();
+	int32 Mismatches = 0;
+	for (int64 Index = 0; Index < Archiver->GetArchiveEntries(); ++Index)
+	{
+		FString Name;
+		TArray64<uint8> Data;
+		const uint32* ExpectedCrc = Archiver->GetEntryToMemory64(Index, Name, Data) ? EntryCrcs.Find(Name) : nullptr;
+		if (ExpectedCrc == nullptr || *ExpectedCrc != FCrc::MemCrc32(Data.GetData(), static_cast<int32>(Data.Num())))
+		{
+			++Mismatches;
+		}
+	}
+	Record(Corpus, TEXT("Verify"), FPlatformTime::Seconds() - StartTime, TotalBytes, Corpus.FileCount);
+	TestEqual("mismatched entries", Mismatches, 0);
+	TestTrue("close archive", Archiver->CloseArchive());
+
+	CompareWithBaseline(Corpus);
+}
+
+void Benchmark::Define()
+{
+	BeforeEach([this]() {
+		TempDirPath = FPaths::Combine(FPaths::ProjectSavedDir(), "temp", "BenchmarkSpec");
+		if (FPaths::DirectoryExists(TempDirPath))
+		{
+			FileManager.DeleteDirectoryRecursively(*TempDirPath);
+		}
+		FileManager.CreateDirectory(*TempDirPath);
+		Archiver = NewObject<ULibzipArchiver>(ULibzipArchiver::StaticClass());
+	});
+
+	for (const FBenchmarkCorpus& Corpus : BenchmarkCorpora)
+	{
+		Describe(Corpus.Name, [this, &Corpus]() {
+			It("should measure create, open, list, extract and verify", [this, &Corpus]() {
+				RunCorpus(Corpus);
+			});
+		});
+	}
+
+	AfterEach([this]() {
+		if (FPaths::DirectoryExists(TempDirPath))
+		{
+			Archiver->CloseArchive();
+			FileManager.DeleteDirectoryRecursively(*TempDirPath);
+		}
+	});
+}
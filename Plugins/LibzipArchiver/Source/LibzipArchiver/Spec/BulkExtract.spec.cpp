@@ -0,0 +1,90 @@
+#include "LibzipArchiver.h"
+#include "Misc/AutomationTest.h"
+#include "HAL/PlatformFilemanager.h"
+
+// Extracts a hundred thousand files, so it only runs with the perf filter.
+BEGIN_DEFINE_SPEC(BulkExtract, "LibzipArchiver.BulkExtract", EAutomationTestFlags::PerfFilter | EAutomationTestFlags::ApplicationContextMask)
+	double MeasureExtraction(const TCHAR* Label, TFunctionRef<bool(const FString&)> Extract);
+
+	UPROPERTY(Transient)
+	ULibzipArchiver* Archiver;
+	FString TempDirPath;
+	IPlatformFile& FileManager = FPlatformFileManager::Get().GetPlatformFile();
+END_DEFINE_SPEC(BulkExtract)
+
+namespace
+{
+	constexpr int32 TinyFileCount = 100000;
+}
+
+double BulkExtract::MeasureExtraction(const TCHAR* Label, TFunctionRef<bool(const FString&)> Extract)
+{
+	const FString OutDir = FPaths::Combine(TempDirPath, Label);
+	const double StartTime = FPlatformTime::Seconds();
+	TestTrue("extract entries", Extract(OutDir));
+	const double Seconds = FPlatformTime::Seconds() - StartTime;
+	TestTrue("last file exist", FPaths::FileExists(FPaths::Combine(OutDir, FString::Printf(TEXT("dir%02d/file%06d.ini"), (TinyFileCount - 1) % 100, TinyFileCount - 1))));
+	AddInfo(FString::Printf(TEXT("%s: %.0f files/s"), Label, TinyFileCount / Seconds));
+	return Seconds;
+}
+
+void BulkExtract::Define()
+{
+	Describe("bulk extraction", [this]() {
+		BeforeEach([this]() {
+			TempDirPath = FPaths::Combine(FPaths::ProjectSavedDir(), "temp", "BulkExtractSpec");
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+			FileManager.CreateDirectory(*TempDirPath);
+			Archiver = NewObject<ULibzipArchiver>(ULibzipArchiver::StaticClass());
+		});
+
+		It("should extract many tiny files faster in batches", [this]() {
+			FString ZipPath = FPaths::Combine(TempDirPath, "tiny.zip");
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(ZipPath));
+			for (int32 Index = 0; Index < TinyFileCount; ++Index)
+			{
+				FString Content = FString::Printf(TEXT("[Section]\nKey=%d\n"), Index);
+				FTCHARToUTF8 Converter(*Content);
+				TArray<uint8> Data(reinterpret_cast<const uint8*>(Converter.Get()), Converter.Length());
+				Archiver->AddEntryFromMemory(FString::Printf(TEXT("dir%02d/file%06d.ini"), Index % 100, Index), Data);
+			}
+			TestTrue("close archive", Archiver->CloseArchive());
+			TestTrue("open archive", Archiver->OpenArchiveFromStorage(ZipPath));
+
+			const double PerEntrySeconds = MeasureExtraction(TEXT("PerEntry"), [this](const FString& OutDir) {
+				bool bResult = true;
+				for (int64 Index = 0; Index < Archiver->GetArchiveEntries(); ++Index)
+				{
+					bResult = Archiver->WriteEntryToStorage(Index, OutDir) && bResult;
+				}
+				return bResult;
+			});
+			const double BatchedSeconds = MeasureExtraction(TEXT("Batched"), [this](const FString& OutDir) {
+				return Archiver->WriteAllEntriesToStorage(OutDir);
+			});
+			MeasureExtraction(TEXT("BatchedSyncPerBatch"), [this](const FString& OutDir) {
+				return Archiver->WriteAllEntriesToStorage(OutDir, ELibzipWriteDurability::SyncPerBatch);
+			});
+			MeasureExtraction(TEXT("Pipelined"), [this](const FString& OutDir) {
+				FLibzipPipelineStats Stats;
+				const bool bResult = Archiver->WriteAllEntriesToStoragePipelined(OutDir, Stats);
+				AddInfo(FString::Printf(TEXT("decode queue %.1f (max %d), write queue %.1f (max %d)"),
+					Stats.AverageDecodeQueueDepth, Stats.MaxDecodeQueueDepth, Stats.AverageWriteQueueDepth, Stats.MaxWriteQueueDepth));
+				return bResult;
+			});
+
+			TestTrue("batched not slower", BatchedSeconds < PerEntrySeconds);
+		});
+
+		AfterEach([this]() {
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				Archiver->CloseArchive();
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+		});
+	});
+}
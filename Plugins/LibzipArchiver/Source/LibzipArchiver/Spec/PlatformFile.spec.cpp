@@ -0,0 +1,126 @@
+#include "LibzipPlatformFile.h"
+#include "LibzipArchiver.h"
+#include "Misc/AutomationTest.h"
+#include "HAL/PlatformFilemanager.h"
+
+BEGIN_DEFINE_SPEC(PlatformFile, "LibzipArchiver.PlatformFile", EAutomationTestFlags::ProductFilter | EAutomationTestFlags::ApplicationContextMask)
+	UPROPERTY(Transient)
+	ULibzipArchiver* Archiver;
+	FString TempDirPath;
+	FString ZipPath;
+	FString MountPoint;
+	TArray<uint8> TextData;
+	TArray<uint8> NoiseData;
+	TUniquePtr<FLibzipPlatformFile> ZipFile;
+	IPlatformFile& FileManager = FPlatformFileManager::Get().GetPlatformFile();
+END_DEFINE_SPEC(PlatformFile)
+
+void PlatformFile::Define()
+{
+	Describe("mounted archive", [this]() {
+		BeforeEach([this]() {
+			TempDirPath = FPaths::ConvertRelativePathToFull(FPaths::Combine(FPaths::ProjectSavedDir(), "temp", "PlatformFileSpec"));
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+			FileManager.CreateDirectory(*TempDirPath);
+			Archiver = NewObject<ULibzipArchiver>(ULibzipArchiver::StaticClass());
+
+			// Large enough to be inflated in chunks past several inflate checkpoints.
+			FString Text;
+			for (int32 Line = 0; Text.Len() < 20 * 1024 * 1024; ++Line)
+			{
+				Text += FString::Printf(TEXT("line %d\n"), Line);
+			}
+			FTCHARToUTF8 Converter(*Text);
+			TextData = TArray<uint8>(reinterpret_cast<const uint8*>(Converter.Get()), Converter.Length());
+			NoiseData.SetNumUninitialized(3 * 1024 * 1024);
+			FRandomStream Random(44);
+			for (uint8& Byte : NoiseData)
+			{
+				Byte = static_cast<uint8>(Random.RandHelper(256));
+			}
+
+			ZipPath = FPaths::Combine(TempDirPath, "mod.zip");
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(ZipPath));
+			Archiver->AddEntryFromMemory("Config/Mod.ini", { 'a', '=', '1' });
+			Archiver->AddEntryFromMemory("Data/Text.txt", TextData);
+			Archiver->AddEntryFromMemory("Data/Noise.bin", NoiseData);
+			TestTrue("close archive", Archiver->CloseArchive());
+
+			MountPoint = FPaths::Combine(TempDirPath, "Mounted");
+			ZipFile = MakeUnique<FLibzipPlatformFile>();
+			ZipFile->Initialize(&FileManager, TEXT(""));
+			TestTrue("mount archive", ZipFile->Mount(ZipPath, MountPoint));
+		});
+
+		It("should answer queries from the central directory", [this]() {
+			TestTrue("file exist", ZipFile->FileExists(*FPaths::Combine(MountPoint, "Config/Mod.ini")));
+			TestFalse("file not exist", ZipFile->FileExists(*FPaths::Combine(MountPoint, "Config/Other.ini")));
+			TestTrue("lower level file exist", ZipFile->FileExists(*ZipPath));
+			TestEqual("file size", ZipFile->FileSize(*FPaths::Combine(MountPoint, "Data/Text.txt")), static_cast<int64>(TextData.Num()));
+			TestTrue("directory exist", ZipFile->DirectoryExists(*FPaths::Combine(MountPoint, "Data")));
+			TestTrue("mounted file read only", ZipFile->IsReadOnly(*FPaths::Combine(MountPoint, "Config/Mod.ini")));
+			TestFalse("mounted file not deleted", ZipFile->DeleteFile(*FPaths::Combine(MountPoint, "Config/Mod.ini")));
+
+			TArray<FString> Found;
+			ZipFile->IterateDirectory(*FPaths::Combine(MountPoint, "Data"), [&Found](const TCHAR* FilenameOrDirectory, bool bIsDirectory) {
+				Found.Add(FPaths::GetCleanFilename(FilenameOrDirectory));
+				return true;
+			});
+			Found.Sort();
+			TestEqual("directory entries", FString::Join(Found, TEXT(",")), "Noise.bin,Text.txt");
+
+			TArray<FString> Files;
+			ZipFile->FindFilesRecursively(Files, *TempDirPath, TEXT(".ini"));
+			TestEqual("recursive ini files", Files.Num(), 1);
+		});
+
+		It("should read and seek in entries", [this]() {
+			for (const TPair<const TCHAR*, const TArray<uint8>*>& Entry : { TPair<const TCHAR*, const TArray<uint8>*>(TEXT("Data/Text.txt"), &TextData),
+				TPair<const TCHAR*, const TArray<uint8>*>(TEXT("Data/Noise.bin"), &NoiseData) })
+			{
+				TUniquePtr<IFileHandle> Handle(ZipFile->OpenRead(*FPaths::Combine(MountPoint, Entry.Key)));
+				TestTrue("open entry", Handle.IsValid());
+				if (!Handle.IsValid())
+				{
+					continue;
+				}
+				const TArray<uint8>& Expected = *Entry.Value;
+				TArray<uint8> Data;
+				Data.SetNumUninitialized(Expected.Num());
+				TestTrue("read entry", Handle->Read(Data.GetData(), Data.Num()));
+				TestTrue("entry content", Data == Expected);
+
+				// Back to the start, then across chunk boundaries in both directions.
+				for (const int64 Offset : { int64(0), int64(Expected.Num() - 100), int64(5 * 1024 * 1024 - 7), int64(1024 * 1024 + 3), int64(300) })
+				{
+					TestTrue("seek entry", Handle->Seek(Offset));
+					uint8 Buffer[64];
+					const int64 Bytes = FMath::Min<int64>(sizeof(Buffer), Expected.Num() - Offset);
+					TestTrue("read after seek", Handle->Read(Buffer, Bytes));
+					TestTrue("content after seek", FMemory::Memcmp(Buffer, Expected.GetData() + Offset, Bytes) == 0);
+				}
+				TestTrue("seek from end", Handle->SeekFromEnd(0));
+				uint8 Byte;
+				TestFalse("read past end", Handle->Read(&Byte, 1));
+			}
+		});
+
+		It("should unmount archives", [this]() {
+			TestTrue("unmount archive", ZipFile->Unmount(ZipPath));
+			TestFalse("file not exist", ZipFile->FileExists(*FPaths::Combine(MountPoint, "Config/Mod.ini")));
+			TestFalse("unmount again", ZipFile->Unmount(ZipPath));
+		});
+
+		AfterEach([this]() {
+			ZipFile.Reset();
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				Archiver->CloseArchive();
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+		});
+	});
+}
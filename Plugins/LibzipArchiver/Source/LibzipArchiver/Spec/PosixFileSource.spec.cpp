@@ -0,0 +1,304 @@
+#include "LibzipArchiver.h"
+#include "LibzipPosixFileSource.h"
+#include "Misc/AutomationTest.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/FileHelper.h"
+
+#if PLATFORM_LINUX
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+// Reports extraction throughput of the POSIX file source next to libzip's stdio source, so it only runs with the perf filter.
+BEGIN_DEFINE_SPEC(PosixFileSource, "LibzipArchiver.PosixFileSource", EAutomationTestFlags::PerfFilter | EAutomationTestFlags::ApplicationContextMask)
+	bool ReadAllEntries(zip* Archive, uint32& Crc, int64& Size);
+	void MeasureSource(const TCHAR* Label, TFunctionRef<zip*()> Open, uint32 ExpectedCrc);
+
+	UPROPERTY(Transient)
+	ULibzipArchiver* Archiver;
+	FString TempDirPath;
+	FString ZipPath;
+	IPlatformFile& FileManager = FPlatformFileManager::Get().GetPlatformFile();
+END_DEFINE_SPEC(PosixFileSource)
+
+namespace
+{
+	constexpr int32 BenchEntryCount = 64;
+	constexpr int64 BenchEntrySize = 4 * 1024 * 1024;
+	constexpr int32 BenchRepeatCount = 3;
+
+	zip* OpenWithPosixSource(const FString& Path, bool bDirectIO)
+	{
+		zip_error_t Error;
+		zip_error_init(&Error);
+		zip_source_t* Source = FLibzipPosixFileSource::Create(Path, bDirectIO, &Error);
+		zip* Archive = Source != NULL ? zip_open_from_source(Source, ZIP_RDONLY, &Error) : NULL;
+		if (Archive == NULL && Source != NULL)
+		{
+			zip_source_free(Source);
+		}
+		zip_error_fini(&Error);
+		return Archive;
+	}
+}
+
+bool PosixFileSource::ReadAllEntries(zip* Archive, uint32& Crc, int64& Size)
+{
+	TArray<uint8> Buffer;
+	Buffer.SetNumUninitialized(1024 * 1024);
+	Crc = 0;
+	Size = 0;
+	for (zip_int64_t Index = 0; Index < zip_get_num_entries(Archive, 0); ++Index)
+	{
+		zip_file* File = zip_fopen_index(Archive, Index, 0);
+		if (File == NULL)
+		{
+			return false;
+		}
+		zip_int64_t ReadByte;
+		while ((ReadByte = zip_fread(File, Buffer.GetData(), Buffer.Num())) > 0)
+		{
+			Crc = FCrc::MemCrc32(Buffer.GetData(), static_cast<int32>(ReadByte), Crc);
+			Size += ReadByte;
+		}
+		zip_fclose(File);
+		if (ReadByte < 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void PosixFileSource::MeasureSource(const TCHAR* Label, TFunctionRef<zip*()> Open, uint32 ExpectedCrc)
+{
+	double BestSeconds = TNumericLimits<double>::Max();
+	for (int32 Repeat = 0; Repeat < BenchRepeatCount; ++Repeat)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		zip* Archive = Open();
+		TestNotNull(TEXT("open archive"), Archive);
+		if (Archive == NULL)
+		{
+			return;
+		}
+		uint32 Crc;
+		int64 Size;
+		TestTrue("read entries", ReadAllEntries(Archive, Crc, Size));
+		zip_discard(Archive);
+		BestSeconds = FMath::Min(BestSeconds, FPlatformTime::Seconds() - StartTime);
+		TestEqual("entries crc", Crc, ExpectedCrc);
+		TestEqual("entries size", Size, BenchEntryCount * BenchEntrySize);
+	}
+
+	AddInfo(FString::Printf(TEXT("%s: %.1f MB/s"), Label, BenchEntryCount * BenchEntrySize / (1024.0 * 1024.0) / BestSeconds));
+}
+
+void PosixFileSource::Define()
+{
+	Describe("posix file source", [this]() {
+		BeforeEach([this]() {
+			TempDirPath = FPaths::Combine(FPaths::ProjectSavedDir(), "temp", "PosixFileSourceSpec");
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+			FileManager.CreateDirectory(*TempDirPath);
+			Archiver = NewObject<ULibzipArchiver>(ULibzipArchiver::StaticClass());
+
+			ZipPath = FPaths::Combine(TempDirPath, "bench.zip");
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(ZipPath));
+			for (int32 Entry = 0; Entry < BenchEntryCount; ++Entry)
+			{
+				// Half random, half repeated, so that entries compress moderately.
+				TArray64<uint8> Data;
+				Data.SetNumUninitialized(BenchEntrySize);
+				uint32 State = Entry + 1;
+				for (int64 Pos = 0; Pos < BenchEntrySize; ++Pos)
+				{
+					State = State * 1664525u + 1013904223u;
+					Data[Pos] = Pos % 2 == 0 ? static_cast<uint8>(State >> 24) : static_cast<uint8>(Pos / 4096);
+				}
+				TestTrue("add entry", Archiver->AddEntryFromMemory(FString::Printf(TEXT("entry%02d.bin"), Entry), MoveTemp(Data)));
+			}
+			TestTrue("close archive", Archiver->CloseArchive());
+		});
+
+		It("should read the same data as the stdio source", [this]() {
+			zip* Archive = OpenWithPosixSource(ZipPath, false);
+			TestNotNull(TEXT("open archive"), Archive);
+			if (Archive == NULL)
+			{
+				return;
+			}
+			uint32 ExpectedCrc;
+			int64 Size;
+			TestTrue("read entries", ReadAllEntries(Archive, ExpectedCrc, Size));
+			zip_discard(Archive);
+
+			// The speeds depend on the machine and on whether the archive is cached, so they are reported rather than checked.
+			MeasureSource(TEXT("stdio"), [this]() {
+				int errorp;
+				return zip_open(TCHAR_TO_UTF8(*ZipPath), ZIP_RDONLY, &errorp);
+			}, ExpectedCrc);
+			MeasureSource(TEXT("pread"), [this]() { return OpenWithPosixSource(ZipPath, false); }, ExpectedCrc);
+			MeasureSource(TEXT("O_DIRECT"), [this]() { return OpenWithPosixSource(ZipPath, true); }, ExpectedCrc);
+		});
+
+		It("should extract through the archiver with direct I/O", [this]() {
+			Archiver->bUseDirectIO = true;
+			TestTrue("open archive", Archiver->OpenArchiveFromStorage(ZipPath));
+			for (int64 Index = 0; Index < Archiver->GetArchiveEntries(); ++Index)
+			{
+				TestTrue("write entry", Archiver->WriteEntryToStorage(Index, TempDirPath));
+			}
+			TestEqual("unarchive file size", FileManager.FileSize(*FPaths::Combine(TempDirPath, "entry00.bin")), BenchEntrySize);
+		});
+
+		It("should update the tail of an archive", [this]() {
+			TArray<uint8> Data;
+			Data.Init('a', 1024);
+			const int64 ZipSize = FileManager.FileSize(*ZipPath);
+
+			const double StartTime = FPlatformTime::Seconds();
+			TestTrue("open archive", Archiver->OpenArchiveForUpdate(ZipPath));
+			TestTrue("delete entry", Archiver->DeleteEntry(BenchEntryCount - 1));
+			TestTrue("add entry", Archiver->AddEntryFromMemory("tail.txt", Data));
+			TestTrue("close archive", Archiver->CloseArchive());
+			// Only a file system sharing extents makes this independent of the archive size, so the time is reported rather than checked.
+			AddInfo(FString::Printf(TEXT("update of %.0f MB archive: %.3f s"), ZipSize / (1024.0 * 1024.0), FPlatformTime::Seconds() - StartTime));
+
+			zip* Archive = OpenWithPosixSource(ZipPath, false);
+			TestNotNull(TEXT("open archive"), Archive);
+			if (Archive != NULL)
+			{
+				uint32 Crc;
+				int64 Size;
+				TestTrue("read entries", ReadAllEntries(Archive, Crc, Size));
+				TestEqual("entries size", Size, (BenchEntryCount - 1) * BenchEntrySize + Data.Num());
+				zip_discard(Archive);
+			}
+		});
+
+		AfterEach([this]() {
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				Archiver->CloseArchive();
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+		});
+	});
+}
+
+BEGIN_DEFINE_SPEC(PosixFileSourceUpdate, "LibzipArchiver.PosixFileSource.Update", EAutomationTestFlags::ProductFilter | EAutomationTestFlags::ApplicationContextMask)
+	void UpdateArchiveTest();
+	bool SupportsCloning();
+
+	UPROPERTY(Transient)
+	ULibzipArchiver* Archiver;
+	FString TempDirPath;
+	FString ZipPath;
+	TArray<TArray<uint8>> EntryData;
+	IPlatformFile& FileManager = FPlatformFileManager::Get().GetPlatformFile();
+END_DEFINE_SPEC(PosixFileSourceUpdate)
+
+void PosixFileSourceUpdate::UpdateArchiveTest()
+{
+	TestTrue("open archive", Archiver->OpenArchiveForUpdate(ZipPath));
+	TestTrue("delete entry", Archiver->DeleteEntry(EntryData.Num() - 1));
+	TestTrue("add entry", Archiver->AddEntryFromMemory("tail.bin", EntryData[0]));
+	TestTrue("close archive", Archiver->CloseArchive());
+
+	TestTrue("reopen archive", Archiver->OpenArchiveFromStorage(ZipPath));
+	TestEqual("archive entry number", Archiver->GetArchiveEntries(), static_cast<int64>(EntryData.Num()));
+	for (int32 Entry = 0; Entry < EntryData.Num() - 1; ++Entry)
+	{
+		FString Name;
+		TArray<uint8> Data;
+		TestTrue("get kept entry", Archiver->GetEntryToMemory(Archiver->FindEntry(FString::Printf(TEXT("entry%d.bin"), Entry)), Name, Data));
+		TestTrue("kept entry data", Data == EntryData[Entry]);
+	}
+	FString Name;
+	TArray<uint8> Data;
+	TestTrue("get added entry", Archiver->GetEntryToMemory(Archiver->FindEntry("tail.bin"), Name, Data));
+	TestTrue("added entry data", Data == EntryData[0]);
+}
+
+bool PosixFileSourceUpdate::SupportsCloning()
+{
+	const FString SourcePath = FPaths::Combine(TempDirPath, "clone_source");
+	const FString ClonePath = FPaths::Combine(TempDirPath, "clone");
+	FFileHelper::SaveArrayToFile(EntryData[0], *SourcePath);
+	const int SourceFd = open(TCHAR_TO_UTF8(*SourcePath), O_RDONLY | O_CLOEXEC);
+	const int CloneFd = open(TCHAR_TO_UTF8(*ClonePath), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	const bool bResult = SourceFd >= 0 && CloneFd >= 0 && ioctl(CloneFd, FICLONE, SourceFd) == 0;
+	close(SourceFd);
+	close(CloneFd);
+	FileManager.DeleteFile(*SourcePath);
+	FileManager.DeleteFile(*ClonePath);
+	return bResult;
+}
+
+void PosixFileSourceUpdate::Define()
+{
+	Describe("posix file source update", [this]() {
+		BeforeEach([this]() {
+			TempDirPath = FPaths::Combine(FPaths::ProjectSavedDir(), "temp", "PosixFileSourceUpdateSpec");
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+			FileManager.CreateDirectory(*TempDirPath);
+			Archiver = NewObject<ULibzipArchiver>(ULibzipArchiver::StaticClass());
+
+			// Incompressible entries, so that the kept start of the archive spans several file system blocks.
+			ZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(ZipPath));
+			EntryData.Reset();
+			uint32 State = 1;
+			for (int32 Entry = 0; Entry < 4; ++Entry)
+			{
+				TArray<uint8>& Data = EntryData.AddDefaulted_GetRef();
+				Data.SetNumUninitialized(256 * 1024);
+				for (uint8& Byte : Data)
+				{
+					State = State * 1664525u + 1013904223u;
+					Byte = static_cast<uint8>(State >> 24);
+				}
+				TestTrue("add entry", Archiver->AddEntryFromMemory(FString::Printf(TEXT("entry%d.bin"), Entry), Data));
+			}
+			TestTrue("close archive", Archiver->CloseArchive());
+		});
+
+		It("should clone the unchanged start of the archive where the file system supports it", [this]() {
+			const bool bSupportsCloning = SupportsCloning();
+			AddInfo(bSupportsCloning ? TEXT("file system shares extents") : TEXT("file system does not share extents, only the fallback is checked"));
+			const int64 CloneCount = FLibzipPosixFileSource::GetCloneCount();
+			UpdateArchiveTest();
+			TestEqual("archive cloned", FLibzipPosixFileSource::GetCloneCount() - CloneCount, bSupportsCloning ? 1ll : 0ll);
+		});
+
+		It("should copy the archive when cloning is refused", [this]() {
+			Archiver->bCloneOnUpdate = false;
+			const int64 CloneCount = FLibzipPosixFileSource::GetCloneCount();
+			UpdateArchiveTest();
+			TestEqual("archive not cloned", FLibzipPosixFileSource::GetCloneCount(), CloneCount);
+		});
+
+		AfterEach([this]() {
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				Archiver->CloseArchive();
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+		});
+	});
+}
+
+#endif
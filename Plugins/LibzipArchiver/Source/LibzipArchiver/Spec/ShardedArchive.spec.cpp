@@ -0,0 +1,119 @@
+#include "LibzipShardedArchiver.h"
+#include "Misc/AutomationTest.h"
+#include "HAL/PlatformFilemanager.h"
+
+BEGIN_DEFINE_SPEC(ShardedArchive, "LibzipArchiver.ShardedArchive", EAutomationTestFlags::ProductFilter | EAutomationTestFlags::ApplicationContextMask)
+	UPROPERTY(Transient)
+	ULibzipShardedArchiver* Archiver;
+	FString TempDirPath;
+	IPlatformFile& FileManager = FPlatformFileManager::Get().GetPlatformFile();
+END_DEFINE_SPEC(ShardedArchive)
+
+void ShardedArchive::Define()
+{
+	Describe("sharded archive", [this]() {
+		BeforeEach([this]() {
+			TempDirPath = FPaths::Combine(FPaths::ProjectSavedDir(), "temp", "ShardedArchiveSpec");
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+			FileManager.CreateDirectory(*TempDirPath);
+			Archiver = NewObject<ULibzipShardedArchiver>(ULibzipShardedArchiver::StaticClass());
+		});
+
+		It("should archive into shards and unarchive", [this]() {
+			FString LibDir = FPaths::Combine(FPaths::ProjectPluginsDir(), "LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64");
+			FString BaseName = FPaths::Combine(TempDirPath, "test");
+
+			bool bCreateResult = ULibzipShardedArchiver::CreateShardedArchive(BaseName, {
+				{ "libzip-static.lib", FPaths::Combine(LibDir, "libzip-static.lib") },
+				{ "libz-static.lib", FPaths::Combine(LibDir, "libz-static.lib") } }, 0, 2, "");
+			TestTrue("create sharded archive", bCreateResult);
+			TestTrue("first shard exist", FPaths::FileExists(BaseName + ".000.zip"));
+			TestTrue("second shard exist", FPaths::FileExists(BaseName + ".001.zip"));
+
+			bool bOpenResult = Archiver->OpenShardedArchive(ULibzipShardedArchiver::GetManifestPath(BaseName), "");
+			TestTrue("open sharded archive", bOpenResult);
+			TestEqual("archive entry number", FString::Printf(TEXT("%lld"), Archiver->GetArchiveEntries()), "2");
+
+			int64 Index = Archiver->FindEntry("libz-static.lib");
+			TestTrue("find entry", Index >= 0);
+			FString Name;
+			TArray<uint8> Data;
+			bool bGetResult = Archiver->GetEntryToMemory(Index, Name, Data);
+			TestTrue("get entry", bGetResult);
+			TestEqual("entry name", Name, "libz-static.lib");
+			TestEqual("entry size", static_cast<int64>(Data.Num()), FileManager.FileSize(*FPaths::Combine(LibDir, "libz-static.lib")));
+
+			bool bCloseResult = Archiver->CloseShardedArchive();
+			TestTrue("close sharded archive", bCloseResult);
+		});
+
+		It("should split shards by size", [this]() {
+			FString LibDir = FPaths::Combine(FPaths::ProjectPluginsDir(), "LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64");
+			FString BaseName = FPaths::Combine(TempDirPath, "test");
+
+			bool bCreateResult = ULibzipShardedArchiver::CreateShardedArchive(BaseName, {
+				{ "libzip-static.lib", FPaths::Combine(LibDir, "libzip-static.lib") },
+				{ "libz-static.lib", FPaths::Combine(LibDir, "libz-static.lib") } }, 1, 0, "Password");
+			TestTrue("create sharded archive", bCreateResult);
+			TestTrue("second shard exist", FPaths::FileExists(BaseName + ".001.zip"));
+
+			bool bOpenResult = Archiver->OpenShardedArchive(ULibzipShardedArchiver::GetManifestPath(BaseName), "Password");
+			TestTrue("open sharded archive", bOpenResult);
+			for (int64 Index = 0; Index < Archiver->GetArchiveEntries(); ++Index)
+			{
+				bool bWriteResult = Archiver->WriteEntryToStorage(Index, TempDirPath);
+				TestTrue("write entry", bWriteResult);
+			}
+			TestTrue("unarchive file exist", FPaths::FileExists(FPaths::Combine(TempDirPath, "libzip-static.lib")));
+			TestTrue("unarchive file exist", FPaths::FileExists(FPaths::Combine(TempDirPath, "libz-static.lib")));
+		});
+
+		It("should rebuild shards and keep them when rebuilding fails", [this]() {
+			FString LibDir = FPaths::Combine(FPaths::ProjectPluginsDir(), "LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64");
+			FString BaseName = FPaths::Combine(TempDirPath, "test");
+			const TMap<FString, FString> Entries = {
+				{ "libzip-static.lib", FPaths::Combine(LibDir, "libzip-static.lib") },
+				{ "libz-static.lib", FPaths::Combine(LibDir, "libz-static.lib") } };
+
+			TestTrue("create sharded archive", ULibzipShardedArchiver::CreateShardedArchive(BaseName, Entries, 0, 2, ""));
+			TestTrue("rebuild sharded archive", ULibzipShardedArchiver::CreateShardedArchive(BaseName, Entries, 0, 2, ""));
+
+			TMap<FString, FString> MissingEntries = Entries;
+			MissingEntries.Add("missing.lib", FPaths::Combine(TempDirPath, "missing.lib"));
+			AddExpectedError("Not exist file for adding entry", EAutomationExpectedErrorFlags::Contains, 1);
+			TestFalse("fail rebuilding", ULibzipShardedArchiver::CreateShardedArchive(BaseName, MissingEntries, 0, 2, ""));
+			TestFalse("no temporary shard left", FPaths::FileExists(BaseName + ".000.zip.tmp") || FPaths::FileExists(BaseName + ".001.zip.tmp"));
+
+			TestTrue("open previous build", Archiver->OpenShardedArchive(ULibzipShardedArchiver::GetManifestPath(BaseName), ""));
+			TestEqual("archive entry number", Archiver->GetArchiveEntries(), 2ll);
+		});
+
+		It("should remove shards beyond the new count when rebuilding", [this]() {
+			FString LibDir = FPaths::Combine(FPaths::ProjectPluginsDir(), "LibzipArchiver", "Source", "ThirdParty", "libzip", "lib", "Win64");
+			FString BaseName = FPaths::Combine(TempDirPath, "test");
+			const TMap<FString, FString> Entries = {
+				{ "libzip-static.lib", FPaths::Combine(LibDir, "libzip-static.lib") },
+				{ "libz-static.lib", FPaths::Combine(LibDir, "libz-static.lib") } };
+
+			TestTrue("create sharded archive", ULibzipShardedArchiver::CreateShardedArchive(BaseName, Entries, 0, 2, ""));
+			TestTrue("rebuild with fewer shards", ULibzipShardedArchiver::CreateShardedArchive(BaseName, Entries, 0, 1, ""));
+			TestTrue("first shard exist", FPaths::FileExists(BaseName + ".000.zip"));
+			TestFalse("second shard removed", FPaths::FileExists(BaseName + ".001.zip"));
+			TestFalse("no previous build left", FPaths::FileExists(BaseName + ".000.zip.old") || FPaths::FileExists(BaseName + ".001.zip.old"));
+
+			TestTrue("open sharded archive", Archiver->OpenShardedArchive(ULibzipShardedArchiver::GetManifestPath(BaseName), ""));
+			TestEqual("archive entry number", Archiver->GetArchiveEntries(), 2ll);
+		});
+
+		AfterEach([this]() {
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				Archiver->CloseShardedArchive();
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+		});
+	});
+}
@@ -0,0 +1,179 @@
+#include "LibzipArchiver.h"
+#include "Misc/AutomationTest.h"
+#include "HAL/PlatformFilemanager.h"
+
+// Writes and reads multi-GB files, so it only runs with the stress filter.
+BEGIN_DEFINE_SPEC(Zip64, "LibzipArchiver.Zip64", EAutomationTestFlags::StressFilter | EAutomationTestFlags::ApplicationContextMask)
+	void WriteLargeFile(const FString& FilePath, int64 Size);
+	bool VerifyLargeData(const uint8* Data, int64 Offset, int64 Size);
+
+	UPROPERTY(Transient)
+	ULibzipArchiver* Archiver;
+	FString TempDirPath;
+	IPlatformFile& FileManager = FPlatformFileManager::Get().GetPlatformFile();
+END_DEFINE_SPEC(Zip64)
+
+namespace
+{
+	constexpr int64 LargeFileBlockSize = 16 * 1024 * 1024;
+
+	/** Incompressible but reproducible content, so that the archive grows as large as the file. */
+	void FillLargeBlock(uint8* Data, int64 Offset, int64 Size)
+	{
+		uint64 State = (Offset / sizeof(uint64)) * 0x9E3779B97F4A7C15ull + 1;
+		for (int64 Pos = 0; Pos < Size; Pos += sizeof(uint64))
+		{
+			State ^= State << 13;
+			State ^= State >> 7;
+			State ^= State << 17;
+			FMemory::Memcpy(Data + Pos, &State, FMath::Min<int64>(sizeof(uint64), Size - Pos));
+		}
+	}
+}
+
+void Zip64::WriteLargeFile(const FString& FilePath, int64 Size)
+{
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*FilePath));
+	TArray<uint8> Block;
+	Block.SetNumUninitialized(LargeFileBlockSize);
+	for (int64 Offset = 0; Offset < Size; Offset += LargeFileBlockSize)
+	{
+		const int64 BlockSize = FMath::Min(LargeFileBlockSize, Size - Offset);
+		FillLargeBlock(Block.GetData(), Offset, BlockSize);
+		Writer->Serialize(Block.GetData(), BlockSize);
+	}
+	TestTrue("write large file", Writer->Close());
+}
+
+bool Zip64::VerifyLargeData(const uint8* Data, int64 Offset, int64 Size)
+{
+	TArray<uint8> Block;
+	Block.SetNumUninitialized(LargeFileBlockSize);
+	for (int64 Pos = 0; Pos < Size; Pos += LargeFileBlockSize)
+	{
+		const int64 BlockSize = FMath::Min(LargeFileBlockSize, Size - Pos);
+		FillLargeBlock(Block.GetData(), Offset + Pos, BlockSize);
+		if (FMemory::Memcmp(Block.GetData(), Data + Pos, BlockSize) != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void Zip64::Define()
+{
+	Describe("zip64 archives", [this]() {
+		BeforeEach([this]() {
+			TempDirPath = FPaths::Combine(FPaths::ProjectSavedDir(), "temp", "Zip64Spec");
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+			FileManager.CreateDirectory(*TempDirPath);
+			Archiver = NewObject<ULibzipArchiver>(ULibzipArchiver::StaticClass());
+		});
+
+		It("should archive and stream out an entry over 4 GiB", [this]() {
+			const int64 FileSize = 4608ll * 1024 * 1024;
+			FString InputPath = FPaths::Combine(TempDirPath, "input", "large.bin");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			WriteLargeFile(InputPath, FileSize);
+
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(OutZipPath));
+			TestTrue("add entry", Archiver->AddEntryFromStorage("large.bin", InputPath));
+			TestTrue("close archive", Archiver->CloseArchive());
+			TestTrue("archive over 4 GiB", FileManager.FileSize(*OutZipPath) > MAX_uint32);
+			FileManager.DeleteFile(*InputPath);
+
+			TestTrue("open archive", Archiver->OpenArchiveFromStorage(OutZipPath));
+			FString Name;
+			TArray<uint8> Data;
+			AddExpectedError("Entry too large for 32-bit array", EAutomationExpectedErrorFlags::Contains, 1);
+			TestFalse("get entry to 32-bit array", Archiver->GetEntryToMemory(0, Name, Data));
+
+			TestTrue("write entry", Archiver->WriteEntryToStorage(0, TempDirPath));
+			FString OutputPath = FPaths::Combine(TempDirPath, "large.bin");
+			TestEqual("unarchive file size", FileManager.FileSize(*OutputPath), FileSize);
+
+			TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*OutputPath));
+			TArray<uint8> Block;
+			Block.SetNumUninitialized(LargeFileBlockSize);
+			bool bVerified = Reader.IsValid();
+			for (int64 Offset = 0; bVerified && Offset < FileSize; Offset += LargeFileBlockSize)
+			{
+				const int64 BlockSize = FMath::Min(LargeFileBlockSize, FileSize - Offset);
+				Reader->Serialize(Block.GetData(), BlockSize);
+				bVerified = VerifyLargeData(Block.GetData(), Offset, BlockSize);
+			}
+			TestTrue("unarchive file content", bVerified);
+		});
+
+		It("should read an entry over 2 GiB to memory", [this]() {
+			const int64 FileSize = 3072ll * 1024 * 1024;
+			FString InputPath = FPaths::Combine(TempDirPath, "input", "large.bin");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			WriteLargeFile(InputPath, FileSize);
+
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(OutZipPath));
+			TestTrue("add entry", Archiver->AddEntryFromStorage("large.bin", InputPath));
+			TestTrue("close archive", Archiver->CloseArchive());
+			FileManager.DeleteFile(*InputPath);
+
+			TestTrue("open archive", Archiver->OpenArchiveFromStorage(OutZipPath));
+			FString Name;
+			TArray64<uint8> Data;
+			TestTrue("get entry to 64-bit array", Archiver->GetEntryToMemory64(0, Name, Data));
+			TestEqual("entry size", Data.Num(), FileSize);
+			TestTrue("entry content", VerifyLargeData(Data.GetData(), 0, Data.Num()));
+			Data.Empty();
+
+			FSharedBuffer Buffer = Archiver->GetEntryToSharedBuffer(0, Name);
+			TestEqual("shared buffer size", static_cast<int64>(Buffer.GetSize()), FileSize);
+		});
+
+		It("should read a deflated entry over 2 GiB concurrently", [this]() {
+			const int64 FileSize = 3072ll * 1024 * 1024;
+			FString InputPath = FPaths::Combine(TempDirPath, "input", "large.txt");
+			FString OutZipPath = FPaths::Combine(TempDirPath, "test.zip");
+			{
+				TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*InputPath));
+				TArray<uint8> Block;
+				Block.Init('a', LargeFileBlockSize);
+				for (int64 Offset = 0; Offset < FileSize; Offset += LargeFileBlockSize)
+				{
+					Writer->Serialize(Block.GetData(), LargeFileBlockSize);
+				}
+				TestTrue("write large file", Writer->Close());
+			}
+
+			TestTrue("create archive", Archiver->CreateArchiveFromStorage(OutZipPath));
+			TestTrue("add entry", Archiver->AddEntryFromStorage("large.txt", InputPath));
+			TestTrue("close archive", Archiver->CloseArchive());
+			FileManager.DeleteFile(*InputPath);
+			TestTrue("entry deflated", FileManager.FileSize(*OutZipPath) < TNumericLimits<int32>::Max());
+
+			TestTrue("open archive", Archiver->OpenArchiveForConcurrentReads(OutZipPath));
+			FString Name;
+			TArray64<uint8> Data;
+			TestTrue("get entry to 64-bit array", Archiver->GetEntryToMemory64(0, Name, Data));
+			TestEqual("entry size", Data.Num(), FileSize);
+			TArray<uint8> Block;
+			Block.Init('a', LargeFileBlockSize);
+			bool bVerified = true;
+			for (int64 Offset = 0; bVerified && Offset < Data.Num(); Offset += LargeFileBlockSize)
+			{
+				bVerified = FMemory::Memcmp(Data.GetData() + Offset, Block.GetData(), FMath::Min(LargeFileBlockSize, Data.Num() - Offset)) == 0;
+			}
+			TestTrue("entry content", bVerified);
+		});
+
+		AfterEach([this]() {
+			if (FPaths::DirectoryExists(TempDirPath))
+			{
+				Archiver->CloseArchive();
+				FileManager.DeleteDirectoryRecursively(*TempDirPath);
+			}
+		});
+	});
+}
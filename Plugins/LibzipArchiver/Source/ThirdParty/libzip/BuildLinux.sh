@@ -0,0 +1,59 @@
+#!/usr/bin/env bash
+# Builds lib/Linux/<architecture>/libzip.a, which libzip.Build.cs links on Linux.
+#
+#   BuildLinux.sh [architecture]
+#
+# architecture defaults to x86_64-unknown-linux-gnu. For other architectures pass a cross compiler in CC, e.g.
+#   CC=aarch64-linux-gnu-gcc BuildLinux.sh aarch64-unknown-linux-gnueabi
+#
+# The library is linked against the engine's zlib and OpenSSL, so build it against their headers by pointing
+# ZLIB_ROOT and OPENSSL_ROOT_DIR at them. Without these the system packages are used, which only works if
+# they are the same major versions as the engine's.
+# Set LIBZIP_SOURCE_DIR to build an unpacked release instead of downloading it.
+set -euo pipefail
+
+LIBZIP_VERSION=1.9.2
+ARCHITECTURE=${1:-x86_64-unknown-linux-gnu}
+MODULE_DIR=$(cd "$(dirname "$0")" && pwd)
+OUTPUT_DIR="$MODULE_DIR/lib/Linux/$ARCHITECTURE"
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+if [ -z "${LIBZIP_SOURCE_DIR:-}" ]; then
+	ARCHIVE="libzip-$LIBZIP_VERSION.tar.xz"
+	curl -fsSL -o "$WORK_DIR/$ARCHIVE" "https://github.com/nih-at/libzip/releases/download/v$LIBZIP_VERSION/$ARCHIVE"
+	echo "SHA-256 of $ARCHIVE: $(sha256sum "$WORK_DIR/$ARCHIVE" | cut -d' ' -f1)"
+	tar -xJf "$WORK_DIR/$ARCHIVE" -C "$WORK_DIR"
+	LIBZIP_SOURCE_DIR="$WORK_DIR/libzip-$LIBZIP_VERSION"
+fi
+
+CMAKE_ARGS=(
+	-DCMAKE_BUILD_TYPE=Release
+	-DCMAKE_POSITION_INDEPENDENT_CODE=ON
+	-DBUILD_SHARED_LIBS=OFF
+	-DENABLE_OPENSSL=ON
+	-DENABLE_GNUTLS=OFF
+	-DENABLE_MBEDTLS=OFF
+	-DENABLE_COMMONCRYPTO=OFF
+	-DENABLE_WINDOWS_CRYPTO=OFF
+	-DENABLE_BZIP2=OFF
+	-DENABLE_LZMA=OFF
+	-DENABLE_ZSTD=OFF
+	-DBUILD_TOOLS=OFF
+	-DBUILD_REGRESS=OFF
+	-DBUILD_EXAMPLES=OFF
+	-DBUILD_DOC=OFF
+)
+if [ -n "${ZLIB_ROOT:-}" ]; then
+	CMAKE_ARGS+=("-DZLIB_ROOT=$ZLIB_ROOT")
+fi
+if [ -n "${OPENSSL_ROOT_DIR:-}" ]; then
+	CMAKE_ARGS+=("-DOPENSSL_ROOT_DIR=$OPENSSL_ROOT_DIR")
+fi
+
+cmake -S "$LIBZIP_SOURCE_DIR" -B "$WORK_DIR/build" "${CMAKE_ARGS[@]}"
+cmake --build "$WORK_DIR/build" --target zip -j"$(nproc)"
+
+mkdir -p "$OUTPUT_DIR"
+cp "$WORK_DIR/build/lib/libzip.a" "$OUTPUT_DIR/libzip.a"
+echo "Built $OUTPUT_DIR/libzip.a"
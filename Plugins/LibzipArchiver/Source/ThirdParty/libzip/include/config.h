@@ -4,6 +4,7 @@
 #include "zipconf.h"
 #endif
 /* BEGIN DEFINES */
+#ifdef _WIN32
 /* #undef HAVE___PROGNAME */
 #define HAVE__CLOSE
 #define HAVE__DUP
@@ -78,6 +79,62 @@
 /* #undef HAVE_SYS_NDIR_H */
 /* #undef WORDS_BIGENDIAN */
 #define HAVE_SHARED
+#else
+/* POSIX (Linux) build: libzip configured with zlib and OpenSSL, 64-bit off_t */
+/* #undef HAVE___PROGNAME */
+/* #undef HAVE__CLOSE */
+/* #undef HAVE__DUP */
+/* #undef HAVE__FDOPEN */
+/* #undef HAVE__FILENO */
+/* #undef HAVE__SETMODE */
+/* #undef HAVE__SNPRINTF */
+/* #undef HAVE__STRDUP */
+/* #undef HAVE__STRICMP */
+/* #undef HAVE__STRTOI64 */
+/* #undef HAVE__STRTOUI64 */
+/* #undef HAVE__UMASK */
+/* #undef HAVE__UNLINK */
+/* #undef HAVE_ARC4RANDOM */
+/* #undef HAVE_CLONEFILE */
+/* #undef HAVE_COMMONCRYPTO */
+#define HAVE_CRYPTO
+#define HAVE_FICLONERANGE
+#define HAVE_FILENO
+#define HAVE_FCHMOD
+#define HAVE_FSEEKO
+#define HAVE_FTELLO
+/* #undef HAVE_GETPROGNAME */
+/* #undef HAVE_GNUTLS */
+/* #undef HAVE_LIBBZ2 */
+/* #undef HAVE_LIBLZMA */
+/* #undef HAVE_LIBZSTD */
+#define HAVE_LOCALTIME_R
+/* #undef HAVE_MBEDTLS */
+#define HAVE_MKSTEMP
+/* #undef HAVE_NULLABLE */
+#define HAVE_OPENSSL
+/* #undef HAVE_SETMODE */
+#define HAVE_SNPRINTF
+#define HAVE_STRCASECMP
+#define HAVE_STRDUP
+/* #undef HAVE_STRICMP */
+#define HAVE_STRTOLL
+#define HAVE_STRTOULL
+#define HAVE_STRUCT_TM_TM_ZONE
+#define HAVE_STDBOOL_H
+#define HAVE_STRINGS_H
+#define HAVE_UNISTD_H
+/* #undef HAVE_WINDOWS_CRYPTO */
+#define SIZEOF_OFF_T 8
+#define SIZEOF_SIZE_T 8
+#define HAVE_DIRENT_H
+#define HAVE_FTS_H
+/* #undef HAVE_NDIR_H */
+/* #undef HAVE_SYS_DIR_H */
+/* #undef HAVE_SYS_NDIR_H */
+/* #undef WORDS_BIGENDIAN */
+#define HAVE_SHARED
+#endif
 /* END DEFINES */
 #define PACKAGE "libzip"
 #define VERSION "1.9.2"
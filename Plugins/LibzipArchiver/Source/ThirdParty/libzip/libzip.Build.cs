@@ -18,5 +18,16 @@ public class LibZip : ModuleRules
             PublicAdditionalLibraries.Add(Path.Combine(ModuleDirectory, "lib", "Win64", "libzip-static.lib"));
             PublicAdditionalLibraries.Add(Path.Combine(ModuleDirectory, "lib", "Win64", "libz-static.lib"));
         }
+        else if (Target.Platform == UnrealTargetPlatform.Linux)
+        {
+            // libzip 1.9.2 with OpenSSL for AES and no other codecs, built by BuildLinux.sh.
+            string LibraryPath = Path.Combine(ModuleDirectory, "lib", "Linux", Target.Architecture, "libzip.a");
+            if (!File.Exists(LibraryPath))
+            {
+                throw new BuildException("Missing {0}. Build it with {1} {2}", LibraryPath, Path.Combine(ModuleDirectory, "BuildLinux.sh"), Target.Architecture);
+            }
+            PublicAdditionalLibraries.Add(LibraryPath);
+            AddEngineThirdPartyPrivateStaticDependencies(Target, "zlib", "OpenSSL");
+        }
     }
 }
\ No newline at end of file
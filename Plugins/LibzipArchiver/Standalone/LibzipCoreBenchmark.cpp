@@ -0,0 +1,248 @@
+#include "LibzipCoreArchive.h"
+#include "LibzipCoreDirectoryIndex.h"
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <random>
+#include "zlib.h"
+
+/**
+ * Benchmarks of the engine independent read path over synthetic archives written on first use to the temp directory.
+ * The archives match the TinyFiles and Text corpora of the LibzipArchiver.Benchmark automation spec.
+ */
+namespace
+{
+	struct FCorpus
+	{
+		const char* Name;
+		int EntryCount;
+		size_t EntrySize;
+		bool bText;
+	};
+
+	constexpr FCorpus TinyFiles = { "TinyFiles", 10000, 256, false };
+	constexpr FCorpus Text = { "Text", 64, 1024 * 1024, true };
+
+	void AppendUInt16(std::vector<uint8_t>& Out, uint32_t Value)
+	{
+		Out.push_back(static_cast<uint8_t>(Value));
+		Out.push_back(static_cast<uint8_t>(Value >> 8));
+	}
+
+	void AppendUInt32(std::vector<uint8_t>& Out, uint32_t Value)
+	{
+		AppendUInt16(Out, Value & 0xFFFF);
+		AppendUInt16(Out, Value >> 16);
+	}
+
+	std::vector<uint8_t> MakeContent(const FCorpus& Corpus, int Index)
+	{
+		static const char* const Words[] = { "archive", "entry", "deflate", "central", "directory", "header", "stream", "buffer" };
+		std::mt19937 Random(static_cast<uint32_t>(Index));
+		std::vector<uint8_t> Content(Corpus.EntrySize);
+		for (size_t Pos = 0; Pos < Content.size();)
+		{
+			if (Corpus.bText)
+			{
+				const char* Word = Words[Random() % 8];
+				for (; *Word != 0 && Pos < Content.size(); ++Word)
+				{
+					Content[Pos++] = static_cast<uint8_t>(*Word);
+				}
+				if (Pos < Content.size())
+				{
+					Content[Pos++] = ' ';
+				}
+			}
+			else
+			{
+				Content[Pos++] = static_cast<uint8_t>(Random());
+			}
+		}
+		return Content;
+	}
+
+	/** Writes a deflate archive with entries spread over nested directories and returns its path. */
+	std::string WriteCorpus(const FCorpus& Corpus)
+	{
+		const std::filesystem::path Path = std::filesystem::temp_directory_path() / (std::string("LibzipCoreBenchmark_") + Corpus.Name + ".zip");
+		std::vector<uint8_t> Archive;
+		std::vector<uint8_t> Directory;
+		for (int Index = 0; Index < Corpus.EntryCount; ++Index)
+		{
+			const std::string Name = "Dir" + std::to_string(Index % 16) + "/Sub" + std::to_string(Index % 7) + "/File" + std::to_string(Index) + ".bin";
+			const std::vector<uint8_t> Content = MakeContent(Corpus, Index);
+
+			std::vector<uint8_t> Compressed(compressBound(static_cast<uLong>(Content.size())));
+			z_stream Stream = {};
+			deflateInit2(&Stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+			Stream.next_in = const_cast<Bytef*>(Content.data());
+			Stream.avail_in = static_cast<uInt>(Content.size());
+			Stream.next_out = Compressed.data();
+			Stream.avail_out = static_cast<uInt>(Compressed.size());
+			deflate(&Stream, Z_FINISH);
+			Compressed.resize(Stream.total_out);
+			deflateEnd(&Stream);
+
+			const uint32_t Crc = static_cast<uint32_t>(crc32(0L, Content.data(), static_cast<uInt>(Content.size())));
+			const uint32_t Offset = static_cast<uint32_t>(Archive.size());
+
+			AppendUInt32(Archive, 0x04034b50);
+			AppendUInt16(Archive, 20);
+			AppendUInt16(Archive, 0);
+			AppendUInt16(Archive, LibzipCore::MethodDeflate);
+			AppendUInt32(Archive, 0);
+			AppendUInt32(Archive, Crc);
+			AppendUInt32(Archive, static_cast<uint32_t>(Compressed.size()));
+			AppendUInt32(Archive, static_cast<uint32_t>(Content.size()));
+			AppendUInt16(Archive, static_cast<uint32_t>(Name.size()));
+			AppendUInt16(Archive, 0);
+			Archive.insert(Archive.end(), Name.begin(), Name.end());
+			Archive.insert(Archive.end(), Compressed.begin(), Compressed.end());
+
+			AppendUInt32(Directory, 0x02014b50);
+			AppendUInt16(Directory, 20);
+			AppendUInt16(Directory, 20);
+			AppendUInt16(Directory, 0);
+			AppendUInt16(Directory, LibzipCore::MethodDeflate);
+			AppendUInt32(Directory, 0);
+			AppendUInt32(Directory, Crc);
+			AppendUInt32(Directory, static_cast<uint32_t>(Compressed.size()));
+			AppendUInt32(Directory, static_cast<uint32_t>(Content.size()));
+			AppendUInt16(Directory, static_cast<uint32_t>(Name.size()));
+			AppendUInt32(Directory, 0);
+			AppendUInt16(Directory, 0);
+			AppendUInt16(Directory, 0);
+			AppendUInt32(Directory, 0);
+			AppendUInt32(Directory, Offset);
+			Directory.insert(Directory.end(), Name.begin(), Name.end());
+		}
+
+		const uint32_t DirectoryOffset = static_cast<uint32_t>(Archive.size());
+		Archive.insert(Archive.end(), Directory.begin(), Directory.end());
+		AppendUInt32(Archive, 0x06054b50);
+		AppendUInt32(Archive, 0);
+		AppendUInt16(Archive, static_cast<uint32_t>(Corpus.EntryCount));
+		AppendUInt16(Archive, static_cast<uint32_t>(Corpus.EntryCount));
+		AppendUInt32(Archive, static_cast<uint32_t>(Directory.size()));
+		AppendUInt32(Archive, DirectoryOffset);
+		AppendUInt16(Archive, 0);
+
+		std::FILE* File = std::fopen(Path.string().c_str(), "wb");
+		if (File == nullptr || std::fwrite(Archive.data(), 1, Archive.size(), File) != Archive.size())
+		{
+			std::fprintf(stderr, "Failed to write %s\n", Path.string().c_str());
+			std::exit(1);
+		}
+		std::fclose(File);
+		return Path.string();
+	}
+
+	const std::string& GetCorpusPath(const FCorpus& Corpus)
+	{
+		static std::map<std::string, std::string> Paths;
+		auto Found = Paths.find(Corpus.Name);
+		if (Found == Paths.end())
+		{
+			Found = Paths.emplace(Corpus.Name, WriteCorpus(Corpus)).first;
+		}
+		return Found->second;
+	}
+
+	void OpenArchive(benchmark::State& State, const FCorpus& Corpus)
+	{
+		const std::string& Path = GetCorpusPath(Corpus);
+		for (auto _ : State)
+		{
+			LibzipCore::FArchiveReader Reader;
+			if (!Reader.Open(Path))
+			{
+				State.SkipWithError("Failed to open archive");
+				break;
+			}
+			benchmark::DoNotOptimize(Reader.GetEntries().data());
+		}
+		State.SetItemsProcessed(State.iterations() * Corpus.EntryCount);
+	}
+
+	void BuildDirectoryIndex(benchmark::State& State, const FCorpus& Corpus)
+	{
+		LibzipCore::FArchiveReader Reader;
+		if (!Reader.Open(GetCorpusPath(Corpus)))
+		{
+			State.SkipWithError("Failed to open archive");
+			return;
+		}
+		for (auto _ : State)
+		{
+			LibzipCore::FDirectoryIndex Index;
+			for (const LibzipCore::FEntry& Entry : Reader.GetEntries())
+			{
+				Index.Add(Entry.Name, Entry.Size);
+			}
+			Index.Build();
+			benchmark::DoNotOptimize(Index.GetSize(""));
+		}
+		State.SetItemsProcessed(State.iterations() * Corpus.EntryCount);
+	}
+
+	void ListDirectory(benchmark::State& State, const FCorpus& Corpus)
+	{
+		LibzipCore::FArchiveReader Reader;
+		if (!Reader.Open(GetCorpusPath(Corpus)))
+		{
+			State.SkipWithError("Failed to open archive");
+			return;
+		}
+		LibzipCore::FDirectoryIndex Index;
+		for (const LibzipCore::FEntry& Entry : Reader.GetEntries())
+		{
+			Index.Add(Entry.Name, Entry.Size);
+		}
+		Index.Build();
+
+		std::vector<std::string> Names;
+		for (auto _ : State)
+		{
+			Names.clear();
+			Index.List("Dir3/Sub5", false, Names);
+			benchmark::DoNotOptimize(Names.data());
+		}
+	}
+
+	void ExtractAll(benchmark::State& State, const FCorpus& Corpus)
+	{
+		LibzipCore::FArchiveReader Reader;
+		if (!Reader.Open(GetCorpusPath(Corpus)))
+		{
+			State.SkipWithError("Failed to open archive");
+			return;
+		}
+		std::vector<uint8_t> Data;
+		uint64_t Bytes = 0;
+		for (auto _ : State)
+		{
+			for (size_t Index = 0; Index < Reader.GetEntries().size(); ++Index)
+			{
+				if (!Reader.Read(Index, Data))
+				{
+					State.SkipWithError("Failed to read entry");
+					return;
+				}
+				Bytes += Data.size();
+			}
+		}
+		State.SetBytesProcessed(static_cast<int64_t>(Bytes));
+		State.SetItemsProcessed(State.iterations() * Corpus.EntryCount);
+	}
+}
+
+BENCHMARK_CAPTURE(OpenArchive, TinyFiles, TinyFiles)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(OpenArchive, Text, Text)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BuildDirectoryIndex, TinyFiles, TinyFiles)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(ListDirectory, TinyFiles, TinyFiles)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(ExtractAll, TinyFiles, TinyFiles)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(ExtractAll, Text, Text)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();